@@ -0,0 +1,184 @@
+/* @file
+ * Versioned binary snapshots of predictor state
+ */
+
+#include "cpu/pred/bp_snapshot.hh"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "base/misc.hh"
+
+const char BPSnapshot::magic[8] = { 'B', 'P', 'S', 'N', 'A', 'P', 0, 0 };
+
+namespace
+{
+
+uint64_t
+alignUp(uint64_t offset)
+{
+    return (offset + BPSnapshot::payloadAlign - 1) &
+        ~(BPSnapshot::payloadAlign - 1);
+}
+
+/** pread() all of 'bytes', or fail. */
+bool
+readAt(int fd, void *dest, size_t bytes, uint64_t offset)
+{
+    char *out = static_cast<char *>(dest);
+    while (bytes) {
+        ssize_t n = pread(fd, out, bytes, offset);
+        if (n <= 0)
+            return false;
+        out += n;
+        bytes -= n;
+        offset += n;
+    }
+    return true;
+}
+
+} // anonymous namespace
+
+BPSnapshotWriter::BPSnapshotWriter(const std::string &path,
+                                   const std::string &config)
+    : path(path), config(config)
+{
+}
+
+void
+BPSnapshotWriter::add(const char *name, const void *data, size_t bytes)
+{
+    if (std::strlen(name) >= sizeof(((BPSnapshotSection *)0)->name))
+        panic("Snapshot section name '%s' is too long.\n", name);
+    Pending section = { name, data, bytes };
+    sections.push_back(section);
+}
+
+void
+BPSnapshotWriter::write()
+{
+    BPSnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, BPSnapshot::magic, sizeof(header.magic));
+    header.version = BPSnapshot::version;
+    header.sectionCount = sections.size();
+    header.configOffset =
+        sizeof(header) + sections.size() * sizeof(BPSnapshotSection);
+    header.configBytes = config.size();
+
+    std::vector<BPSnapshotSection> table(sections.size());
+    uint64_t offset = alignUp(header.configOffset + header.configBytes);
+    for (size_t i = 0; i < sections.size(); i++) {
+        std::memset(&table[i], 0, sizeof(table[i]));
+        std::strncpy(table[i].name, sections[i].name.c_str(),
+                     sizeof(table[i].name));
+        table[i].offset = offset;
+        table[i].bytes = sections[i].bytes;
+        offset = alignUp(offset + sections[i].bytes);
+    }
+
+    // Write a new file and rename it over the old one: the tables of a
+    // predictor restored from 'path' are private mappings of it, which
+    // truncating the file in place would pull out from under them.
+    std::string tmp_path = path + ".tmp";
+    std::FILE *file = std::fopen(tmp_path.c_str(), "wb");
+    if (!file)
+        fatal("Cannot create snapshot '%s'.\n", tmp_path.c_str());
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+        (table.empty() || std::fwrite(&table[0], sizeof(table[0]),
+                                      table.size(), file) == table.size()) &&
+        std::fwrite(config.data(), 1, config.size(), file) == config.size();
+    for (size_t i = 0; ok && i < sections.size(); i++) {
+        ok = std::fseek(file, table[i].offset, SEEK_SET) == 0 &&
+            std::fwrite(sections[i].data, 1, sections[i].bytes, file) ==
+            sections[i].bytes;
+    }
+    // extend the file over the padding of the last payload, so every
+    // section can be mapped in whole pages
+    if (ok && offset > (uint64_t)std::ftell(file))
+        ok = std::fseek(file, offset - 1, SEEK_SET) == 0 &&
+            std::fputc(0, file) != EOF;
+    if (std::fclose(file) != 0 || !ok) {
+        std::remove(tmp_path.c_str());
+        fatal("Error writing snapshot '%s'.\n", tmp_path.c_str());
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        fatal("Cannot replace snapshot '%s'.\n", path.c_str());
+    }
+}
+
+BPSnapshotReader::BPSnapshotReader(const std::string &path,
+                                   const std::string &config)
+    : path(path)
+{
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        fatal("Cannot open snapshot '%s'.\n", path.c_str());
+
+    struct stat st;
+    BPSnapshotHeader header;
+    if (fstat(fd, &st) != 0 || !readAt(fd, &header, sizeof(header), 0))
+        fatal("Snapshot '%s' is truncated.\n", path.c_str());
+    if (std::memcmp(header.magic, BPSnapshot::magic, sizeof(header.magic)))
+        fatal("'%s' is not a predictor snapshot.\n", path.c_str());
+    if (header.version != BPSnapshot::version)
+        fatal("Snapshot '%s' has unsupported version %u.\n", path.c_str(),
+              header.version);
+
+    std::string saved(header.configBytes, '\0');
+    sections.resize(header.sectionCount);
+    if ((!sections.empty() &&
+         !readAt(fd, &sections[0], sections.size() * sizeof(sections[0]),
+                 sizeof(header))) ||
+        (!saved.empty() &&
+         !readAt(fd, &saved[0], saved.size(), header.configOffset)))
+        fatal("Snapshot '%s' is truncated.\n", path.c_str());
+    if (saved != config)
+        fatal("Snapshot '%s' was taken of '%s', not '%s'.\n", path.c_str(),
+              saved.c_str(), config.c_str());
+
+    for (size_t i = 0; i < sections.size(); i++) {
+        if (sections[i].offset % BPSnapshot::payloadAlign ||
+            sections[i].offset + sections[i].bytes > (uint64_t)st.st_size)
+            fatal("Snapshot '%s' is truncated.\n", path.c_str());
+    }
+}
+
+BPSnapshotReader::~BPSnapshotReader()
+{
+    close(fd);
+}
+
+const BPSnapshotSection &
+BPSnapshotReader::find(const char *name, size_t bytes) const
+{
+    for (size_t i = 0; i < sections.size(); i++) {
+        if (std::strncmp(sections[i].name, name,
+                         sizeof(sections[i].name)) != 0)
+            continue;
+        if (sections[i].bytes != bytes)
+            fatal("Snapshot '%s' section '%s' holds %llu bytes, not %zu.\n",
+                  path.c_str(), name,
+                  (unsigned long long)sections[i].bytes, bytes);
+        return sections[i];
+    }
+    fatal("Snapshot '%s' has no section '%s'.\n", path.c_str(), name);
+}
+
+uint64_t
+BPSnapshotReader::sectionOffset(const char *name, size_t bytes) const
+{
+    return find(name, bytes).offset;
+}
+
+void
+BPSnapshotReader::read(const char *name, void *dest, size_t bytes) const
+{
+    if (!readAt(fd, dest, bytes, find(name, bytes).offset))
+        fatal("Snapshot '%s' is truncated.\n", path.c_str());
+}
@@ -0,0 +1,116 @@
+/* @file
+ * Versioned binary snapshots of predictor state
+ *
+ * A snapshot holds the tables and registers of one predictor so a
+ * warmed-up predictor can be saved once and restored at the start of
+ * every simulated region. The file is laid out as
+ *
+ *   BPSnapshotHeader                  64 bytes
+ *   BPSnapshotSection[sectionCount]   32 bytes each
+ *   configuration string              configBytes bytes
+ *   section payloads                  each starting on a 4 KiB page
+ *
+ * The configuration string describes the predictor type and the
+ * parameters that shape its tables; a snapshot is only restored into
+ * a predictor with the same string. Payloads are page aligned so the
+ * tables can be mapped copy-on-write straight from the file (see
+ * TableStorage::mapFile()). All fields are in host byte order.
+ */
+
+#ifndef __CPU_PRED_BP_SNAPSHOT_HH__
+#define __CPU_PRED_BP_SNAPSHOT_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct BPSnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    /** Offset and length of the configuration string. */
+    uint64_t configOffset;
+    uint64_t configBytes;
+    uint64_t reserved[4];
+};
+
+struct BPSnapshotSection
+{
+    /** NUL padded section name. */
+    char name[16];
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+namespace BPSnapshot
+{
+
+extern const char magic[8];
+const uint32_t version = 1;
+/** Alignment of the section payloads in the file. */
+const uint64_t payloadAlign = 4096;
+
+} // namespace BPSnapshot
+
+/** Collects named sections and writes them out as one snapshot. */
+class BPSnapshotWriter
+{
+  public:
+    BPSnapshotWriter(const std::string &path, const std::string &config);
+
+    /**
+     * Add a section. 'data' is only read by write(), so it must stay
+     * valid until then.
+     */
+    void add(const char *name, const void *data, size_t bytes);
+
+    /** Write the file. */
+    void write();
+
+  private:
+    struct Pending
+    {
+        std::string name;
+        const void *data;
+        size_t bytes;
+    };
+
+    std::string path;
+    std::string config;
+    std::vector<Pending> sections;
+};
+
+/** Opens a snapshot and hands out its sections. */
+class BPSnapshotReader
+{
+  public:
+    /**
+     * Open 'path' and check it holds a snapshot of a predictor
+     * configured as 'config'.
+     */
+    BPSnapshotReader(const std::string &path, const std::string &config);
+    ~BPSnapshotReader();
+
+    /**
+     * File offset of section 'name', which must be 'bytes' long. To be
+     * mapped through descriptor().
+     */
+    uint64_t sectionOffset(const char *name, size_t bytes) const;
+
+    /** Copy section 'name', which must be 'bytes' long, to 'dest'. */
+    void read(const char *name, void *dest, size_t bytes) const;
+
+    /** Descriptor of the open file; mappings outlive the reader. */
+    int descriptor() const { return fd; }
+
+  private:
+    const BPSnapshotSection &find(const char *name, size_t bytes) const;
+
+    std::string path;
+    int fd;
+    std::vector<BPSnapshotSection> sections;
+};
+
+#endif // __CPU_PRED_BP_SNAPSHOT_HH__
@@ -0,0 +1,381 @@
+/* @file
+ * Compact binary branch trace format
+ */
+
+#include "cpu/pred/bp_trace.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/misc.hh"
+
+namespace
+{
+
+/** Gap values at or above this are stored as a separate varint. */
+const unsigned gapEscape = 63;
+
+inline uint8_t *
+putVarint(uint8_t *out, uint64_t val)
+{
+    while (val >= 0x80) {
+        *out++ = (uint8_t)(val | 0x80);
+        val >>= 7;
+    }
+    *out++ = (uint8_t)val;
+    return out;
+}
+
+/** Longest varint of a 64-bit value. */
+const unsigned maxVarintBytes = 10;
+
+/**
+ * Decode a varint from [in, end). Returns the byte after it, or NULL if
+ * it runs past 'end' or is longer than maxVarintBytes.
+ */
+inline const uint8_t *
+getVarint(const uint8_t *in, const uint8_t *end, uint64_t &val)
+{
+    uint64_t result = 0;
+    unsigned shift = 0;
+    uint8_t byte;
+    do {
+        if (in == end || shift >= 7 * maxVarintBytes)
+            return NULL;
+        byte = *in++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    val = result;
+    return in;
+}
+
+inline uint64_t
+zigzag(int64_t val)
+{
+    return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}
+
+inline int64_t
+unzigzag(uint64_t val)
+{
+    return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+
+} // anonymous namespace
+
+bool
+BranchTrace::isBinaryTrace(const std::string &path)
+{
+    char buf[sizeof(magic)];
+    std::FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    bool match = std::fread(buf, 1, sizeof(buf), f) == sizeof(buf) &&
+        std::memcmp(buf, magic, sizeof(magic)) == 0;
+    std::fclose(f);
+    return match;
+}
+
+unsigned
+BranchTrace::encode(const BranchRecord &rec, Addr prev_pc, uint8_t *out)
+{
+    uint8_t *p = out;
+    bool long_gap = rec.instGap >= gapEscape;
+
+    *p++ = (rec.taken ? 1 : 0) | (rec.conditional ? 2 : 0) |
+        ((long_gap ? gapEscape : rec.instGap) << 2);
+    p = putVarint(p, zigzag((int64_t)(rec.pc - prev_pc)));
+    if (long_gap)
+        p = putVarint(p, rec.instGap);
+    return p - out;
+}
+
+BranchTraceWriter::BranchTraceWriter(const std::string &path,
+                                     uint32_t block_records)
+    : path(path), blockBytes((size_t)block_records *
+                             BranchTrace::maxRecordBytes),
+      blockSize(0), blockFill(0), prevPC(0), fileOffset(sizeof(header))
+{
+    if (block_records == 0)
+        fatal("Trace block size must be non-zero.\n");
+
+    file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        fatal("Cannot create trace '%s'.\n", path.c_str());
+
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, BranchTrace::magic, sizeof(header.magic));
+    header.version = BranchTrace::version;
+    header.blockRecords = block_records;
+
+    // Placeholder, rewritten by close().
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1)
+        fatal("Error writing trace '%s'.\n", path.c_str());
+}
+
+BranchTraceWriter::~BranchTraceWriter()
+{
+    close();
+}
+
+void
+BranchTraceWriter::write(const BranchRecord *recs, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        write(recs[i]);
+}
+
+void
+BranchTraceWriter::beginBlock()
+{
+    BranchTraceBlock blk;
+    blk.offset = fileOffset;
+    blk.firstRecord = header.recordCount;
+    blk.firstInst = header.instCount;
+    index.push_back(blk);
+    prevPC = 0;
+}
+
+void
+BranchTraceWriter::flushBlock()
+{
+    if (blockSize &&
+        std::fwrite(&blockBytes[0], 1, blockSize, file) != blockSize)
+        fatal("Error writing trace '%s'.\n", path.c_str());
+    fileOffset += blockSize;
+    blockSize = 0;
+    blockFill = 0;
+}
+
+void
+BranchTraceWriter::close()
+{
+    if (!file)
+        return;
+
+    flushBlock();
+
+    header.blockCount = index.size();
+    header.indexOffset = fileOffset;
+    size_t index_size = index.size() * sizeof(BranchTraceBlock);
+    if ((index_size &&
+         std::fwrite(&index[0], 1, index_size, file) != index_size) ||
+        std::fseek(file, 0, SEEK_SET) != 0 ||
+        std::fwrite(&header, sizeof(header), 1, file) != 1 ||
+        std::fclose(file) != 0)
+        fatal("Error writing trace '%s'.\n", path.c_str());
+    file = NULL;
+}
+
+BranchTraceFile::BranchTraceFile(const std::string &path)
+    : path(path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        fatal("Cannot open trace '%s'.\n", path.c_str());
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header))
+        fatal("Trace '%s' is truncated.\n", path.c_str());
+    size = st.st_size;
+
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+        fatal("Cannot map trace '%s'.\n", path.c_str());
+    data = static_cast<const uint8_t *>(map);
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    header = reinterpret_cast<const BranchTraceHeader *>(data);
+    if (std::memcmp(header->magic, BranchTrace::magic,
+                    sizeof(header->magic)) != 0)
+        fatal("'%s' is not a branch trace.\n", path.c_str());
+    if (header->version != BranchTrace::version)
+        fatal("Trace '%s' has unsupported version %u.\n", path.c_str(),
+              header->version);
+    if (header->indexOffset < sizeof(*header) ||
+        header->indexOffset > size ||
+        header->blockCount >
+            (size - header->indexOffset) / sizeof(BranchTraceBlock))
+        fatal("Trace '%s' is truncated or was not closed.\n", path.c_str());
+
+    index = reinterpret_cast<const BranchTraceBlock *>(
+        data + header->indexOffset);
+
+    // Every block but the last holds blockRecords records, and the
+    // blocks lie in order between the header and the index.
+    uint64_t per_block = header->blockRecords;
+    if (per_block == 0 ||
+        header->blockCount != (header->recordCount + per_block - 1) /
+            per_block)
+        fatal("Trace '%s' has a corrupt header.\n", path.c_str());
+    uint64_t prev_offset = sizeof(*header);
+    for (uint64_t i = 0; i < header->blockCount; i++) {
+        if (index[i].offset < prev_offset ||
+            index[i].offset > header->indexOffset ||
+            index[i].firstRecord != i * per_block)
+            fatal("Trace '%s' has a corrupt block index.\n", path.c_str());
+        prev_offset = index[i].offset;
+    }
+}
+
+BranchTraceFile::~BranchTraceFile()
+{
+    munmap(const_cast<uint8_t *>(data), size);
+}
+
+const uint8_t *
+BranchTraceFile::blockBegin(uint64_t i) const
+{
+    return data + index[i].offset;
+}
+
+const uint8_t *
+BranchTraceFile::blockEnd(uint64_t i) const
+{
+    return data + (i + 1 < header->blockCount ? index[i + 1].offset :
+                   header->indexOffset);
+}
+
+uint64_t
+BranchTraceFile::blockRecords(uint64_t i) const
+{
+    return (i + 1 < header->blockCount ? index[i + 1].firstRecord :
+            header->recordCount) - index[i].firstRecord;
+}
+
+uint64_t
+BranchTraceFile::findBlock(uint64_t record) const
+{
+    // Every block but the last holds exactly blockRecords records.
+    uint64_t block = record / header->blockRecords;
+    return std::min(block, header->blockCount - 1);
+}
+
+void
+BranchTraceFile::release(uint64_t first, uint64_t last) const
+{
+    if (first >= last)
+        return;
+
+    // Only whole pages inside the range can be dropped.
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = (uintptr_t)blockBegin(first);
+    uintptr_t end = (uintptr_t)blockEnd(last - 1);
+    begin = (begin + page - 1) & ~(page - 1);
+    end &= ~(page - 1);
+    if (begin < end)
+        madvise((void *)begin, end - begin, MADV_DONTNEED);
+}
+
+BranchTraceReader::BranchTraceReader(const BranchTraceFile &trace)
+    : trace(trace), firstBlock(0), lastBlock(trace.numBlocks()),
+      releaseConsumed(false)
+{
+    rangeEnd = trace.numRecords();
+    startBlock(firstBlock);
+}
+
+BranchTraceReader::BranchTraceReader(const BranchTraceFile &trace,
+                                     uint64_t first_block,
+                                     uint64_t last_block)
+    : trace(trace), firstBlock(first_block),
+      lastBlock(std::min(last_block, trace.numBlocks())),
+      releaseConsumed(false)
+{
+    if (firstBlock > lastBlock)
+        firstBlock = lastBlock;
+    rangeEnd = lastBlock < trace.numBlocks() ?
+        trace.block(lastBlock).firstRecord : trace.numRecords();
+    startBlock(firstBlock);
+}
+
+void
+BranchTraceReader::startBlock(uint64_t block)
+{
+    curBlock = block;
+    prevPC = 0;
+    if (block < lastBlock) {
+        cur = trace.blockBegin(block);
+        end = trace.blockEnd(block);
+        position = trace.block(block).firstRecord;
+        blockLimit = position + trace.blockRecords(block);
+    } else {
+        cur = end = NULL;
+        position = blockLimit = rangeEnd;
+    }
+}
+
+void
+BranchTraceReader::corruptBlock() const
+{
+    fatal("Trace '%s' has a corrupt block %llu.\n",
+          trace.getPath().c_str(), (unsigned long long)curBlock);
+}
+
+void
+BranchTraceReader::seek(uint64_t record)
+{
+    if (record >= rangeEnd) {
+        startBlock(lastBlock);
+        return;
+    }
+
+    uint64_t block = trace.findBlock(record);
+    if (block < firstBlock)
+        fatal("Seek before the start of the trace range.\n");
+    startBlock(block);
+
+    BranchRecord skip;
+    while (position < record)
+        read(&skip, 1);
+}
+
+size_t
+BranchTraceReader::read(BranchRecord *recs, size_t max)
+{
+    size_t n = 0;
+
+    while (n < max) {
+        if (cur == end) {
+            if (curBlock >= lastBlock)
+                break;
+            // the bytes of a block must decode to its record count
+            if (position != blockLimit)
+                corruptBlock();
+            if (releaseConsumed)
+                trace.release(curBlock, curBlock + 1);
+            startBlock(curBlock + 1);
+            continue;
+        }
+        if (position == blockLimit)
+            corruptBlock();
+
+        const uint8_t *p = cur;
+        uint8_t flags = *p++;
+        uint64_t delta;
+        p = getVarint(p, end, delta);
+        uint64_t gap = flags >> 2;
+        if (p && gap == gapEscape)
+            p = getVarint(p, end, gap);
+        if (!p || gap > UINT32_MAX)
+            corruptBlock();
+
+        BranchRecord &rec = recs[n++];
+        rec.pc = prevPC + (Addr)unzigzag(delta);
+        rec.instGap = (uint32_t)gap;
+        rec.taken = flags & 1;
+        rec.conditional = flags & 2;
+        prevPC = rec.pc;
+        cur = p;
+        position++;
+    }
+
+    return n;
+}
@@ -0,0 +1,232 @@
+/* @file
+ * Compact binary branch trace format
+ *
+ * A trace is a fixed header, a sequence of independently decodable
+ * blocks of records, and a block index at the end of the file:
+ *
+ *   header   64 bytes, see BranchTraceHeader
+ *   block 0  blockRecords encoded records
+ *   ...
+ *   block N  the remaining records
+ *   index    one BranchTraceBlock per block
+ *
+ * Each record is a flag byte followed by varints:
+ *
+ *   flags    bit 0 taken, bit 1 conditional, bits 2-7 instGap, or 63
+ *            if the gap is stored as a varint after the PC delta
+ *   pc       zigzag varint of pc minus the previous record's pc; the
+ *            previous pc is 0 at the start of every block
+ *   instGap  varint, only present when the flag field holds 63
+ *
+ * so a typical branch takes two to four bytes. Blocks restart the PC
+ * delta chain, which lets a reader seek to any block through the index
+ * and lets a trace be split on block boundaries. All multi-byte fields
+ * are stored in host (little-endian) byte order.
+ */
+
+#ifndef __CPU_PRED_BP_TRACE_HH__
+#define __CPU_PRED_BP_TRACE_HH__
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "base/types.hh"
+
+/** One committed branch. */
+struct BranchRecord
+{
+    /** Branch instruction address. */
+    Addr pc;
+    /** Instructions committed since the previous branch, inclusive. */
+    uint32_t instGap;
+    /** Resolved direction. */
+    bool taken;
+    /** Conditional branches are predicted, the rest use uncondBranch(). */
+    bool conditional;
+};
+
+struct BranchTraceHeader
+{
+    /** "BPTRACE" followed by a NUL. */
+    char magic[8];
+    uint32_t version;
+    /** Records per block; the last block may hold fewer. */
+    uint32_t blockRecords;
+    uint64_t recordCount;
+    /** Sum of instGap over all records. */
+    uint64_t instCount;
+    uint64_t blockCount;
+    /** File offset of the block index. */
+    uint64_t indexOffset;
+    uint64_t reserved[2];
+};
+
+/** Block index entry. */
+struct BranchTraceBlock
+{
+    /** File offset of the first encoded record. */
+    uint64_t offset;
+    /** Trace position of the first record. */
+    uint64_t firstRecord;
+    /** Instructions committed before the first record. */
+    uint64_t firstInst;
+};
+
+namespace BranchTrace
+{
+    const char magic[8] = { 'B', 'P', 'T', 'R', 'A', 'C', 'E', '\0' };
+    const uint32_t version = 1;
+    const uint32_t defaultBlockRecords = 64 * 1024;
+    /** Upper bound on the encoded size of one record. */
+    const unsigned maxRecordBytes = 1 + 10 + 5;
+
+    /** True if the file at 'path' starts with the trace magic. */
+    bool isBinaryTrace(const std::string &path);
+
+    /**
+     * Encode one record into 'out', which must have room for
+     * maxRecordBytes. Returns the number of bytes written.
+     */
+    unsigned encode(const BranchRecord &rec, Addr prev_pc, uint8_t *out);
+}
+
+/**
+ * Streaming trace writer. Records are encoded into a block buffer and
+ * written a block at a time; close() appends the index and fills in the
+ * header.
+ */
+class BranchTraceWriter
+{
+  public:
+    BranchTraceWriter(const std::string &path,
+                      uint32_t block_records =
+                          BranchTrace::defaultBlockRecords);
+    ~BranchTraceWriter();
+
+    void
+    write(const BranchRecord &rec)
+    {
+        if (blockFill == header.blockRecords)
+            flushBlock();
+        if (blockFill == 0)
+            beginBlock();
+        blockSize += BranchTrace::encode(rec, prevPC,
+                                         &blockBytes[blockSize]);
+        prevPC = rec.pc;
+        header.recordCount++;
+        header.instCount += rec.instGap;
+        blockFill++;
+    }
+
+    void write(const BranchRecord *recs, size_t count);
+
+    /** Finish the trace. Called by the destructor if needed. */
+    void close();
+
+  private:
+    void beginBlock();
+    void flushBlock();
+
+    std::string path;
+    std::FILE *file;
+    BranchTraceHeader header;
+    std::vector<BranchTraceBlock> index;
+    std::vector<uint8_t> blockBytes;
+    size_t blockSize;
+    uint32_t blockFill;
+    Addr prevPC;
+    uint64_t fileOffset;
+};
+
+/**
+ * A trace file mapped read-only into memory. Blocks are decoded
+ * straight out of the mapping; pages are brought in on demand and can
+ * be dropped by the kernel again, so traces much larger than memory can
+ * be replayed. Any number of readers may share one mapping. The header
+ * and block index are checked against the file when it is opened, and
+ * a reader stops with an error at a block that does not decode to its
+ * record count within its bytes.
+ */
+class BranchTraceFile
+{
+  public:
+    BranchTraceFile(const std::string &path);
+    ~BranchTraceFile();
+
+    const std::string &getPath() const { return path; }
+    const BranchTraceHeader &getHeader() const { return *header; }
+    uint64_t numRecords() const { return header->recordCount; }
+    uint64_t numBlocks() const { return header->blockCount; }
+    const BranchTraceBlock &block(uint64_t i) const { return index[i]; }
+
+    /** Encoded bytes of block i. */
+    const uint8_t *blockBegin(uint64_t i) const;
+    const uint8_t *blockEnd(uint64_t i) const;
+    /** Number of records in block i. */
+    uint64_t blockRecords(uint64_t i) const;
+
+    /** Index of the block holding record 'record'. */
+    uint64_t findBlock(uint64_t record) const;
+
+    /** Hint the kernel that blocks [first, last) are no longer needed. */
+    void release(uint64_t first, uint64_t last) const;
+
+  private:
+    std::string path;
+    const uint8_t *data;
+    size_t size;
+    const BranchTraceHeader *header;
+    const BranchTraceBlock *index;
+};
+
+/**
+ * Chunked sequential decoder over a range of a mapped trace. read()
+ * decodes straight from the mapping into a caller-provided buffer, so
+ * the trace never has to be loaded as a whole.
+ */
+class BranchTraceReader
+{
+  public:
+    /** Read the whole trace. */
+    BranchTraceReader(const BranchTraceFile &trace);
+    /** Read blocks [first_block, last_block) of the trace. */
+    BranchTraceReader(const BranchTraceFile &trace, uint64_t first_block,
+                      uint64_t last_block);
+
+    /**
+     * Decode up to 'max' records into 'recs'. Returns the number
+     * decoded, 0 at the end of the range.
+     */
+    size_t read(BranchRecord *recs, size_t max);
+
+    /** Continue from trace record 'record', which must be in range. */
+    void seek(uint64_t record);
+
+    /** Trace position of the next record read() returns. */
+    uint64_t tell() const { return position; }
+
+    /** Drop pages of consumed blocks as the reader moves forward. */
+    void setReleaseConsumed(bool release) { releaseConsumed = release; }
+
+  private:
+    void startBlock(uint64_t block);
+    /** Report that the current block does not decode and exit. */
+    void corruptBlock() const;
+
+    const BranchTraceFile &trace;
+    uint64_t firstBlock;
+    uint64_t lastBlock;
+    uint64_t curBlock;
+    const uint8_t *cur;
+    const uint8_t *end;
+    Addr prevPC;
+    uint64_t position;
+    /** Trace position just past the current block. */
+    uint64_t blockLimit;
+    uint64_t rangeEnd;
+    bool releaseConsumed;
+};
+
+#endif // __CPU_PRED_BP_TRACE_HH__
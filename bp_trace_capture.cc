@@ -0,0 +1,86 @@
+/* @file
+ * Branch trace capture for the direction predictors
+ */
+
+#include "cpu/pred/bp_trace_capture.hh"
+
+#include "base/misc.hh"
+#include "sim/sim_exit.hh"
+
+BranchTraceCapture::BranchTraceCapture(const std::string &path,
+                                       size_t buffer_records)
+    : writer(path), bufferRecords(buffer_records), fillCount(0),
+      pendingBuf(NULL), pendingCount(0), stopping(false), closed(false)
+{
+    buffers[0].resize(bufferRecords);
+    buffers[1].resize(bufferRecords);
+    fillBuf = &buffers[0][0];
+
+    thread = std::thread(&BranchTraceCapture::writerLoop, this);
+
+    exitCallback = new ExitCallback(this);
+    registerExitCallback(exitCallback);
+
+    warn("Branch trace '%s' is captured without instruction counts; "
+         "MPKI cannot be computed from it.\n", path.c_str());
+}
+
+BranchTraceCapture::~BranchTraceCapture()
+{
+    close();
+    exitCallback->capture = NULL;
+}
+
+void
+BranchTraceCapture::handOff()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    // The writer is still busy with the other buffer; wait for it.
+    cond.wait(guard, [this] { return pendingBuf == NULL; });
+
+    pendingBuf = fillBuf;
+    pendingCount = fillCount;
+    cond.notify_all();
+
+    fillBuf = fillBuf == &buffers[0][0] ? &buffers[1][0] : &buffers[0][0];
+    fillCount = 0;
+}
+
+void
+BranchTraceCapture::writerLoop()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        cond.wait(guard, [this] { return pendingBuf || stopping; });
+        if (!pendingBuf)
+            break;
+
+        const BranchRecord *buf = pendingBuf;
+        size_t count = pendingCount;
+        guard.unlock();
+        writer.write(buf, count);
+        guard.lock();
+
+        pendingBuf = NULL;
+        cond.notify_all();
+    }
+}
+
+void
+BranchTraceCapture::close()
+{
+    if (closed)
+        return;
+    closed = true;
+
+    if (fillCount)
+        handOff();
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+        cond.notify_all();
+    }
+    thread.join();
+    writer.close();
+}
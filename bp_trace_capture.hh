@@ -0,0 +1,95 @@
+/* @file
+ * Branch trace capture for the direction predictors
+ *
+ * A predictor with branchTraceFile set hands every branch it sees
+ * commit to a BranchTraceCapture, which writes them in the format of
+ * bp_trace.hh. Records are appended to one of two buffers on the
+ * simulation thread; a full buffer is handed to a background thread
+ * that encodes and writes it while the other one fills, so recording
+ * costs the simulator little more than a store per branch.
+ *
+ * The predictor hooks do not see committed instruction counts, so the
+ * captured records carry an instruction gap of 0 and the trace header
+ * an instruction count of 0; the capture says so when it starts, and
+ * the replay tools report such traces without MPKI.
+ */
+
+#ifndef __CPU_PRED_BP_TRACE_CAPTURE_HH__
+#define __CPU_PRED_BP_TRACE_CAPTURE_HH__
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/callback.hh"
+#include "cpu/pred/bp_trace.hh"
+
+class BranchTraceCapture
+{
+  public:
+    /**
+     * Start capturing to 'path'. A simulator exit callback finishes the
+     * trace if the capture is still open then; deleting the capture
+     * finishes it too and disarms the callback.
+     */
+    BranchTraceCapture(const std::string &path,
+                       size_t buffer_records = 256 * 1024);
+    ~BranchTraceCapture();
+
+    /** Append a branch; branches after close() are dropped. */
+    void
+    record(Addr pc, bool taken, bool conditional)
+    {
+        // the exit callback may close the capture while the simulator
+        // still commits branches, and the writer thread is gone then
+        if (closed)
+            return;
+        BranchRecord &rec = fillBuf[fillCount];
+        rec.pc = pc;
+        rec.instGap = 0;
+        rec.taken = taken;
+        rec.conditional = conditional;
+        if (++fillCount == bufferRecords)
+            handOff();
+    }
+
+    /** Flush all records, stop the writer thread and finish the file. */
+    void close();
+
+  private:
+    /**
+     * Closes the capture at simulator exit. Exit callbacks cannot be
+     * removed, so the destructor clears 'capture' instead.
+     */
+    class ExitCallback : public Callback
+    {
+      public:
+        ExitCallback(BranchTraceCapture *capture) : capture(capture) { }
+        void process() { if (capture) capture->close(); }
+        BranchTraceCapture *capture;
+    };
+
+    /** Pass the fill buffer to the writer thread and switch buffers. */
+    void handOff();
+    void writerLoop();
+
+    BranchTraceWriter writer;
+    size_t bufferRecords;
+    std::vector<BranchRecord> buffers[2];
+    BranchRecord *fillBuf;
+    size_t fillCount;
+
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable cond;
+    /** Buffer waiting for the writer, NULL if the writer is idle. */
+    const BranchRecord *pendingBuf;
+    size_t pendingCount;
+    bool stopping;
+    bool closed;
+    ExitCallback *exitCallback;
+};
+
+#endif // __CPU_PRED_BP_TRACE_CAPTURE_HH__
@@ -6,32 +6,67 @@
  *
  */
 
+#include <algorithm>
+#include <sstream>
+
 #include "base/bitfield.hh"
 #include "base/intmath.hh"
+#include "cpu/pred/bp_snapshot.hh"
 #include "cpu/pred/gshare.hh"
 
 /*
  * Constructor for gshare BP
  */
 GshareBP::GshareBP(const Params *params)
-    : BPredUnit(params), instShiftAmt(params->instShiftAmt),
-      globalHistoryReg(0), //initilize the global History registor to 0
+    : BPredUnit(params), numThreads(params->numThreads),
+      historyRing(params->numThreads,
+                  HistoryRing<BPHistory>(params->historyCheckpoints)),
+      instShiftAmt(params->instShiftAmt),
+      globalHistoryReg(params->numThreads, 0), //initilize the global History registors to 0
       globalHistoryBits(ceilLog2(params->localPredictorSize)),  //initilize the size of the global history register to be log2(localPredictorSize)
+      globalHistoryLength(params->globalHistoryLength),
       localPredictorSize(params->localPredictorSize),
-      localCtrBits(params->localCtrBits)
+      localCtrBits(params->localCtrBits),
+      owners(NULL)
 {
 	if (!isPowerOf2(localPredictorSize))
 		fatal("Invalid local predictor size.\n");
+	if (this->numThreads == 0)
+		fatal("GshareBP needs at least one thread.\n");
 
 	//set the mask of the global history register, to ensure the bits above globalHistoryBits are 0s.
 	this->historyRegisterMask = mask(this->globalHistoryBits);
-	//initilize the so-called localCtrs
-	this->localCtrs.resize(this->localPredictorSize);
-
-	for(uint32_t count_ctr = 0;count_ctr < this->localPredictorSize;count_ctr++)
+	//with globalHistoryLength, each thread keeps that many outcomes and
+	//the register holds them folded down to globalHistoryBits
+	if (this->globalHistoryLength)
 	{
-		this->localCtrs[count_ctr].setBits(this->localCtrBits);
+		this->longHistory.resize(this->numThreads);
+		for (unsigned tid = 0; tid < this->numThreads; tid++)
+		{
+			this->longHistory[tid].init(this->globalHistoryLength, params->historyCheckpoints, 0);
+			this->longHistory[tid].addFold(this->globalHistoryLength, this->globalHistoryBits);
+		}
 	}
+	//with loopPredictorEntries, each thread has a loop predictor in
+	//front of the counters
+	if (params->loopPredictorEntries)
+	{
+		this->loopPredictor.resize(this->numThreads);
+		for (unsigned tid = 0; tid < this->numThreads; tid++)
+			this->loopPredictor[tid].init(params->loopPredictorEntries);
+	}
+	//initilize the so-called localCtrs, all counters start at 0
+	//the table is zero-filled lazily, so this costs nothing up front
+	this->localCtrs.init(this->localPredictorSize, this->localCtrBits,
+	                     params->tableHugePages);
+
+	//with threadIndexSalt, each thread XORs its own salt into the
+	//index so the threads' histories spread over the shared counters;
+	//thread 0 has none
+	this->threadSalt.resize(this->numThreads, 0);
+	if (params->threadIndexSalt)
+		for (ThreadID tid = 1; tid < (ThreadID)this->numThreads; tid++)
+			this->threadSalt[tid] = (unsigned)((tid * ULL(0x9e3779b97f4a7c15)) >> 32) & this->historyRegisterMask;
 
 	//setting the threshold for the value in local counter to indicates a taken branch
 	// This is equivalent to (2^(Ctr))/2 - 1
@@ -41,6 +76,102 @@ GshareBP::GshareBP(const Params *params)
     //printf("localCtrBits is %u\n",this->localCtrBits);
     //printf("localThreshold is %08x\n",this->localThreshold);
 
+    //record every committed branch to a trace if requested
+    if (!params->branchTraceFile.empty())
+        this->traceCapture.reset(new BranchTraceCapture(params->branchTraceFile));
+
+    //attribute mispredictions to branches if requested; the components
+    //are the counters and the loop predictor, if any
+    if (!params->mispredictProfile.empty())
+    {
+        std::vector<std::string> components(1, "counter");
+        if (!this->loopPredictor.empty())
+            components.push_back("loop");
+        this->profiler.reset(new MispredictProfiler(params->mispredictProfile,
+            params->profileEntries, params->profileTop, components));
+    }
+
+    //remember which branch trained each counter last, to count aliasing
+    if (params->trackAliasing)
+    {
+        this->ownerStorage.allocate(this->localPredictorSize * sizeof(uint16_t),
+                                    params->tableHugePages);
+        this->owners = static_cast<uint16_t *>(this->ownerStorage.data());
+    }
+
+}
+
+/*
+ * Statistics
+ */
+void
+GshareBP::regStats()
+{
+    BPredUnit::regStats();
+
+    statCounterReads
+        .scalar(stats.counterReads)
+        .name(name() + ".counterReads")
+        .desc("Number of counters read to predict a branch")
+        ;
+
+    statCounterWrites
+        .scalar(stats.counterWrites)
+        .name(name() + ".counterWrites")
+        .desc("Number of counter updates")
+        ;
+
+    statAliasedCommits
+        .scalar(stats.aliasedCommits)
+        .name(name() + ".aliasedCommits")
+        .desc("Number of commits to a counter last trained by another "
+              "branch")
+        ;
+
+    statDestructiveAliasing
+        .scalar(stats.destructiveAliasing)
+        .name(name() + ".destructiveAliasing")
+        .desc("Number of aliased commits that were mispredicted")
+        ;
+
+    statLoopPredictions
+        .scalar(stats.loopPredictions)
+        .name(name() + ".loopPredictions")
+        .desc("Number of committed branches predicted by the loop "
+              "predictor")
+        ;
+
+    statLoopMispredictions
+        .scalar(stats.loopMispredictions)
+        .name(name() + ".loopMispredictions")
+        .desc("Number of loop predictor predictions that were "
+              "mispredicted")
+        ;
+}
+
+uint64_t
+GshareBP::storageBits() const
+{
+	//the owners of trackAliasing are instrumentation, not state
+	unsigned historyBits = this->globalHistoryLength ? this->globalHistoryLength : this->globalHistoryBits;
+	uint64_t bits = this->localCtrs.storageBits() + (uint64_t)this->numThreads * historyBits;
+	for (unsigned tid = 0; tid < this->loopPredictor.size(); tid++)
+		bits += this->loopPredictor[tid].storageBits();
+	return bits;
+}
+
+void
+GshareBP::commitOwner(unsigned idx, Addr branchAddr, bool mispredicted)
+{
+	//0 marks a counter no branch has trained yet
+	uint16_t owner = (branchAddr >> this->instShiftAmt) % 0xffff + 1;
+	if (this->owners[idx] && this->owners[idx] != owner)
+	{
+		this->stats.aliasedCommits++;
+		if (mispredicted)
+			this->stats.destructiveAliasing++;
+	}
+	this->owners[idx] = owner;
 }
 
 /*
@@ -49,15 +180,115 @@ GshareBP::GshareBP(const Params *params)
 void
 GshareBP::reset()
 {
-	//reset the global history register
-	this->globalHistoryReg = 0;
+	//reset the global history registers
+	std::fill(this->globalHistoryReg.begin(), this->globalHistoryReg.end(), 0);
+	for (unsigned tid = 0; tid < this->longHistory.size(); tid++)
+		this->longHistory[tid].clear();
+	for (unsigned tid = 0; tid < this->loopPredictor.size(); tid++)
+		this->loopPredictor[tid].clear();
+
+	//reset the localCtrs; the pages are dropped, not rewritten
+	this->localCtrs.reset();
+	this->ownerStorage.clear();
+
+}
+
+/*
+ * Snapshot of the counters and the global history register
+ */
+std::string
+GshareBP::snapshotConfig() const
+{
+	std::ostringstream os;
+	os << "gshare localPredictorSize=" << this->localPredictorSize
+	   << " localCtrBits=" << this->localCtrBits
+	   << " instShiftAmt=" << this->instShiftAmt
+	   << " numThreads=" << this->numThreads;
+	if (this->globalHistoryLength)
+		os << " globalHistoryLength=" << this->globalHistoryLength;
+	if (!this->loopPredictor.empty())
+		os << " loopPredictorEntries=" << this->loopPredictor[0].entries();
+	return os.str();
+}
 
-	//reset the localCtrs
-	for(uint32_t count_ctr = 0;count_ctr < this->localPredictorSize;count_ctr++)
+void
+GshareBP::saveSnapshot(const std::string &path) const
+{
+	std::vector<uint64_t> ghr(this->globalHistoryReg.begin(), this->globalHistoryReg.end());
+	BPSnapshotWriter writer(path, this->snapshotConfig());
+	writer.add("localCtrs", this->localCtrs.data(), this->localCtrs.dataBytes());
+	writer.add("globalHistory", &ghr[0], ghr.size() * sizeof(ghr[0]));
+	//the long histories of all threads, back to back
+	std::vector<uint64_t> longHist;
+	for (unsigned tid = 0; tid < this->longHistory.size(); tid++)
+	{
+		size_t at = longHist.size();
+		longHist.resize(at + this->longHistory[tid].stateWords());
+		this->longHistory[tid].saveState(&longHist[at]);
+	}
+	if (!longHist.empty())
+		writer.add("longHistory", &longHist[0], longHist.size() * sizeof(longHist[0]));
+	//likewise the loop predictors
+	std::vector<uint64_t> loopTable;
+	for (unsigned tid = 0; tid < this->loopPredictor.size(); tid++)
 	{
-		this->localCtrs[count_ctr].setBits(localCtrBits);
+		size_t at = loopTable.size();
+		loopTable.resize(at + this->loopPredictor[tid].stateWords());
+		this->loopPredictor[tid].saveState(&loopTable[at]);
 	}
+	if (!loopTable.empty())
+		writer.add("loopTable", &loopTable[0], loopTable.size() * sizeof(loopTable[0]));
+	writer.write();
+}
 
+void
+GshareBP::restoreSnapshot(const std::string &path)
+{
+	BPSnapshotReader reader(path, this->snapshotConfig());
+	std::vector<uint64_t> ghr(this->numThreads);
+	reader.read("globalHistory", &ghr[0], ghr.size() * sizeof(ghr[0]));
+	if (!this->longHistory.empty())
+	{
+		size_t words = this->longHistory[0].stateWords();
+		std::vector<uint64_t> longHist(words * this->numThreads);
+		reader.read("longHistory", &longHist[0], longHist.size() * sizeof(longHist[0]));
+		for (unsigned tid = 0; tid < this->numThreads; tid++)
+			this->longHistory[tid].loadState(&longHist[tid * words]);
+	}
+	if (!this->loopPredictor.empty())
+	{
+		size_t words = this->loopPredictor[0].stateWords();
+		std::vector<uint64_t> loopTable(words * this->numThreads);
+		reader.read("loopTable", &loopTable[0], loopTable.size() * sizeof(loopTable[0]));
+		for (unsigned tid = 0; tid < this->numThreads; tid++)
+			this->loopPredictor[tid].loadState(&loopTable[tid * words]);
+	}
+	this->localCtrs.mapFile(reader.descriptor(),
+		reader.sectionOffset("localCtrs", this->localCtrs.dataBytes()));
+	for (unsigned tid = 0; tid < this->numThreads; tid++)
+	{
+		this->globalHistoryReg[tid] = ghr[tid] & this->historyRegisterMask;
+		//no branch is in flight across a snapshot
+		this->historyRing[tid].clear();
+	}
+	//snapshots do not record which branch trained a counter
+	this->ownerStorage.clear();
+}
+
+void
+GshareBP::serialize(std::ostream &os)
+{
+	std::string snapshot = name() + ".bpsnap";
+	this->saveSnapshot(Checkpoint::dir() + "/" + snapshot);
+	SERIALIZE_SCALAR(snapshot);
+}
+
+void
+GshareBP::unserialize(Checkpoint *cp, const std::string &section)
+{
+	std::string snapshot;
+	UNSERIALIZE_SCALAR(snapshot);
+	this->restoreSnapshot(cp->cptDir + "/" + snapshot);
 }
 
 /*
@@ -66,16 +297,20 @@ GshareBP::reset()
  	2. update the record of global history register.
  */
 void
-GshareBP::uncondBranch(void * &bpHistory)
+GshareBP::uncondBranch(ThreadID tid, Addr pc, void * &bpHistory)
 {
-	BPHistory *history = new BPHistory;
+	//take a checkpoint, its handle is returned via bpHistory
+	BPHistory *history = this->historyRing[tid].push(bpHistory);
 	//store the current global history register to the returning history
-	history->globalHistoryReg = this->globalHistoryReg;
+	history->globalHistoryReg = this->globalHistoryReg[tid];
 	//treat unconditional branch as a predict-to-take branch
 	history->finalPred = true;
-	//return the content in history to bpHistory
-	bpHistory = static_cast<void*>(history);
-	updateGlobalHistReg(true);
+	history->uncond = true;
+	history->loop.entry = -1;
+	history->loop.confident = false;
+	if (!this->longHistory.empty())
+		this->longHistory[tid].save(history->longHistory);
+	updateGlobalHistReg(tid, true);
 	return ;
 }
 
@@ -83,23 +318,38 @@ GshareBP::uncondBranch(void * &bpHistory)
  * Lookup the actual branch prediction.
  */
 bool
-GshareBP::lookup(Addr branchAddr, void * &bpHistory)
+GshareBP::lookup(ThreadID tid, Addr branchAddr, void * &bpHistory)
 {
-	//hash the branchAddr with the global history register to get the index into the table of counter.
-	unsigned localCtrsIdx = ((branchAddr >> this->instShiftAmt) ^ this->globalHistoryReg) & this->historyRegisterMask;
+	//hash the branchAddr with the thread's global history register to get the index into the table of counter.
+	unsigned localCtrsIdx = ((branchAddr >> this->instShiftAmt) ^ this->globalHistoryReg[tid] ^ this->threadSalt[tid]) & this->historyRegisterMask;
     assert(localCtrsIdx < this->localPredictorSize);
     
     //read the value from the local counters, and assign the judgement into the final_prediction
-    bool final_prediction = (this->localCtrs[localCtrsIdx].read() > this->localThreshold);
+    bool final_prediction = (this->localCtrs.read(localCtrsIdx) > this->localThreshold);
+    this->stats.counterReads++;
 
-    //update the bpHistory
-    BPHistory *history = new BPHistory;
+    //checkpoint the history, bpHistory becomes the checkpoint's handle
+    BPHistory *history = this->historyRing[tid].push(bpHistory);
     history->finalPred = final_prediction;
-    history->globalHistoryReg = this->globalHistoryReg;
-    bpHistory = static_cast<void*>(history);
+    history->uncond = false;
+    history->globalHistoryReg = this->globalHistoryReg[tid];
+    if (!this->longHistory.empty())
+        this->longHistory[tid].save(history->longHistory);
+
+    //a confident loop predictor overrides the counters, and its
+    //iteration count follows the branch down the predicted path
+    history->loop.entry = -1;
+    history->loop.confident = false;
+    if (!this->loopPredictor.empty())
+    {
+        LoopPredictor &loop = this->loopPredictor[tid];
+        loop.lookup(branchAddr >> this->instShiftAmt, history->loop);
+        final_prediction = history->loop.predict(final_prediction);
+        loop.speculate(history->loop, final_prediction);
+    }
 
     //speculatively update the global history register.
-    updateGlobalHistReg(final_prediction);
+    updateGlobalHistReg(tid, final_prediction);
 
     return final_prediction;
 }
@@ -108,74 +358,249 @@ GshareBP::lookup(Addr branchAddr, void * &bpHistory)
  * BTB Update actions, called when a BTB miss happen
  */
 void
-GshareBP::btbUpdate(Addr branchAddr, void * &bpHistory)
+GshareBP::btbUpdate(ThreadID tid, Addr branchAddr, void * &bpHistory)
 {
+	//the branch now goes down the not-taken path, so does its loop
+	//iteration count
+	if (!this->loopPredictor.empty() && bpHistory)
+	{
+		BPHistory *history = &this->historyRing[tid].get(bpHistory);
+		this->loopPredictor[tid].restore(history->loop);
+		this->loopPredictor[tid].speculate(history->loop, false);
+	}
 	//force set the last prediction made to be 0
-	this->globalHistoryReg &= (this->historyRegisterMask & ~ULL(1));
+	if (!this->longHistory.empty())
+	{
+		this->longHistory[tid].setLastOutcome(false);
+		this->globalHistoryReg[tid] = this->longHistory[tid].fold(0);
+		return;
+	}
+	this->globalHistoryReg[tid] &= (this->historyRegisterMask & ~ULL(1));
 }
 
 /*
  * Update data structures after getting actual decison 
  */
 void
-GshareBP::update(Addr branchAddr, bool taken, void *bpHistory, bool squashed)
+GshareBP::update(ThreadID tid, Addr branchAddr, bool taken, void *bpHistory, bool squashed)
 {
 	if(bpHistory)
 	{
 		//case that the branch history is not null
-		BPHistory *history = static_cast<BPHistory *>(bpHistory);
+		BPHistory *history = &this->historyRing[tid].get(bpHistory);
 		//1. get the index to the local counter for that branch address at that bpHistory time
-		unsigned localCtrsIdx = ((branchAddr >> this->instShiftAmt) ^ history->globalHistoryReg) & this->historyRegisterMask;
+		unsigned localCtrsIdx = ((branchAddr >> this->instShiftAmt) ^ history->globalHistoryReg ^ this->threadSalt[tid]) & this->historyRegisterMask;
 		assert(localCtrsIdx < localPredictorSize);
 
-		//2. update the local counter by the acutal judgement of the conditional branch
-		if(taken)
-		{
-			this->localCtrs[localCtrsIdx].increment();
-		}
-		else
+		//the prediction made, which the loop predictor may have made
+		bool prediction = history->loop.predict(history->finalPred);
+
+		//2. update the local counter by the acutal judgement of the conditional branch,
+		//unless a confident loop predictor predicted it right
+		if (!(history->loop.confident && history->loop.pred == taken))
 		{
-			this->localCtrs[localCtrsIdx].decrement();
+			if(taken)
+			{
+				this->localCtrs.increment(localCtrsIdx);
+			}
+			else
+			{
+				this->localCtrs.decrement(localCtrsIdx);
+			}
+			this->stats.counterWrites++;
 		}
 
 		//if the branch is mis-predicted
 		if(squashed)
 		{
-			if(taken)
-				this->globalHistoryReg = (history->globalHistoryReg << 1) | 1;
-			else
-				this->globalHistoryReg = (history->globalHistoryReg << 1);
-			this->globalHistoryReg &= this->historyRegisterMask;
+			//roll the history back to this branch and insert the outcome
+			this->globalHistoryReg[tid] = history->globalHistoryReg;
+			if (!this->longHistory.empty())
+				this->longHistory[tid].restore(history->longHistory);
+			updateGlobalHistReg(tid, taken);
+			//likewise the loop iteration count
+			if (!this->loopPredictor.empty())
+			{
+				this->loopPredictor[tid].restore(history->loop);
+				this->loopPredictor[tid].speculate(history->loop, taken);
+			}
 		}
 		else
 		{
 			//the globalHistoryReg is already updated when lookup() is called.
-			delete history;
+			//the branch commits here, record it if capturing a trace.
+			if (!this->loopPredictor.empty() && !history->uncond)
+			{
+				this->loopPredictor[tid].update(branchAddr >> this->instShiftAmt,
+				                                history->loop, taken, history->finalPred);
+				if (history->loop.confident)
+				{
+					this->stats.loopPredictions++;
+					if (history->loop.pred != taken)
+						this->stats.loopMispredictions++;
+				}
+			}
+			if (this->owners)
+				this->commitOwner(localCtrsIdx, branchAddr, prediction != taken);
+			if (this->profiler && !history->uncond)
+				this->profiler->record(branchAddr, prediction != taken,
+				                       history->loop.confident ? 1 : 0);
+			//a trace holds one thread's branches, thread 0's
+			if (this->traceCapture && tid == 0)
+				this->traceCapture->record(branchAddr, taken, !history->uncond);
+			this->historyRing[tid].release(bpHistory);
 		}
 	}
 	//otherwise do nothing
 }
 
+/*
+ * Offline replay of committed branches: lookup()/uncondBranch() followed
+ * by update(), plus the squashing update() of a mispredicted branch,
+ * folded together
+ */
+uint64_t
+GshareBP::predictBatch(const BranchRecord *recs, size_t count,
+                       uint64_t *pred_bits)
+{
+	//the aliasing, profiling, long history and loop predictor code is
+	//compiled out unless trackAliasing, mispredictProfile,
+	//globalHistoryLength or loopPredictorEntries is set
+	if (this->owners || this->profiler || !this->longHistory.empty() ||
+	    !this->loopPredictor.empty())
+		return this->predictBatchRun<true>(recs, count, pred_bits);
+	return this->predictBatchRun<false>(recs, count, pred_bits);
+}
+
+template <bool Extended>
+uint64_t
+GshareBP::predictBatchRun(const BranchRecord *recs, size_t count,
+                          uint64_t *pred_bits)
+{
+	unsigned ghr = this->globalHistoryReg[0];
+	const unsigned shift = this->instShiftAmt;
+	const unsigned regMask = this->historyRegisterMask;
+	const unsigned threshold = this->localThreshold;
+	LoopPredictor *loop = Extended && !this->loopPredictor.empty() ?
+		&this->loopPredictor[0] : NULL;
+	uint64_t misses = 0;
+	uint64_t reads = 0;
+	//commits a confident loop predictor left the counters alone on
+	uint64_t skipped = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const BranchRecord &rec = recs[i];
+		unsigned localCtrsIdx = ((rec.pc >> shift) ^ ghr) & regMask;
+		//unconditional branches are predicted taken and train as taken
+		bool taken = rec.taken || !rec.conditional;
+		bool pred = true;
+		LoopPredictor::Lookup loopLookup;
+		loopLookup.confident = false;
+		if (rec.conditional)
+		{
+			pred = this->localCtrs.read(localCtrsIdx) > threshold;
+			reads++;
+			bool counterPred = pred;
+			if (Extended && loop)
+			{
+				loop->lookup(rec.pc >> shift, loopLookup);
+				pred = loopLookup.predict(counterPred);
+				//the squashing update() leaves the count as if
+				//fetched down the right path
+				loop->speculate(loopLookup, taken);
+				loop->update(rec.pc >> shift, loopLookup, taken, counterPred);
+				if (loopLookup.confident)
+				{
+					this->stats.loopPredictions++;
+					if (pred != taken)
+						this->stats.loopMispredictions++;
+				}
+			}
+			if (pred != taken)
+			{
+				//the squashing update() trains the counter once more
+				misses++;
+				if (taken)
+					this->localCtrs.increment(localCtrsIdx);
+				else
+					this->localCtrs.decrement(localCtrsIdx);
+			}
+		}
+		if (pred_bits)
+		{
+			uint64_t bit = ULL(1) << (i & 63);
+			pred_bits[i >> 6] = pred ? pred_bits[i >> 6] | bit :
+										pred_bits[i >> 6] & ~bit;
+		}
+		//commit
+		if (Extended && loopLookup.confident && pred == taken)
+			skipped++;
+		else if (taken)
+			this->localCtrs.increment(localCtrsIdx);
+		else
+			this->localCtrs.decrement(localCtrsIdx);
+		if (Extended && this->owners)
+			this->commitOwner(localCtrsIdx, rec.pc, pred != taken);
+		if (Extended && this->profiler && rec.conditional)
+			this->profiler->record(rec.pc, pred != taken,
+			                       loopLookup.confident ? 1 : 0);
+		//either the prediction was right or the history was repaired,
+		//so the history always ends up holding the outcome
+		if (Extended && !this->longHistory.empty())
+		{
+			this->longHistory[0].push(taken, 0);
+			ghr = this->longHistory[0].fold(0);
+		}
+		else
+			ghr = ((ghr << 1) | taken) & regMask;
+	}
+
+	this->globalHistoryReg[0] = ghr;
+	//one write per branch plus one per misprediction, less the commits
+	//the loop predictor took
+	this->stats.counterReads += reads;
+	this->stats.counterWrites += count + misses - skipped;
+	return misses;
+}
+
 /*
  * Global History Registor Update 
  */
 void
-GshareBP::updateGlobalHistReg(bool taken)
+GshareBP::updateGlobalHistReg(ThreadID tid, bool taken)
 {
-	//shift the register and insert the new value.
-	this->globalHistoryReg = taken ? (globalHistoryReg << 1) | 1 :
-								(globalHistoryReg << 1);
-	this->globalHistoryReg &= this->historyRegisterMask;
+	//with globalHistoryLength, the register is the fold of the long history
+	if (!this->longHistory.empty())
+	{
+		this->longHistory[tid].push(taken, 0);
+		this->globalHistoryReg[tid] = this->longHistory[tid].fold(0);
+		return;
+	}
+	//shift the thread's register and insert the new value.
+	unsigned &ghr = this->globalHistoryReg[tid];
+	ghr = taken ? (ghr << 1) | 1 : (ghr << 1);
+	ghr &= this->historyRegisterMask;
 }
 
 /*
  * Actions for squash
  */
 void
-GshareBP::squash(void *bpHistory) {
+GshareBP::squash(ThreadID tid, void *bpHistory) {
 	//retrieve the data from the bpHistory
-	BPHistory *history = static_cast<BPHistory*>(bpHistory);
-	this->globalHistoryReg = history->globalHistoryReg;
-	//release the memory
-	delete history;
+	BPHistory *history = &this->historyRing[tid].get(bpHistory);
+	this->globalHistoryReg[tid] = history->globalHistoryReg;
+	if (!this->longHistory.empty())
+		this->longHistory[tid].restore(history->longHistory);
+	//roll the thread's checkpoint ring back past this branch; each
+	//squashed branch may have advanced a different loop entry
+	if (!this->loopPredictor.empty())
+	{
+		LoopPredictor &loop = this->loopPredictor[tid];
+		this->historyRing[tid].squash(bpHistory,
+			[&loop](const BPHistory &h) { loop.restore(h.loop); });
+	}
+	else
+		this->historyRing[tid].squash(bpHistory);
 }
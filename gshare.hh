@@ -9,27 +9,143 @@
 #ifndef __CPU_PRED_GSHARE_PRED_HH__
 #define __CPU_PRED_GSHARE_PRED_HH__
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/statistics.hh"
+#include "cpu/pred/bp_trace_capture.hh"
 #include "cpu/pred/bpred_unit.hh"
-#include "cpu/pred/sat_counter.hh"
+#include "cpu/pred/history_ring.hh"
+#include "cpu/pred/long_history.hh"
+#include "cpu/pred/loop_predictor.hh"
+#include "cpu/pred/mispredict_profile.hh"
+#include "cpu/pred/packed_counters.hh"
+#include "cpu/pred/table_storage.hh"
+
+/** Access counts of a GshareBP, for tuning and power models. */
+struct GshareStats
+{
+    GshareStats()
+        : counterReads(0), counterWrites(0), aliasedCommits(0),
+          destructiveAliasing(0), loopPredictions(0), loopMispredictions(0)
+    { }
+
+    /** Counters read to predict a branch. */
+    uint64_t counterReads;
+    /** Counters trained, twice for a mispredicted branch. */
+    uint64_t counterWrites;
+    /** Committed branches whose counter was last trained by another
+     *  branch (with trackAliasing). */
+    uint64_t aliasedCommits;
+    /** Of those, the conditional branches that were mispredicted. */
+    uint64_t destructiveAliasing;
+    /** Committed branches the loop predictor predicted instead of the
+     *  counters (with loopPredictorEntries). */
+    uint64_t loopPredictions;
+    /** Of those, the mispredicted ones. */
+    uint64_t loopMispredictions;
+};
 
 /*
  * Feel free to make any modifications, this is a skeleton code
  * to get you started.
  * Note: Do not change name of class
  */
+
+/*
+ * Each of the numThreads hardware threads has its own global history
+ * register and history checkpoints, so SMT threads do not pollute each
+ * other's history; the counters are shared. With threadIndexSalt, every
+ * thread but thread 0 also XORs a fixed salt into the counter index.
+ *
+ * With globalHistoryLength set, the history hashed into the index is
+ * the last globalHistoryLength outcomes, however many index bits there
+ * are, folded down to the index width (see long_history.hh).
+ *
+ * With loopPredictorEntries set, each thread also has a loop predictor
+ * (see loop_predictor.hh) that overrides the counters for the loop
+ * branches it is confident about; a branch it predicts right does not
+ * train the counters at commit, so loops leave them to other branches.
+ */
 class GshareBP : public BPredUnit
 {
   public:
     GshareBP(const Params *params);
-    void uncondBranch(void * &bp_history);
-    void squash(void *bp_history);
-    bool lookup(Addr branch_addr, void * &bp_history);
-    void btbUpdate(Addr branch_addr, void * &bp_history);
-    void update(Addr branch_addr, bool taken, void *bp_history, bool squashed);
+    void uncondBranch(ThreadID tid, Addr pc, void * &bp_history);
+    void squash(ThreadID tid, void *bp_history);
+    bool lookup(ThreadID tid, Addr branch_addr, void * &bp_history);
+    void btbUpdate(ThreadID tid, Addr branch_addr, void * &bp_history);
+    void update(ThreadID tid, Addr branch_addr, bool taken, void *bp_history,
+                bool squashed);
     void reset();
 
+    /**
+     * Predict and train on a run of committed branches of thread 0
+     * without going through the BPredUnit hooks. Each branch is
+     * resolved before the next one, so the global history stays in a
+     * register and no history checkpoints are taken; the counters end
+     * up exactly as after lookup()/uncondBranch() and update() for
+     * every record.
+     * Branches are not recorded to branchTraceFile.
+     * @param recs The branches, in program order.
+     * @param count Number of branches.
+     * @param pred_bits If not NULL, bit i of word i / 64 is set to the
+     * prediction for recs[i] (unconditional branches predict taken).
+     * @return The number of mispredicted conditional branches.
+     */
+    uint64_t predictBatch(const BranchRecord *recs, size_t count,
+                          uint64_t *pred_bits);
+
+    /**
+     * Write the counters and the global histories to a snapshot file
+     * (see bp_snapshot.hh). No branch may be in flight.
+     */
+    void saveSnapshot(const std::string &path) const;
+
+    /**
+     * Restore the state saved by saveSnapshot() from a predictor with
+     * the same table parameters. The counters are mapped copy-on-write
+     * from the file rather than read.
+     */
+    void restoreSnapshot(const std::string &path);
+
+    /** Checkpointing: the tables go to a snapshot next to the
+     *  checkpoint, named in the checkpoint. */
+    void serialize(std::ostream &os);
+    void unserialize(Checkpoint *cp, const std::string &section);
+
+    /** Occupancy counts of a thread's history checkpoint ring. */
+    const HistoryRingStats &historyStats(ThreadID tid = 0) const
+    { return historyRing[tid].getStats(); }
+
+    /** Counter access and aliasing counts. */
+    const GshareStats &accessStats() const { return stats; }
+
+    /** Register accessStats() as gem5 statistics. */
+    void regStats();
+
+    /** Bits of predictor state: the counters, the history registers
+     *  (or long histories) and the loop predictors. */
+    uint64_t storageBits() const;
+
   private:
-    void updateGlobalHistReg(bool taken);
+    void updateGlobalHistReg(ThreadID tid, bool taken);
+
+    /** Parameters a snapshot must agree on, as a string. */
+    std::string snapshotConfig() const;
+
+    /** predictBatch(), with or without trackAliasing,
+     *  mispredictProfile and globalHistoryLength. */
+    template <bool Extended>
+    uint64_t predictBatchRun(const BranchRecord *recs, size_t count,
+                             uint64_t *pred_bits);
+
+    /**
+     * Note the commit of a branch that trained counter 'idx', counting
+     * it as aliased if another branch trained the counter last.
+     */
+    void commitOwner(unsigned idx, Addr branch_addr, bool mispredicted);
 
     struct BPHistory {
         unsigned globalHistoryReg;
@@ -39,15 +155,29 @@ class GshareBP : public BPredUnit
             false: predict not-taken
         */
         bool finalPred;
+        //true if the history belongs to an unconditional branch.
+        bool uncond;
+        //the long history before this branch, with globalHistoryLength
+        LongHistory<1>::Checkpoint longHistory;
+        //what the loop predictor found; the prediction made is
+        //loop.predict(finalPred)
+        LoopPredictor::Lookup loop;
     };
 
+    /** Number of hardware threads. */
+    unsigned numThreads;
+
+    /** Per thread, the checkpoints handed out as bp_history by lookup()
+     *  and uncondBranch(). */
+    std::vector<HistoryRing<BPHistory> > historyRing;
+
     /** Number of bits to shift the instruction over to get rid of the word
      *  offset.
      */
     unsigned instShiftAmt;
 
-    //storing the bits of the global history register.
-    unsigned globalHistoryReg;
+    //storing the bits of the global history register of each thread.
+    std::vector<unsigned> globalHistoryReg;
     //indicates the size (length) of the global history register.
     unsigned globalHistoryBits;
 
@@ -55,8 +185,23 @@ class GshareBP : public BPredUnit
      *  used. */
     unsigned historyRegisterMask;
 
-    /** Local counters, each element of localCtrs is a Saturating counter */
-    std::vector<SatCounter> localCtrs;
+    /** Outcomes folded into the index if not 0; globalHistoryReg then
+     *  holds the fold. */
+    unsigned globalHistoryLength;
+    /** Per thread, the history folded into globalHistoryReg, with
+     *  globalHistoryLength. */
+    std::vector<LongHistory<1> > longHistory;
+
+    /** Per thread, the loop predictor, with loopPredictorEntries. */
+    std::vector<LoopPredictor> loopPredictor;
+
+    /** Per thread, the salt XORed into the counter index (0 unless
+     *  threadIndexSalt is set). */
+    std::vector<unsigned> threadSalt;
+
+    /** Local counters, localCtrBits-bit saturating counters packed into
+     *  words */
+    PackedCounterTable localCtrs;
     /** Number of counters in the local predictor. */
     unsigned localPredictorSize;
     /** Number of bits of the local predictor's counters. */
@@ -68,6 +213,25 @@ class GshareBP : public BPredUnit
      *  equal to or below the threshold is not taken.
      */
     unsigned localThreshold;
+
+    /** Records committed branches if branchTraceFile is set. */
+    std::unique_ptr<BranchTraceCapture> traceCapture;
+    /** Profiles mispredicted branches if mispredictProfile is set. */
+    std::unique_ptr<MispredictProfiler> profiler;
+
+    GshareStats stats;
+    /** With trackAliasing, a 16-bit hash of the branch that last
+     *  trained each counter (0: none); NULL otherwise. */
+    TableStorage ownerStorage;
+    uint16_t *owners;
+
+    /** The counts of 'stats' as gem5 statistics. */
+    Stats::Value statCounterReads;
+    Stats::Value statCounterWrites;
+    Stats::Value statAliasedCommits;
+    Stats::Value statDestructiveAliasing;
+    Stats::Value statLoopPredictions;
+    Stats::Value statLoopMispredictions;
 };
 
 #endif // __CPU_PRED_GSHARE_PRED_HH__
@@ -0,0 +1,344 @@
+/* @file
+ * Implementation of a skewed gshare (gskew) branch predictor
+ */
+
+#include "cpu/pred/gskew.hh"
+
+#include <algorithm>
+#include <sstream>
+
+#include "base/bitfield.hh"
+#include "base/intmath.hh"
+#include "cpu/pred/bp_snapshot.hh"
+
+namespace
+{
+
+/**
+ * Records predictBatch() computes the bank indices of, and prefetches,
+ * ahead of the branch it predicts; a power of two at least one more
+ * than that holds the indices in flight.
+ */
+const unsigned prefetchDistance = 8;
+const unsigned prefetchSlots = 16;
+
+} // anonymous namespace
+
+GskewBP::GskewBP(const Params *params)
+    : BPredUnit(params), numThreads(params->numThreads),
+      historyRing(params->numThreads,
+                  HistoryRing<BPHistory>(params->historyCheckpoints)),
+      globalHistoryReg(params->numThreads, 0),
+      instShiftAmt(params->instShiftAmt),
+      bankSize(params->gskewBankSize)
+{
+    if (numThreads == 0)
+        fatal("GskewBP needs at least one thread.\n");
+    // the skewing functions need at least two index bits
+    if (!isPowerOf2(bankSize) || bankSize < 4)
+        fatal("Invalid gskew bank size.\n");
+
+    indexBits = ceilLog2(bankSize);
+    indexMask = mask(indexBits);
+    banks.init((size_t)numBanks * bankSize, params->localCtrBits,
+               params->tableHugePages);
+    threshold = (1 << (params->localCtrBits - 1)) - 1;
+
+    threadSalt.resize(numThreads, 0);
+    if (params->threadIndexSalt) {
+        for (ThreadID tid = 1; tid < (ThreadID)numThreads; tid++)
+            threadSalt[tid] = (unsigned)((tid * ULL(0x9e3779b97f4a7c15)) >>
+                                         32) & indexMask;
+    }
+
+    if (!params->branchTraceFile.empty())
+        traceCapture.reset(new BranchTraceCapture(params->branchTraceFile));
+
+    if (!params->mispredictProfile.empty())
+        profiler.reset(new MispredictProfiler(params->mispredictProfile,
+            params->profileEntries, params->profileTop,
+            std::vector<std::string>(1, "vote")));
+}
+
+void
+GskewBP::regStats()
+{
+    BPredUnit::regStats();
+
+    statCounterReads
+        .scalar(stats.counterReads)
+        .name(name() + ".counterReads")
+        .desc("Number of counters read to predict a branch")
+        ;
+
+    statCounterWrites
+        .scalar(stats.counterWrites)
+        .name(name() + ".counterWrites")
+        .desc("Number of counter updates")
+        ;
+
+    statSplitVotes
+        .scalar(stats.splitVotes)
+        .name(name() + ".splitVotes")
+        .desc("Number of predictions on which the banks disagreed")
+        ;
+}
+
+uint64_t
+GskewBP::storageBits() const
+{
+    return banks.storageBits() + (uint64_t)numThreads * indexBits;
+}
+
+void
+GskewBP::reset()
+{
+    std::fill(globalHistoryReg.begin(), globalHistoryReg.end(), 0);
+    banks.reset();
+}
+
+/*
+ * Snapshot of the banks and the global history registers
+ */
+std::string
+GskewBP::snapshotConfig() const
+{
+    std::ostringstream os;
+    os << "gskew gskewBankSize=" << bankSize
+       << " localCtrBits=" << banks.bits()
+       << " instShiftAmt=" << instShiftAmt
+       << " numThreads=" << numThreads;
+    return os.str();
+}
+
+void
+GskewBP::saveSnapshot(const std::string &path) const
+{
+    std::vector<uint64_t> ghr(globalHistoryReg.begin(),
+                              globalHistoryReg.end());
+    BPSnapshotWriter writer(path, snapshotConfig());
+    writer.add("banks", banks.data(), banks.dataBytes());
+    writer.add("globalHistory", &ghr[0], ghr.size() * sizeof(ghr[0]));
+    writer.write();
+}
+
+void
+GskewBP::restoreSnapshot(const std::string &path)
+{
+    BPSnapshotReader reader(path, snapshotConfig());
+    std::vector<uint64_t> ghr(numThreads);
+    reader.read("globalHistory", &ghr[0], ghr.size() * sizeof(ghr[0]));
+    banks.mapFile(reader.descriptor(),
+                  reader.sectionOffset("banks", banks.dataBytes()));
+    for (unsigned tid = 0; tid < numThreads; tid++) {
+        globalHistoryReg[tid] = ghr[tid] & indexMask;
+        // no branch is in flight across a snapshot
+        historyRing[tid].clear();
+    }
+}
+
+void
+GskewBP::serialize(std::ostream &os)
+{
+    std::string snapshot = name() + ".bpsnap";
+    saveSnapshot(Checkpoint::dir() + "/" + snapshot);
+    SERIALIZE_SCALAR(snapshot);
+}
+
+void
+GskewBP::unserialize(Checkpoint *cp, const std::string &section)
+{
+    std::string snapshot;
+    UNSERIALIZE_SCALAR(snapshot);
+    restoreSnapshot(cp->cptDir + "/" + snapshot);
+}
+
+/*
+ * Banks
+ */
+unsigned
+GskewBP::skew(unsigned v) const
+{
+    // (v_n, ..., v_1) -> (v_n ^ v_1, v_n, ..., v_2)
+    unsigned top = ((v >> (indexBits - 1)) ^ v) & 1;
+    return (v >> 1) | (top << (indexBits - 1));
+}
+
+unsigned
+GskewBP::unskew(unsigned v) const
+{
+    // (v_n, ..., v_1) -> (v_n-1, ..., v_1, v_n ^ v_n-1)
+    unsigned bottom = ((v >> (indexBits - 1)) ^ (v >> (indexBits - 2))) & 1;
+    return ((v << 1) & indexMask) | bottom;
+}
+
+void
+GskewBP::bankIndices(Addr branch_addr, unsigned ghr, unsigned salt,
+                     unsigned *idx) const
+{
+    // the hashed vector is an address half and a history half; the
+    // address bits above the index are XORed into the history half, as
+    // gshare does with the whole address
+    Addr pc = branch_addr >> instShiftAmt;
+    unsigned v1 = (unsigned)(pc ^ salt) & indexMask;
+    unsigned v2 = (unsigned)(ghr ^ (pc >> indexBits)) & indexMask;
+    idx[0] = skew(v1) ^ unskew(v2) ^ v2;
+    idx[1] = (skew(v1) ^ unskew(v2) ^ v1) + bankSize;
+    idx[2] = (unskew(v1) ^ skew(v2) ^ v2) + 2 * bankSize;
+}
+
+bool
+GskewBP::vote(const unsigned *idx)
+{
+    unsigned taken_votes = 0;
+    for (unsigned b = 0; b < numBanks; b++)
+        taken_votes += banks.read(idx[b]) > threshold;
+    stats.counterReads += numBanks;
+    if (taken_votes != 0 && taken_votes != numBanks)
+        stats.splitVotes++;
+    return taken_votes > numBanks / 2;
+}
+
+void
+GskewBP::train(const unsigned *idx, bool pred, bool taken)
+{
+    for (unsigned b = 0; b < numBanks; b++) {
+        // a correct prediction leaves the dissenting banks alone
+        bool dir = banks.read(idx[b]) > threshold;
+        if (pred == taken && dir != taken)
+            continue;
+        if (taken)
+            banks.increment(idx[b]);
+        else
+            banks.decrement(idx[b]);
+        stats.counterWrites++;
+    }
+}
+
+/*
+ * BPredUnit hooks
+ */
+void
+GskewBP::uncondBranch(ThreadID tid, Addr pc, void * &bp_history)
+{
+    BPHistory *history = historyRing[tid].push(bp_history);
+    history->globalHistoryReg = globalHistoryReg[tid];
+    history->finalPred = true;
+    history->uncond = true;
+    pushHistory(globalHistoryReg[tid], true);
+}
+
+bool
+GskewBP::lookup(ThreadID tid, Addr branch_addr, void * &bp_history)
+{
+    unsigned idx[numBanks];
+    bankIndices(branch_addr, globalHistoryReg[tid], threadSalt[tid], idx);
+    bool final_pred = vote(idx);
+
+    BPHistory *history = historyRing[tid].push(bp_history);
+    history->globalHistoryReg = globalHistoryReg[tid];
+    history->finalPred = final_pred;
+    history->uncond = false;
+
+    // speculatively update the history with the prediction
+    pushHistory(globalHistoryReg[tid], final_pred);
+    return final_pred;
+}
+
+void
+GskewBP::btbUpdate(ThreadID tid, Addr branch_addr, void * &bp_history)
+{
+    // the last outcome becomes not taken
+    globalHistoryReg[tid] &= ~1u;
+}
+
+void
+GskewBP::update(ThreadID tid, Addr branch_addr, bool taken,
+                void *bp_history, bool squashed)
+{
+    if (!bp_history)
+        return;
+
+    BPHistory &history = historyRing[tid].get(bp_history);
+    if (squashed) {
+        // mispredicted: repair the history with the outcome; the banks
+        // are trained once, at commit
+        globalHistoryReg[tid] = history.globalHistoryReg;
+        pushHistory(globalHistoryReg[tid], taken);
+        return;
+    }
+
+    if (!history.uncond) {
+        unsigned idx[numBanks];
+        bankIndices(branch_addr, history.globalHistoryReg, threadSalt[tid],
+                    idx);
+        train(idx, history.finalPred, taken);
+        if (profiler)
+            profiler->record(branch_addr, history.finalPred != taken, 0);
+    }
+    // a trace holds one thread's branches, thread 0's
+    if (traceCapture && tid == 0)
+        traceCapture->record(branch_addr, taken, !history.uncond);
+    historyRing[tid].release(bp_history);
+}
+
+void
+GskewBP::squash(ThreadID tid, void *bp_history)
+{
+    globalHistoryReg[tid] =
+        historyRing[tid].get(bp_history).globalHistoryReg;
+    historyRing[tid].squash(bp_history);
+}
+
+/*
+ * Offline replay of committed branches: lookup()/uncondBranch(), the
+ * squashing update() of a mispredicted branch and the committing
+ * update(), folded together
+ */
+uint64_t
+GskewBP::predictBatch(const BranchRecord *recs, size_t count,
+                      uint64_t *pred_bits)
+{
+    // the history of a committed branch is the outcomes before it, so
+    // the indices of later branches are known in advance: they are
+    // computed prefetchDistance records ahead and their counters
+    // prefetched while the branches in between are trained
+    unsigned pending[prefetchSlots][numBanks];
+    unsigned ghr = globalHistoryReg[0];
+    size_t ahead = 0;
+    uint64_t misses = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        for (; ahead < count && ahead <= i + prefetchDistance; ahead++) {
+            const BranchRecord &rec = recs[ahead];
+            if (rec.conditional) {
+                unsigned *idx = pending[ahead & (prefetchSlots - 1)];
+                bankIndices(rec.pc, ghr, 0, idx);
+                for (unsigned b = 0; b < numBanks; b++)
+                    banks.prefetch(idx[b]);
+            }
+            pushHistory(ghr, rec.taken || !rec.conditional);
+        }
+
+        const BranchRecord &rec = recs[i];
+        bool taken = rec.taken || !rec.conditional;
+        bool pred = true;
+        if (rec.conditional) {
+            const unsigned *idx = pending[i & (prefetchSlots - 1)];
+            pred = vote(idx);
+            misses += pred != taken;
+            train(idx, pred, taken);
+            if (profiler)
+                profiler->record(rec.pc, pred != taken, 0);
+        }
+        if (pred_bits) {
+            uint64_t bit = ULL(1) << (i & 63);
+            pred_bits[i >> 6] = pred ? pred_bits[i >> 6] | bit :
+                                       pred_bits[i >> 6] & ~bit;
+        }
+    }
+
+    // every record has been pushed by the look-ahead
+    globalHistoryReg[0] = ghr;
+    return misses;
+}
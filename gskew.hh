@@ -0,0 +1,190 @@
+/* @file
+ * Header file for a skewed gshare (gskew) branch predictor
+ *
+ * gskew (Michaud, Seznec and Uhlig, "Trading conflict and capacity
+ * aliasing in conditional branch predictors") splits the counters of
+ * gshare into three banks, each indexed by a different skewing function
+ * of the same PC and global history, and predicts by majority vote. Two
+ * branches that collide in one bank almost never collide in the other
+ * two, so the vote hides most of the destructive aliasing that a single
+ * gshare table suffers at the same size.
+ *
+ * The banks are trained at commit with the partial update policy: on a
+ * correct prediction only the banks that voted for the outcome are
+ * strengthened, leaving a dissenting counter to keep serving the branch
+ * it may belong to; on a misprediction all three are trained.
+ *
+ * Each bank has gskewBankSize localCtrBits-bit counters, and the global
+ * history is a register of log2(gskewBankSize) bits. The three indices
+ * depend only on the PC and the history, so they are computed together
+ * and the three counters are loaded in parallel; predictBatch() also
+ * prefetches the counters of the branches a few records ahead.
+ */
+
+#ifndef __CPU_PRED_GSKEW_PRED_HH__
+#define __CPU_PRED_GSKEW_PRED_HH__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/statistics.hh"
+#include "cpu/pred/bp_trace.hh"
+#include "cpu/pred/bp_trace_capture.hh"
+#include "cpu/pred/bpred_unit.hh"
+#include "cpu/pred/history_ring.hh"
+#include "cpu/pred/mispredict_profile.hh"
+#include "cpu/pred/packed_counters.hh"
+
+/** Access counts of a GskewBP, for tuning and power models. */
+struct GskewStats
+{
+    GskewStats()
+        : counterReads(0), counterWrites(0), splitVotes(0)
+    { }
+
+    /** Counters read to predict a branch, three per branch. */
+    uint64_t counterReads;
+    /** Counters trained at commit. */
+    uint64_t counterWrites;
+    /** Predictions on which the banks did not agree. */
+    uint64_t splitVotes;
+};
+
+/*
+ * Each of the numThreads hardware threads has its own global history
+ * register and history checkpoints, while the banks are shared. With
+ * threadIndexSalt, every thread but thread 0 XORs a fixed salt into the
+ * address half of the hashed vector.
+ */
+class GskewBP : public BPredUnit
+{
+  public:
+    /** Number of banks. */
+    static const unsigned numBanks = 3;
+
+    GskewBP(const Params *params);
+    void uncondBranch(ThreadID tid, Addr pc, void * &bp_history);
+    void squash(ThreadID tid, void *bp_history);
+    bool lookup(ThreadID tid, Addr branch_addr, void * &bp_history);
+    void btbUpdate(ThreadID tid, Addr branch_addr, void * &bp_history);
+    void update(ThreadID tid, Addr branch_addr, bool taken, void *bp_history,
+                bool squashed);
+    void reset();
+
+    /**
+     * Predict and train on a run of committed branches of thread 0
+     * without going through the BPredUnit hooks; the banks end up
+     * exactly as after lookup()/uncondBranch() and update() for every
+     * record. Branches are not recorded to branchTraceFile.
+     * @param recs The branches, in program order.
+     * @param count Number of branches.
+     * @param pred_bits If not NULL, bit i of word i / 64 is set to the
+     * prediction for recs[i] (unconditional branches predict taken).
+     * @return The number of mispredicted conditional branches.
+     */
+    uint64_t predictBatch(const BranchRecord *recs, size_t count,
+                          uint64_t *pred_bits);
+
+    /**
+     * Write the banks and the global histories to a snapshot file (see
+     * bp_snapshot.hh). No branch may be in flight.
+     */
+    void saveSnapshot(const std::string &path) const;
+
+    /**
+     * Restore the state saved by saveSnapshot() from a predictor with
+     * the same table parameters, mapping the banks copy-on-write.
+     */
+    void restoreSnapshot(const std::string &path);
+
+    /** Checkpointing: the tables go to a snapshot next to the
+     *  checkpoint, named in the checkpoint. */
+    void serialize(std::ostream &os);
+    void unserialize(Checkpoint *cp, const std::string &section);
+
+    /** Occupancy counts of a thread's history checkpoint ring. */
+    const HistoryRingStats &historyStats(ThreadID tid = 0) const
+    { return historyRing[tid].getStats(); }
+
+    /** Counter access counts. */
+    const GskewStats &accessStats() const { return stats; }
+
+    /** Register accessStats() as gem5 statistics. */
+    void regStats();
+
+    /** Bits of predictor state: the banks and the history registers. */
+    uint64_t storageBits() const;
+
+  private:
+    struct BPHistory
+    {
+        /** The thread's history register before this branch. */
+        unsigned globalHistoryReg;
+        bool finalPred;
+        /** True if the history belongs to an unconditional branch. */
+        bool uncond;
+    };
+
+    /** The skewing function H of the paper and its inverse. */
+    unsigned skew(unsigned v) const;
+    unsigned unskew(unsigned v) const;
+
+    /**
+     * Index of the counter of each bank, into 'banks', for a branch
+     * with history register 'ghr'.
+     */
+    void bankIndices(Addr branch_addr, unsigned ghr, unsigned salt,
+                     unsigned *idx) const;
+
+    /** Majority vote of the counters at 'idx'. */
+    bool vote(const unsigned *idx);
+
+    /** Train the banks with the partial update policy. */
+    void train(const unsigned *idx, bool pred, bool taken);
+
+    void pushHistory(unsigned &ghr, bool taken) const
+    { ghr = ((ghr << 1) | taken) & indexMask; }
+
+    /** Parameters a snapshot must agree on, as a string. */
+    std::string snapshotConfig() const;
+
+    /** Number of hardware threads. */
+    unsigned numThreads;
+
+    /** Per thread, the checkpoints handed out as bp_history by lookup()
+     *  and uncondBranch(). */
+    std::vector<HistoryRing<BPHistory> > historyRing;
+    /** Per thread, the global history register. */
+    std::vector<unsigned> globalHistoryReg;
+
+    unsigned instShiftAmt;
+
+    /** The three banks of bankSize counters, back to back. */
+    PackedCounterTable banks;
+    unsigned bankSize;
+    /** log2(bankSize): the index and history width. */
+    unsigned indexBits;
+    unsigned indexMask;
+    /** Counters above this predict taken. */
+    unsigned threshold;
+
+    /** Per thread, the salt XORed into the address half of the index
+     *  (0 unless threadIndexSalt is set). */
+    std::vector<unsigned> threadSalt;
+
+    /** Records committed branches if branchTraceFile is set. */
+    std::unique_ptr<BranchTraceCapture> traceCapture;
+    /** Profiles mispredicted branches if mispredictProfile is set. */
+    std::unique_ptr<MispredictProfiler> profiler;
+
+    GskewStats stats;
+
+    /** The counts of 'stats' as gem5 statistics. */
+    Stats::Value statCounterReads;
+    Stats::Value statCounterWrites;
+    Stats::Value statSplitVotes;
+};
+
+#endif // __CPU_PRED_GSKEW_PRED_HH__
@@ -0,0 +1,161 @@
+/* @file
+ * Ring of speculative history checkpoints
+ *
+ * Branch history records live and die in program order: they are
+ * created at prediction, released oldest first when branches commit,
+ * and discarded youngest first when the pipeline squashes. The ring
+ * exploits that: a checkpoint is the next slot at the tail, commit
+ * frees slots at the head, and a squash rolls the tail back to the
+ * squashed branch. Nothing is allocated after construction and the
+ * ring bounds predictor memory; sized to at least the number of
+ * branches that can be in flight (the ROB size), it never fills.
+ *
+ * The bp_history handle given to the CPU is the slot index plus one, so
+ * it is never NULL.
+ */
+
+#ifndef __CPU_PRED_HISTORY_RING_HH__
+#define __CPU_PRED_HISTORY_RING_HH__
+
+#include <cstdint>
+#include <vector>
+
+#include "base/intmath.hh"
+#include "base/misc.hh"
+
+/** Occupancy counts of a HistoryRing, kept for sizing it. */
+struct HistoryRingStats
+{
+    HistoryRingStats()
+        : pushes(0), releases(0), squashes(0), peakLive(0)
+    { }
+
+    uint64_t pushes;
+    uint64_t releases;
+    uint64_t squashes;
+    uint64_t peakLive;
+};
+
+template <class T>
+class HistoryRing
+{
+  public:
+    HistoryRing(unsigned entries)
+        : head(0), tail(0)
+    {
+        if (entries == 0)
+            fatal("History checkpoint ring must have at least one entry.\n");
+        // Round up so slot indices are a mask away from positions.
+        unsigned size = 1 << ceilLog2(entries);
+        slots.resize(size);
+        ringMask = size - 1;
+    }
+
+    /**
+     * Take the next checkpoint and set 'handle' to it. The returned
+     * record is uninitialized.
+     */
+    T *
+    push(void * &handle)
+    {
+        if (tail - head > ringMask)
+            panic("History checkpoint ring overflow; %u branches in flight."
+                  " Raise historyCheckpoints.\n", tail - head);
+
+        unsigned idx = tail++ & ringMask;
+        slots[idx].live = true;
+        handle = reinterpret_cast<void *>((uintptr_t)idx + 1);
+
+        stats.pushes++;
+        if (tail - head > stats.peakLive)
+            stats.peakLive = tail - head;
+        return &slots[idx].value;
+    }
+
+    /** The checkpoint behind a handle from push(). */
+    T &
+    get(void *handle)
+    {
+        return slots[index(handle)].value;
+    }
+
+    /**
+     * The branch has committed. Slots are reclaimed once every older
+     * checkpoint has been released as well.
+     */
+    void
+    release(void *handle)
+    {
+        slots[index(handle)].live = false;
+        while (head != tail && !slots[head & ringMask].live)
+            head++;
+        stats.releases++;
+    }
+
+    /** Discard the checkpoint and every younger one. */
+    void
+    squash(void *handle)
+    {
+        unsigned idx = index(handle);
+        unsigned pos = head + ((idx - head) & ringMask);
+        for (unsigned p = pos; p != tail; p++)
+            slots[p & ringMask].live = false;
+        tail = pos;
+        while (head != tail && !slots[head & ringMask].live)
+            head++;
+        stats.squashes++;
+    }
+
+    /**
+     * Call 'undo' on the checkpoint and every younger one, youngest
+     * first, then discard them as squash() does; for state that each
+     * branch changed in a different place.
+     */
+    template <class Undo>
+    void
+    squash(void *handle, Undo undo)
+    {
+        unsigned pos = head + ((index(handle) - head) & ringMask);
+        for (unsigned p = tail; p != pos; p--)
+            undo(slots[(p - 1) & ringMask].value);
+        squash(handle);
+    }
+
+    /** Drop every checkpoint. */
+    void
+    clear()
+    {
+        for (unsigned p = head; p != tail; p++)
+            slots[p & ringMask].live = false;
+        head = tail = 0;
+    }
+
+    const HistoryRingStats &getStats() const { return stats; }
+
+  private:
+    struct Slot
+    {
+        Slot()
+            : live(false)
+        { }
+
+        T value;
+        bool live;
+    };
+
+    unsigned
+    index(void *handle) const
+    {
+        return (unsigned)(reinterpret_cast<uintptr_t>(handle) - 1);
+    }
+
+    std::vector<Slot> slots;
+    unsigned ringMask;
+    /** Position of the oldest live checkpoint. */
+    unsigned head;
+    /** Position the next checkpoint is taken from. */
+    unsigned tail;
+    HistoryRingStats stats;
+};
+
+#endif // __CPU_PRED_HISTORY_RING_HH__
@@ -0,0 +1,230 @@
+/* @file
+ * Global and path history longer than a register, with folding
+ *
+ * A LongHistory keeps the outcomes of the last branches of a thread in
+ * a circular bit buffer, hundreds of bits if need be, and a path
+ * history of up to 32 bits made of one address bit per branch. Table
+ * indices and tags do not read the buffer: they read folded histories,
+ * each the last 'length' outcomes XOR-folded into 'width' bits (bit i
+ * of the fold is the XOR of outcomes i, i + width, i + 2 * width, ...
+ * rotated by the number of branches pushed). A fold is updated in O(1)
+ * per branch from the outcome entering the window and the one leaving
+ * it (Michaud, "A PPM-like, tag-based branch predictor"), so hashing a
+ * 600-bit history costs no more than a 10-bit one.
+ *
+ * A Checkpoint is the buffer position, the path history and the folds,
+ * a few words: outcomes older than the position stay in the buffer, so
+ * restoring a checkpoint rolls the history back without copying it, as
+ * long as the buffer is longer than the longest fold plus the branches
+ * in flight. MaxFolds bounds the folds, and with them the size of a
+ * Checkpoint.
+ *
+ * All-zero is the initial state, as for the tables.
+ */
+
+#ifndef __CPU_PRED_LONG_HISTORY_HH__
+#define __CPU_PRED_LONG_HISTORY_HH__
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "base/intmath.hh"
+#include "base/misc.hh"
+#include "base/types.hh"
+
+template <unsigned MaxFolds>
+class LongHistory
+{
+  public:
+    /** The state restore() returns to. */
+    struct Checkpoint
+    {
+        unsigned pos;
+        uint32_t path;
+        uint32_t folds[MaxFolds];
+    };
+
+    LongHistory()
+        : bufferMask(0), pathMask(0), numFolds(0), pos(0), path(0)
+    {
+        std::memset(folds, 0, sizeof(folds));
+    }
+
+    /**
+     * Keep at least 'length' outcomes with up to 'in_flight' branches
+     * rolled back by restore(), and 'path_bits' bits of path history
+     * (0 to 32).
+     */
+    void
+    init(unsigned length, unsigned in_flight, unsigned path_bits)
+    {
+        if (path_bits > 32)
+            fatal("Path history is limited to 32 bits.\n");
+        unsigned size = 1 << ceilLog2(std::max(length + in_flight + 1, 64u));
+        words.assign(size / 64, 0);
+        bufferMask = size - 1;
+        pathMask = path_bits == 32 ? ~0u : (1u << path_bits) - 1;
+        numFolds = 0;
+        clear();
+    }
+
+    /**
+     * Fold the last 'length' outcomes into 'width' bits (1 to 31) from
+     * now on. Returns the fold's number, for fold(). Folds are added
+     * before the first push().
+     */
+    unsigned
+    addFold(unsigned length, unsigned width)
+    {
+        if (numFolds == MaxFolds)
+            panic("Too many folded histories.\n");
+        if (width < 1 || width > 31)
+            panic("Folded history of %u bits.\n", width);
+        if (length + 1 > bufferMask)
+            panic("Folded history longer than the history buffer.\n");
+        Spec &spec = specs[numFolds];
+        spec.length = length;
+        spec.width = width;
+        spec.outPoint = length % width;
+        spec.mask = (1u << width) - 1;
+        folds[numFolds] = 0;
+        return numFolds++;
+    }
+
+    /**
+     * Append the outcome of a branch, and 'pc_bit' (only bit 0 is
+     * used) to the path history.
+     */
+    void
+    push(bool taken, unsigned pc_bit)
+    {
+        setBit(pos, taken);
+        pos++;
+        path = ((path << 1) | (pc_bit & 1)) & pathMask;
+        unsigned newest = pos - 1;
+        for (unsigned f = 0; f < numFolds; f++) {
+            const Spec &spec = specs[f];
+            uint32_t fold = (folds[f] << 1) | taken;
+            fold ^= (uint32_t)bit(newest - spec.length) << spec.outPoint;
+            fold ^= fold >> spec.width;
+            folds[f] = fold & spec.mask;
+        }
+    }
+
+    /**
+     * Replace the outcome of the last branch pushed. The outcome enters
+     * a fold at bit 0 only, so this flips bit 0 of every fold.
+     */
+    void
+    setLastOutcome(bool taken)
+    {
+        unsigned last = pos - 1;
+        if (bit(last) == taken)
+            return;
+        setBit(last, taken);
+        for (unsigned f = 0; f < numFolds; f++)
+            folds[f] ^= 1;
+    }
+
+    /** Folded history number 'f'. */
+    uint32_t fold(unsigned f) const { return folds[f]; }
+    /** The path history, the last branch in bit 0. */
+    uint32_t pathHistory() const { return path; }
+    /** Outcome of the branch 'age' branches ago (0: the last). */
+    bool outcome(unsigned age) const { return bit(pos - 1 - age); }
+
+    void
+    save(Checkpoint &cp) const
+    {
+        cp.pos = pos;
+        cp.path = path;
+        std::memcpy(cp.folds, folds, numFolds * sizeof(folds[0]));
+    }
+
+    /**
+     * Roll back to a checkpoint; the outcomes pushed since are
+     * dropped.
+     */
+    void
+    restore(const Checkpoint &cp)
+    {
+        pos = cp.pos;
+        path = cp.path;
+        std::memcpy(folds, cp.folds, numFolds * sizeof(folds[0]));
+    }
+
+    /** Forget every outcome. */
+    void
+    clear()
+    {
+        std::fill(words.begin(), words.end(), 0);
+        std::memset(folds, 0, sizeof(folds));
+        pos = 0;
+        path = 0;
+    }
+
+    /** Words of state for a snapshot: position, path, folds, buffer. */
+    size_t stateWords() const { return 2 + numFolds + words.size(); }
+
+    void
+    saveState(uint64_t *state) const
+    {
+        *state++ = pos;
+        *state++ = path;
+        for (unsigned f = 0; f < numFolds; f++)
+            *state++ = folds[f];
+        std::copy(words.begin(), words.end(), state);
+    }
+
+    void
+    loadState(const uint64_t *state)
+    {
+        pos = *state++;
+        path = *state++ & pathMask;
+        for (unsigned f = 0; f < numFolds; f++)
+            folds[f] = *state++ & specs[f].mask;
+        std::copy(state, state + words.size(), words.begin());
+    }
+
+  private:
+    struct Spec
+    {
+        unsigned length;
+        unsigned width;
+        /** Bit the outcome leaving the window is folded into. */
+        unsigned outPoint;
+        uint32_t mask;
+    };
+
+    bool
+    bit(unsigned p) const
+    {
+        p &= bufferMask;
+        return (words[p >> 6] >> (p & 63)) & 1;
+    }
+
+    void
+    setBit(unsigned p, bool value)
+    {
+        p &= bufferMask;
+        uint64_t b = ULL(1) << (p & 63);
+        words[p >> 6] = value ? words[p >> 6] | b : words[p >> 6] & ~b;
+    }
+
+    /** The outcomes, one bit each, pos - 1 the newest. */
+    std::vector<uint64_t> words;
+    unsigned bufferMask;
+    uint32_t pathMask;
+
+    Spec specs[MaxFolds];
+    unsigned numFolds;
+
+    /** Outcomes pushed so far. */
+    unsigned pos;
+    uint32_t path;
+    uint32_t folds[MaxFolds];
+};
+
+#endif // __CPU_PRED_LONG_HISTORY_HH__
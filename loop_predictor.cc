@@ -0,0 +1,179 @@
+/* @file
+ * Implementation of a tagged loop predictor
+ */
+
+#include "cpu/pred/loop_predictor.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/bitfield.hh"
+#include "base/intmath.hh"
+#include "base/misc.hh"
+
+LoopPredictor::LoopPredictor()
+    : setMask(0), setBits(0), allocationTick(0)
+{
+}
+
+void
+LoopPredictor::init(unsigned entries)
+{
+    if (!isPowerOf2(entries) || entries < ways)
+        fatal("Invalid loop predictor size, must be a power of two of at "
+              "least %u.\n", ways);
+    static_assert(sizeof(Entry) == sizeof(uint64_t),
+                  "a loop predictor entry is saved as one word");
+    table.assign(entries, Entry());
+    setBits = ceilLog2(entries / ways);
+    setMask = mask(setBits);
+    clear();
+}
+
+void
+LoopPredictor::lookup(Addr pc, Lookup &l) const
+{
+    unsigned idx = setIndex(pc);
+    const Entry *set = &table[idx * ways];
+    l.entry = -1;
+    l.tag = (uint16_t)((pc >> setBits) & mask(tagBits));
+    l.iterBefore = 0;
+    l.pred = false;
+    l.confident = false;
+    for (unsigned w = 0; w < ways; w++) {
+        const Entry &e = set[w];
+        if (e.tag != l.tag)
+            continue;
+        l.entry = (int)(idx * ways + w);
+        l.iterBefore = e.iter;
+        // the next iteration is the last one of a trip
+        bool exit = ((e.iter + 1) & mask(iterBits)) == e.tripCount;
+        l.pred = exit ? !e.dir : e.dir;
+        l.confident = e.confidence == confidenceMax;
+        return;
+    }
+}
+
+void
+LoopPredictor::speculate(const Lookup &l, bool taken)
+{
+    if (l.entry < 0)
+        return;
+    Entry &e = table[l.entry];
+    // the entry may have been taken by another branch since
+    if (e.tag != l.tag)
+        return;
+    e.iter = taken == e.dir ? (l.iterBefore + 1) & mask(iterBits) : 0;
+}
+
+void
+LoopPredictor::restore(const Lookup &l)
+{
+    if (l.entry < 0)
+        return;
+    Entry &e = table[l.entry];
+    if (e.tag == l.tag)
+        e.iter = l.iterBefore;
+}
+
+void
+LoopPredictor::free(Entry &e)
+{
+    e.tripCount = 0;
+    e.confidence = 0;
+    e.age = 0;
+}
+
+void
+LoopPredictor::update(Addr pc, const Lookup &l, bool taken, bool main_pred)
+{
+    if (l.entry >= 0 && table[l.entry].tag == l.tag) {
+        Entry &e = table[l.entry];
+        if (l.confident) {
+            if (l.pred != taken) {
+                free(e);
+                return;
+            }
+            if (l.pred != main_pred && e.age < ageMax)
+                e.age++;
+        }
+
+        unsigned iter = (l.iterBefore + 1) & mask(iterBits);
+        // a trip longer than the recorded one
+        if (iter > e.tripCount) {
+            e.confidence = 0;
+            if (e.tripCount)
+                free(e);
+        }
+        if (taken != (bool)e.dir) {
+            if (iter == e.tripCount) {
+                if (e.confidence < confidenceMax)
+                    e.confidence++;
+                // loops of one or two iterations are left to the main
+                // predictor
+                if (e.tripCount < 3) {
+                    e.dir = taken;
+                    free(e);
+                }
+            } else if (e.tripCount == 0) {
+                // the first whole trip
+                e.tripCount = iter;
+                e.confidence = 0;
+            } else {
+                // a different trip count: start again
+                e.tripCount = 0;
+                e.confidence = 0;
+            }
+        }
+        return;
+    }
+
+    if (taken == main_pred || (allocationTick++ & 3) != 0)
+        return;
+    Entry *set = &table[setIndex(pc) * ways];
+    unsigned first = (allocationTick >> 2) & (ways - 1);
+    for (unsigned i = 0; i < ways; i++) {
+        Entry &e = set[(first + i) & (ways - 1)];
+        if (e.age) {
+            e.age--;
+            continue;
+        }
+        // most mispredictions of a loop branch are its exits
+        e.tag = l.tag;
+        e.dir = !taken;
+        e.tripCount = 0;
+        e.iter = 0;
+        e.confidence = 0;
+        e.age = ageMax;
+        return;
+    }
+}
+
+void
+LoopPredictor::clear()
+{
+    std::fill(table.begin(), table.end(), Entry());
+    allocationTick = 0;
+}
+
+uint64_t
+LoopPredictor::storageBits() const
+{
+    return (uint64_t)table.size() *
+        (tagBits + 2 * iterBits + ceilLog2(confidenceMax + 1) +
+         ceilLog2(ageMax + 1) + 1) + 2;
+}
+
+void
+LoopPredictor::saveState(uint64_t *state) const
+{
+    *state++ = allocationTick;
+    std::memcpy(state, &table[0], table.size() * sizeof(Entry));
+}
+
+void
+LoopPredictor::loadState(const uint64_t *state)
+{
+    allocationTick = (unsigned)*state++;
+    std::memcpy(&table[0], state, table.size() * sizeof(Entry));
+}
@@ -0,0 +1,144 @@
+/* @file
+ * Tagged loop predictor, a side component of the direction predictors
+ *
+ * A loop-closing branch with a fixed trip count N goes the same way N -
+ * 1 times and then the other way once. A global-history table learns
+ * the exit only if the history reaches back a whole trip, and meanwhile
+ * the loop spreads over as many counters (or cache entries) as it has
+ * histories. The loop predictor of L-TAGE (Seznec, "The L-TAGE branch
+ * predictor") instead keeps, per loop branch, the trip count seen on
+ * the last trips and the current iteration, and predicts the exit when
+ * the iteration reaches the trip count.
+ *
+ * The table has loopPredictorEntries entries in sets of 4 ways, tagged
+ * by the PC; the set index folds the PC bits above it into the low
+ * bits, so branches at a power-of-two stride do not crowd into a few
+ * sets. An entry is allocated when the main predictor mispredicts
+ * a branch the table does not hold, assuming the misprediction was a
+ * loop exit. At each exit, the iteration count is compared with the
+ * recorded trip count: a match raises the confidence, a mismatch
+ * forgets the trip count. Only a confident entry overrides the main
+ * predictor, and a confident entry that mispredicts is freed. The age
+ * of an entry grows when it overrides a wrong main prediction and
+ * shrinks when allocations find its set full, so entries that do not
+ * pay for themselves are replaced.
+ *
+ * The iteration count is speculative: lookup() reads it, speculate()
+ * advances it with the direction the branch is fetched down, and
+ * restore() puts back the value the Lookup saved, so rolling back the
+ * branches of a squash youngest first leaves every entry as it was.
+ * Training happens at commit, from the iteration count the Lookup
+ * saved.
+ */
+
+#ifndef __CPU_PRED_LOOP_PREDICTOR_HH__
+#define __CPU_PRED_LOOP_PREDICTOR_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "base/types.hh"
+
+class LoopPredictor
+{
+  public:
+    /** Ways per set. */
+    static const unsigned ways = 4;
+    /** Bits of an entry's tag. */
+    static const unsigned tagBits = 14;
+    /** Bits of the trip and iteration counts; longer loops are not
+     *  predicted. */
+    static const unsigned iterBits = 14;
+    /** Trips of the same count before an entry overrides. */
+    static const unsigned confidenceMax = 3;
+    static const unsigned ageMax = 7;
+
+    /** What lookup() found, kept with the branch's checkpoint. */
+    struct Lookup
+    {
+        /** Entry of the branch, -1 if the table missed. */
+        int entry;
+        uint16_t tag;
+        /** Iteration count before this branch. */
+        uint16_t iterBefore;
+        /** Direction the entry predicts. */
+        bool pred;
+        /** The entry is confident: pred overrides the main predictor. */
+        bool confident;
+
+        /** The prediction, given the main predictor's. */
+        bool
+        predict(bool main_pred) const
+        {
+            return confident ? pred : main_pred;
+        }
+    };
+
+    LoopPredictor();
+
+    /** Size the table, all entries empty; entries is a power of two of
+     *  at least ways. */
+    void init(unsigned entries);
+
+    /** Look up the branch at 'pc' (shifted right by instShiftAmt). */
+    void lookup(Addr pc, Lookup &l) const;
+
+    /** Advance the iteration count of a branch fetched as 'taken'. */
+    void speculate(const Lookup &l, bool taken);
+
+    /** Put the iteration count of the branch back as before lookup(). */
+    void restore(const Lookup &l);
+
+    /**
+     * Train on a committed branch and allocate an entry if the main
+     * predictor, which predicted 'main_pred', mispredicted it.
+     */
+    void update(Addr pc, const Lookup &l, bool taken, bool main_pred);
+
+    /** Empty every entry. */
+    void clear();
+
+    /** Number of entries. */
+    unsigned entries() const { return table.size(); }
+
+    /** Bits of state: tag, counts, confidence, age and direction. */
+    uint64_t storageBits() const;
+
+    /** Words of state for a snapshot. */
+    size_t stateWords() const { return 1 + table.size(); }
+    void saveState(uint64_t *state) const;
+    void loadState(const uint64_t *state);
+
+  private:
+    /** One entry; all-zero is empty. */
+    struct Entry
+    {
+        uint16_t tag;
+        /** Trip count of the last trips, 0 while unknown. */
+        uint16_t tripCount;
+        /** Speculative iteration count of the current trip. */
+        uint16_t iter;
+        uint8_t confidence : 4;
+        /** Direction of the iterations, the exit being the other. */
+        uint8_t dir : 1;
+        uint8_t age;
+    };
+
+    /** Set of the branch at 'pc'. */
+    unsigned
+    setIndex(Addr pc) const
+    {
+        return (unsigned)(pc ^ (pc >> setBits)) & setMask;
+    }
+
+    void free(Entry &e);
+
+    std::vector<Entry> table;
+    unsigned setMask;
+    unsigned setBits;
+    /** Allocations are attempted on one main misprediction in four. */
+    unsigned allocationTick;
+};
+
+#endif // __CPU_PRED_LOOP_PREDICTOR_HH__
@@ -0,0 +1,205 @@
+/* @file
+ * Bounded-memory profile of the branches that mispredict most
+ */
+
+#include "cpu/pred/mispredict_profile.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/intmath.hh"
+#include "base/misc.hh"
+#include "sim/sim_exit.hh"
+
+namespace
+{
+
+/** Odd multipliers hashing a PC into each row of the sketch. */
+const uint64_t sketchSeeds[] = {
+    ULL(0x9e3779b97f4a7c15), ULL(0xc2b2ae3d27d4eb4f),
+    ULL(0x165667b19e3779f9), ULL(0xd6e8feb86659fd93),
+};
+
+} // anonymous namespace
+
+MispredictProfiler::MispredictProfiler(
+    const std::string &path, unsigned entries, unsigned top,
+    const std::vector<std::string> &components)
+    : path(path), capacity(entries), top(top), components(components),
+      totalExecutions(0), totalMispredicts(0), closed(false)
+{
+    if (!capacity)
+        fatal("Misprediction profile needs at least one entry.\n");
+    if (components.empty() || components.size() > maxComponents)
+        panic("Misprediction profile of %zu components.\n",
+              components.size());
+
+    this->entries.reserve(capacity);
+    heap.reserve(capacity);
+    heapPos.reserve(capacity);
+    index.reserve(capacity);
+
+    sketchBits = ceilLog2(4 * capacity);
+    sketch.assign(sketchRows << sketchBits, 0);
+
+    exitCallback = new ExitCallback(this);
+    registerExitCallback(exitCallback);
+}
+
+MispredictProfiler::~MispredictProfiler()
+{
+    close();
+    exitCallback->profiler = NULL;
+}
+
+size_t
+MispredictProfiler::sketchCell(Addr pc, unsigned row) const
+{
+    return ((size_t)row << sketchBits) +
+        ((pc * sketchSeeds[row]) >> (64 - sketchBits));
+}
+
+void
+MispredictProfiler::countExecution(Addr pc)
+{
+    totalExecutions++;
+
+    // conservative update: only raise the rows holding the minimum,
+    // which keeps the estimate an upper bound but tightens it
+    uint32_t *cells[sketchRows];
+    uint32_t min = UINT32_MAX;
+    for (unsigned r = 0; r < sketchRows; r++) {
+        cells[r] = &sketch[sketchCell(pc, r)];
+        min = std::min(min, *cells[r]);
+    }
+    if (min == UINT32_MAX)
+        return;
+    for (unsigned r = 0; r < sketchRows; r++) {
+        if (*cells[r] == min)
+            *cells[r] = min + 1;
+    }
+}
+
+uint64_t
+MispredictProfiler::executions(Addr pc) const
+{
+    uint32_t min = UINT32_MAX;
+    for (unsigned r = 0; r < sketchRows; r++) {
+        min = std::min(min, sketch[sketchCell(pc, r)]);
+    }
+    return min;
+}
+
+void
+MispredictProfiler::countMispredict(Addr pc, unsigned component)
+{
+    totalMispredicts++;
+
+    unsigned slot;
+    std::unordered_map<Addr, unsigned>::iterator it = index.find(pc);
+    if (it != index.end()) {
+        slot = it->second;
+    } else if (entries.size() < capacity) {
+        // a new counter starts at 0, below every other: it becomes the
+        // root of the heap
+        Entry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.pc = pc;
+        slot = entries.size();
+        entries.push_back(entry);
+        heap.push_back(slot);
+        heapPos.push_back(heap.size() - 1);
+        for (unsigned pos = heap.size() - 1; pos; pos = (pos - 1) / 2) {
+            unsigned parent = (pos - 1) / 2;
+            std::swap(heap[pos], heap[parent]);
+            heapPos[heap[pos]] = pos;
+            heapPos[heap[parent]] = parent;
+        }
+        index[pc] = slot;
+    } else {
+        // take over the smallest counter, whose count bounds how many
+        // of its mispredictions are not ours
+        slot = heap[0];
+        Entry &entry = entries[slot];
+        index.erase(entry.pc);
+        entry.pc = pc;
+        entry.error = entry.mispredicts;
+        std::memset(entry.byComponent, 0, sizeof(entry.byComponent));
+        index[pc] = slot;
+    }
+
+    entries[slot].mispredicts++;
+    entries[slot].byComponent[component]++;
+    siftDown(heapPos[slot]);
+}
+
+void
+MispredictProfiler::siftDown(unsigned pos)
+{
+    unsigned size = heap.size();
+    while (true) {
+        unsigned smallest = pos;
+        unsigned left = 2 * pos + 1;
+        unsigned right = left + 1;
+        if (left < size && entries[heap[left]].mispredicts <
+            entries[heap[smallest]].mispredicts)
+            smallest = left;
+        if (right < size && entries[heap[right]].mispredicts <
+            entries[heap[smallest]].mispredicts)
+            smallest = right;
+        if (smallest == pos)
+            return;
+        std::swap(heap[pos], heap[smallest]);
+        heapPos[heap[pos]] = pos;
+        heapPos[heap[smallest]] = smallest;
+        pos = smallest;
+    }
+}
+
+void
+MispredictProfiler::close()
+{
+    if (closed)
+        return;
+    closed = true;
+
+    std::vector<const Entry *> order(entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+        order[i] = &entries[i];
+    size_t shown = std::min<size_t>(top, order.size());
+    std::partial_sort(order.begin(), order.begin() + shown, order.end(),
+                      [](const Entry *a, const Entry *b) {
+                          return a->mispredicts - a->error >
+                              b->mispredicts - b->error;
+                      });
+
+    std::FILE *file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        warn("Cannot create misprediction profile '%s'.\n", path.c_str());
+        return;
+    }
+    std::fprintf(file, "# %llu conditional branches, %llu mispredicted, "
+                 "%u counters\n", (unsigned long long)totalExecutions,
+                 (unsigned long long)totalMispredicts, capacity);
+    std::fprintf(file, "# pc mispredicts error executions miss_rate");
+    for (size_t c = 0; c < components.size(); c++)
+        std::fprintf(file, " %s", components[c].c_str());
+    std::fprintf(file, "\n");
+    for (size_t i = 0; i < shown; i++) {
+        const Entry &entry = *order[i];
+        uint64_t execs = executions(entry.pc);
+        uint64_t guaranteed = entry.mispredicts - entry.error;
+        double rate = execs ? (double)guaranteed / execs : 0.0;
+        std::fprintf(file, "%#llx %llu %llu %llu %.4f",
+                     (unsigned long long)entry.pc,
+                     (unsigned long long)entry.mispredicts,
+                     (unsigned long long)entry.error,
+                     (unsigned long long)execs, std::min(rate, 1.0));
+        for (size_t c = 0; c < components.size(); c++)
+            std::fprintf(file, " %llu",
+                         (unsigned long long)entry.byComponent[c]);
+        std::fprintf(file, "\n");
+    }
+    if (std::fclose(file) != 0)
+        warn("Error writing misprediction profile '%s'.\n", path.c_str());
+}
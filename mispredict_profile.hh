@@ -0,0 +1,127 @@
+/* @file
+ * Bounded-memory profile of the branches that mispredict most
+ *
+ * A predictor with mispredictProfile set reports every conditional
+ * branch it sees commit to a MispredictProfiler, together with whether
+ * it was mispredicted and which predictor component made the
+ * prediction. The profiler keeps
+ *
+ *  - the mispredictions per branch PC in a space-saving summary of
+ *    profileEntries counters (Metwally et al., "Efficient Computation
+ *    of Frequent and Top-k Elements in Data Streams"): a PC without a
+ *    counter takes over the smallest one, inheriting its count as the
+ *    bound on its overestimate ('error'). Every PC with more than
+ *    1/profileEntries of all mispredictions is guaranteed a counter.
+ *  - the executions per PC in a count-min sketch (Cormode and
+ *    Muthukrishnan) of 4 rows of 4 * profileEntries counters, with
+ *    conservative update, which never underestimates.
+ *
+ * so its memory depends on profileEntries only, however many static
+ * branches the workload has. At simulator exit the profileTop PCs with
+ * the most guaranteed mispredictions (count minus error) are written
+ * to the profile file, one per line, with their executions, miss rate
+ * (a lower bound: guaranteed mispredictions over the executions upper
+ * bound) and the mispredictions made by each component. Counts by
+ * component only cover the time since the PC last took over a counter.
+ * With many similar branches and too few entries, every counter
+ * churns, errors stay close to the counts and the report says so.
+ */
+
+#ifndef __CPU_PRED_MISPREDICT_PROFILE_HH__
+#define __CPU_PRED_MISPREDICT_PROFILE_HH__
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/callback.hh"
+#include "base/types.hh"
+
+class MispredictProfiler
+{
+  public:
+    /** Most components a predictor can attribute predictions to. */
+    static const unsigned maxComponents = 4;
+
+    /**
+     * Profile into 'path' with 'entries' misprediction counters,
+     * reporting the top 'top' PCs. 'components' names the predictor
+     * components record() is given the index of. Like
+     * BranchTraceCapture, the profiler writes the report from a
+     * simulator exit callback if it is still open then, or when it is
+     * deleted, which disarms the callback.
+     */
+    MispredictProfiler(const std::string &path, unsigned entries,
+                       unsigned top,
+                       const std::vector<std::string> &components);
+    ~MispredictProfiler();
+
+    /**
+     * Count the commit of a conditional branch predicted by component
+     * 'component'.
+     */
+    void
+    record(Addr pc, bool mispredicted, unsigned component)
+    {
+        countExecution(pc);
+        if (mispredicted)
+            countMispredict(pc, component);
+    }
+
+    /** Write the report now; later calls do nothing. */
+    void close();
+
+  private:
+    /** Closes the profiler at exit unless it was deleted first. */
+    class ExitCallback : public Callback
+    {
+      public:
+        ExitCallback(MispredictProfiler *profiler) : profiler(profiler) { }
+        void process() { if (profiler) profiler->close(); }
+        MispredictProfiler *profiler;
+    };
+
+    struct Entry
+    {
+        Addr pc;
+        /** Mispredictions, overestimated by up to 'error'. */
+        uint64_t mispredicts;
+        uint64_t error;
+        uint64_t byComponent[maxComponents];
+    };
+
+    /** Index in 'sketch' of the counter of 'pc' in row 'row'. */
+    size_t sketchCell(Addr pc, unsigned row) const;
+    void countExecution(Addr pc);
+    void countMispredict(Addr pc, unsigned component);
+    uint64_t executions(Addr pc) const;
+
+    /** Restore the heap order from heap[pos] down. */
+    void siftDown(unsigned pos);
+
+    std::string path;
+    unsigned capacity;
+    unsigned top;
+    std::vector<std::string> components;
+
+    /** Space-saving counters, and a min-heap of their indices by
+     *  'mispredicts', with each entry's position in it. */
+    std::vector<Entry> entries;
+    std::vector<unsigned> heap;
+    std::vector<unsigned> heapPos;
+    std::unordered_map<Addr, unsigned> index;
+
+    /** Count-min sketch of executions, sketchRows rows of
+     *  2^sketchBits counters. */
+    static const unsigned sketchRows = 4;
+    std::vector<uint32_t> sketch;
+    unsigned sketchBits;
+
+    uint64_t totalExecutions;
+    uint64_t totalMispredicts;
+    bool closed;
+    ExitCallback *exitCallback;
+};
+
+#endif // __CPU_PRED_MISPREDICT_PROFILE_HH__
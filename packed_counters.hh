@@ -0,0 +1,180 @@
+/* @file
+ * Bit-packed saturating counters
+ *
+ * A SatCounter object spends three bytes (initial value, maximum and
+ * value) on what is usually a 2-bit counter. The predictor tables here
+ * store only the counter values, packed into machine words: a counter
+ * of n bits takes a slot of the next power of two of n bits (1, 2, 4 or
+ * 8), so 2-bit counters pack 32 to a 64-bit word and a slot never
+ * straddles a word. Counters start at 0 and saturate at 2^n - 1,
+ * exactly as SatCounter does.
+ *
+ * The words live in a TableStorage: all-zero words are the initial
+ * state, so a table is allocated and reset without writing it, and it
+ * can be restored from a predictor snapshot by mapping it (see
+ * bp_snapshot.hh).
+ */
+
+#ifndef __CPU_PRED_PACKED_COUNTERS_HH__
+#define __CPU_PRED_PACKED_COUNTERS_HH__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "base/intmath.hh"
+#include "base/misc.hh"
+#include "cpu/pred/table_storage.hh"
+
+namespace PackedCounters
+{
+
+/** log2 of the slot width, in bits, of an n-bit counter. */
+inline unsigned
+slotShift(unsigned bits)
+{
+    if (bits < 1 || bits > 8)
+        fatal("Saturating counters must have 1 to 8 bits.\n");
+    return ceilLog2(bits);
+}
+
+/** Value of the counter in slot 'slot' of 'word'. */
+template <class Word>
+inline unsigned
+read(Word word, unsigned slot, unsigned slot_shift, unsigned max)
+{
+    return (unsigned)(word >> (slot << slot_shift)) & max;
+}
+
+template <class Word>
+inline void
+increment(Word &word, unsigned slot, unsigned slot_shift, unsigned max)
+{
+    unsigned shift = slot << slot_shift;
+    if (((word >> shift) & max) < max)
+        word += (Word)1 << shift;
+}
+
+template <class Word>
+inline void
+decrement(Word &word, unsigned slot, unsigned slot_shift, unsigned max)
+{
+    unsigned shift = slot << slot_shift;
+    if ((word >> shift) & max)
+        word -= (Word)1 << shift;
+}
+
+template <class Word>
+inline void
+write(Word &word, unsigned slot, unsigned slot_shift, unsigned max,
+      unsigned val)
+{
+    unsigned shift = slot << slot_shift;
+    word = (word & ~((Word)max << shift)) | ((Word)(val & max) << shift);
+}
+
+} // namespace PackedCounters
+
+/** A table of n-bit saturating counters packed into 64-bit words. */
+class PackedCounterTable
+{
+  public:
+    PackedCounterTable()
+        : words(NULL), entries(0), ctrBits(0), slotShift(0), indexShift(0),
+          maxVal(0)
+    { }
+
+    /**
+     * Size the table for 'num_entries' counters of 'bits' bits, all 0,
+     * with 'huge_pages' on huge pages (see TableStorage).
+     */
+    void
+    init(size_t num_entries, unsigned bits, bool huge_pages = false)
+    {
+        entries = num_entries;
+        ctrBits = bits;
+        slotShift = PackedCounters::slotShift(bits);
+        indexShift = 6 - slotShift;
+        maxVal = (1 << bits) - 1;
+        storage.allocate(((entries + (1 << indexShift) - 1) >> indexShift) *
+                         sizeof(uint64_t), huge_pages);
+        words = static_cast<uint64_t *>(storage.data());
+    }
+
+    /** Set every counter back to 0, without touching the words. */
+    void reset() { storage.clear(); }
+
+    /** The packed words, dataBytes() bytes, e.g. for a snapshot. */
+    const void *data() const { return storage.data(); }
+    size_t dataBytes() const { return storage.size(); }
+
+    /**
+     * Take the counters from dataBytes() bytes of file 'fd' at 'offset'
+     * (page aligned), mapped copy-on-write.
+     */
+    void
+    mapFile(int fd, uint64_t offset)
+    {
+        storage.mapFile(fd, offset, storage.size());
+        words = static_cast<uint64_t *>(storage.data());
+    }
+
+    unsigned
+    read(size_t idx) const
+    {
+        return PackedCounters::read(words[idx >> indexShift], slot(idx),
+                                    slotShift, maxVal);
+    }
+
+    void
+    increment(size_t idx)
+    {
+        PackedCounters::increment(words[idx >> indexShift], slot(idx),
+                                  slotShift, maxVal);
+    }
+
+    void
+    decrement(size_t idx)
+    {
+        PackedCounters::decrement(words[idx >> indexShift], slot(idx),
+                                  slotShift, maxVal);
+    }
+
+    void
+    write(size_t idx, unsigned val)
+    {
+        PackedCounters::write(words[idx >> indexShift], slot(idx),
+                              slotShift, maxVal, val);
+    }
+
+    /** Start loading the word of counter 'idx' before it is trained. */
+    void
+    prefetch(size_t idx) const
+    {
+        __builtin_prefetch(&words[idx >> indexShift], 1);
+    }
+
+    size_t size() const { return entries; }
+    unsigned bits() const { return ctrBits; }
+
+    /** Bits of counter state modelled (entries times counter width). */
+    uint64_t storageBits() const { return (uint64_t)entries * ctrBits; }
+
+  private:
+    unsigned
+    slot(size_t idx) const
+    {
+        return idx & ((1 << indexShift) - 1);
+    }
+
+    TableStorage storage;
+    uint64_t *words;
+    size_t entries;
+    unsigned ctrBits;
+    /** log2 of the slot width in bits. */
+    unsigned slotShift;
+    /** log2 of the counters per word. */
+    unsigned indexShift;
+    unsigned maxVal;
+};
+
+#endif // __CPU_PRED_PACKED_COUNTERS_HH__
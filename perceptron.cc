@@ -0,0 +1,609 @@
+/* @file
+ * Implementation of a perceptron branch predictor
+ */
+
+#include "cpu/pred/perceptron.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "base/intmath.hh"
+#include "cpu/pred/bp_snapshot.hh"
+
+namespace
+{
+
+/**
+ * Weights saturate at +-127 rather than -128, so negating one (a -1
+ * history bit) never overflows.
+ */
+const int weightMax = 127;
+
+/** Weights per vector step; history lengths are a multiple of it. */
+const unsigned kernelWidth = 32;
+
+/*
+ * The kernels read the newest kernelWidth history bytes from 'head' and
+ * the rest from 'h' + kernelWidth. The hooks pass the ring for both;
+ * the batch replay keeps the newest outcomes in a buffer of their own,
+ * shifted a branch at a time with one full-width load and store,
+ * because a load from the ring would cover the byte the previous
+ * branch just stored, and a narrow store cannot be forwarded to a wide
+ * load.
+ */
+
+#if defined(__AVX2__)
+
+/** 'acc' plus the products of weights and history bytes, in int32
+ *  groups of four. */
+inline __m256i
+accumulate(__m256i acc, __m256i wv, __m256i hv)
+{
+    // h is +1, -1 or 0: negate or clear the weight
+    __m256i prod = _mm256_sign_epi8(wv, hv);
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    return _mm256_dpbusd_epi32(acc, _mm256_set1_epi8(1), prod);
+#else
+    // widen: pairs to int16, then pairs of those to int32
+    __m256i pairs = _mm256_maddubs_epi16(_mm256_set1_epi8(1), prod);
+    return _mm256_add_epi32(acc,
+                            _mm256_madd_epi16(pairs, _mm256_set1_epi16(1)));
+#endif
+}
+
+/** Sum of w[i] * h[i] over n (a multiple of 32) int8 pairs. */
+inline int
+dotProduct(const int8_t *w, const int8_t *head, const int8_t *h, unsigned n)
+{
+    __m256i acc = accumulate(_mm256_setzero_si256(),
+                             _mm256_loadu_si256((const __m256i *)w),
+                             _mm256_loadu_si256((const __m256i *)head));
+    for (unsigned i = kernelWidth; i < n; i += kernelWidth) {
+        __m256i wv = _mm256_loadu_si256((const __m256i *)(w + i));
+        __m256i hv = _mm256_loadu_si256((const __m256i *)(h + i));
+        acc = accumulate(acc, wv, hv);
+    }
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc),
+                                _mm256_extracti128_si256(acc, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+/** w[i] += h[i] (or -h[i]) over 32 weights, saturating at +-127. */
+inline void
+trainWeights(int8_t *w, __m256i hv, __m256i sign)
+{
+    __m256i wv = _mm256_loadu_si256((const __m256i *)w);
+    wv = _mm256_adds_epi8(wv, _mm256_sign_epi8(hv, sign));
+    _mm256_storeu_si256((__m256i *)w,
+                        _mm256_max_epi8(wv, _mm256_set1_epi8(-weightMax)));
+}
+
+/** w[i] += h[i] if taken, else -= h[i], saturating at +-127. */
+inline void
+trainRow(int8_t *w, const int8_t *head, const int8_t *h, unsigned n,
+         bool taken)
+{
+    // a sign rather than adds or subs by 'taken', which is a branch
+    const __m256i sign = _mm256_set1_epi8(taken ? 1 : -1);
+    trainWeights(w, _mm256_loadu_si256((const __m256i *)head), sign);
+    for (unsigned i = kernelWidth; i < n; i += kernelWidth)
+        trainWeights(w + i, _mm256_loadu_si256((const __m256i *)(h + i)),
+                     sign);
+}
+
+/** Shift 'outcome' in as head[0], dropping the oldest byte. */
+inline void
+pushHead(int8_t *head, int8_t outcome)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i *)head);
+    // alignr shifts within 128-bit lanes: the low lane takes the
+    // outcome as its carry and the high lane byte 15 of the low one
+    __m256i carry = _mm256_permute2x128_si256(
+        v, _mm256_set1_epi8(outcome), 0x02);
+    _mm256_storeu_si256((__m256i *)head,
+                        _mm256_alignr_epi8(v, carry, 15));
+}
+
+#elif defined(__SSE2__)
+
+/**
+ * 'acc' plus the sums, in its int64 halves, of the products of 16
+ * weights and history bytes, each biased by 128.
+ */
+inline __m128i
+accumulate(__m128i acc, __m128i wv, __m128i hv)
+{
+    // no byte sign or multiply before SSSE3: negate the weight where h
+    // is -1, as (w ^ -1) + 1, and clear it where h is 0
+    const __m128i zero = _mm_setzero_si128();
+    __m128i neg = _mm_cmpgt_epi8(zero, hv);
+    __m128i prod = _mm_sub_epi8(_mm_xor_si128(wv, neg), neg);
+    prod = _mm_andnot_si128(_mm_cmpeq_epi8(hv, zero), prod);
+    // psadbw sums unsigned bytes: the bias makes the products unsigned
+    prod = _mm_xor_si128(prod, _mm_set1_epi8(-128));
+    return _mm_add_epi64(acc, _mm_sad_epu8(prod, zero));
+}
+
+/** Sum of w[i] * h[i] over n (a multiple of 32) int8 pairs. */
+inline int
+dotProduct(const int8_t *w, const int8_t *head, const int8_t *h, unsigned n)
+{
+    __m128i acc = _mm_setzero_si128();
+    for (unsigned i = 0; i < kernelWidth; i += 16)
+        acc = accumulate(acc, _mm_loadu_si128((const __m128i *)(w + i)),
+                         _mm_loadu_si128((const __m128i *)(head + i)));
+    for (unsigned i = kernelWidth; i < n; i += 16)
+        acc = accumulate(acc, _mm_loadu_si128((const __m128i *)(w + i)),
+                         _mm_loadu_si128((const __m128i *)(h + i)));
+    acc = _mm_add_epi64(acc, _mm_shuffle_epi32(acc, 0x4e));
+    return _mm_cvtsi128_si32(acc) - 128 * (int)n;
+}
+
+/** w[i] += h[i] ^ neg - neg over 16 weights, saturating at +-127. */
+inline void
+trainWeights(int8_t *w, __m128i hv, __m128i neg)
+{
+    __m128i wv = _mm_loadu_si128((const __m128i *)w);
+    wv = _mm_adds_epi8(wv, _mm_sub_epi8(_mm_xor_si128(hv, neg), neg));
+    // no byte max before SSE4.1: lift -128 to -127 by subtracting the
+    // all-ones compare
+    wv = _mm_sub_epi8(wv, _mm_cmpeq_epi8(wv, _mm_set1_epi8(-weightMax - 1)));
+    _mm_storeu_si128((__m128i *)w, wv);
+}
+
+/** w[i] += h[i] if taken, else -= h[i], saturating at +-127. */
+inline void
+trainRow(int8_t *w, const int8_t *head, const int8_t *h, unsigned n,
+         bool taken)
+{
+    // -h as (h ^ -1) + 1, rather than adds or subs by 'taken', which
+    // is a branch
+    const __m128i neg = _mm_set1_epi8(taken ? 0 : -1);
+    for (unsigned i = 0; i < kernelWidth; i += 16)
+        trainWeights(w + i, _mm_loadu_si128((const __m128i *)(head + i)),
+                     neg);
+    for (unsigned i = kernelWidth; i < n; i += 16)
+        trainWeights(w + i, _mm_loadu_si128((const __m128i *)(h + i)),
+                     neg);
+}
+
+/** Shift 'outcome' in as head[0], dropping the oldest byte. */
+inline void
+pushHead(int8_t *head, int8_t outcome)
+{
+    __m128i low = _mm_loadu_si128((const __m128i *)head);
+    __m128i high = _mm_loadu_si128((const __m128i *)(head + 16));
+    high = _mm_or_si128(_mm_slli_si128(high, 1), _mm_srli_si128(low, 15));
+    low = _mm_or_si128(_mm_slli_si128(low, 1),
+                       _mm_cvtsi32_si128((uint8_t)outcome));
+    _mm_storeu_si128((__m128i *)head, low);
+    _mm_storeu_si128((__m128i *)(head + 16), high);
+}
+
+#else
+
+inline int
+dotProduct(const int8_t *w, const int8_t *head, const int8_t *h, unsigned n)
+{
+    int sum = 0;
+    for (unsigned i = 0; i < n; i++)
+        sum += w[i] * (i < kernelWidth ? head[i] : h[i]);
+    return sum;
+}
+
+inline void
+trainRow(int8_t *w, const int8_t *head, const int8_t *h, unsigned n,
+         bool taken)
+{
+    int sign = taken ? 1 : -1;
+    for (unsigned i = 0; i < n; i++) {
+        int v = w[i] + sign * (i < kernelWidth ? head[i] : h[i]);
+        w[i] = (int8_t)std::max(-weightMax, std::min(weightMax, v));
+    }
+}
+
+inline void
+pushHead(int8_t *head, int8_t outcome)
+{
+    std::memmove(head + 1, head, kernelWidth - 1);
+    head[0] = outcome;
+}
+
+#endif // __AVX2__ / __SSE2__
+
+/**
+ * Train row 'w' of n weights and its bias 'b', which gave 'output', on
+ * the outcome, unless the prediction was right and its magnitude beyond
+ * 'threshold'. Returns whether it trained.
+ */
+inline bool
+trainPerceptron(int8_t *w, int8_t &b, const int8_t *head, const int8_t *h,
+                unsigned n, int output, bool taken, int threshold)
+{
+    // the output signed toward the outcome, (output ^ -1) + 1 if not
+    // taken, is beyond the threshold just when the prediction was right
+    // and confident
+    int flip = (int)taken - 1;
+    if (((output ^ flip) - flip) > threshold)
+        return false;
+    trainRow(w, head, h, n, taken);
+    int v = b + 2 * (int)taken - 1;
+    b = (int8_t)std::max(-weightMax, std::min(weightMax, v));
+    return true;
+}
+
+} // anonymous namespace
+
+PerceptronBP::PerceptronBP(const Params *params)
+    : BPredUnit(params), numThreads(params->numThreads),
+      historyRing(params->numThreads,
+                  HistoryRing<BPHistory>(params->historyCheckpoints)),
+      threadHistory(params->numThreads),
+      instShiftAmt(params->instShiftAmt),
+      historyLength(params->perceptronHistoryLength),
+      tableSize(params->perceptronTableSize),
+      weights(NULL), biases(NULL)
+{
+    if (numThreads == 0)
+        fatal("PerceptronBP needs at least one thread.\n");
+    if (!historyLength || historyLength % kernelWidth)
+        fatal("Invalid perceptron history length, must be a multiple of "
+              "%u.\n", kernelWidth);
+    if (!isPowerOf2(tableSize))
+        fatal("Invalid perceptron table size.\n");
+
+    rowBits = ceilLog2(tableSize);
+    // the threshold of Jimenez and Lin, best for 8-bit weights
+    threshold = (int)(1.93 * historyLength + 14);
+
+    weightStorage.allocate((size_t)tableSize * (historyLength + 1),
+                           params->tableHugePages);
+    weights = static_cast<int8_t *>(weightStorage.data());
+    biases = weights + (size_t)tableSize * historyLength;
+
+    // the history read at commit must survive the branches fetched
+    // after it
+    ringSize = 1 << ceilLog2(historyLength + params->historyCheckpoints + 1);
+    ringMask = ringSize - 1;
+    for (unsigned tid = 0; tid < numThreads; tid++) {
+        threadHistory[tid].outcomes.assign(2 * ringSize, 0);
+        threadHistory[tid].pos = 0;
+    }
+
+    threadSalt.resize(numThreads, 0);
+    if (params->threadIndexSalt) {
+        for (ThreadID tid = 1; tid < (ThreadID)numThreads; tid++)
+            threadSalt[tid] = (unsigned)((tid * ULL(0x9e3779b97f4a7c15)) >>
+                                         32) & (tableSize - 1);
+    }
+
+    if (!params->branchTraceFile.empty())
+        traceCapture.reset(new BranchTraceCapture(params->branchTraceFile));
+
+    if (!params->mispredictProfile.empty())
+        profiler.reset(new MispredictProfiler(params->mispredictProfile,
+            params->profileEntries, params->profileTop,
+            std::vector<std::string>(1, "perceptron")));
+}
+
+void
+PerceptronBP::regStats()
+{
+    BPredUnit::regStats();
+
+    statDotProducts
+        .scalar(stats.dotProducts)
+        .name(name() + ".dotProducts")
+        .desc("Number of weight rows summed to predict a branch")
+        ;
+
+    statTrainings
+        .scalar(stats.trainings)
+        .name(name() + ".trainings")
+        .desc("Number of weight rows trained")
+        ;
+}
+
+uint64_t
+PerceptronBP::storageBits() const
+{
+    return (uint64_t)tableSize * (historyLength + 1) * 8 +
+        (uint64_t)numThreads * historyLength;
+}
+
+void
+PerceptronBP::reset()
+{
+    weightStorage.clear();
+    for (unsigned tid = 0; tid < numThreads; tid++) {
+        ThreadHistory &hist = threadHistory[tid];
+        std::fill(hist.outcomes.begin(), hist.outcomes.end(), 0);
+        hist.pos = 0;
+    }
+}
+
+/*
+ * Snapshot of the weights and the histories
+ */
+std::string
+PerceptronBP::snapshotConfig() const
+{
+    std::ostringstream os;
+    os << "perceptron perceptronTableSize=" << tableSize
+       << " perceptronHistoryLength=" << historyLength
+       << " historyRing=" << ringSize
+       << " instShiftAmt=" << instShiftAmt
+       << " numThreads=" << numThreads;
+    return os.str();
+}
+
+void
+PerceptronBP::saveSnapshot(const std::string &path) const
+{
+    std::vector<uint64_t> registers;
+    std::vector<int8_t> outcomes;
+    for (unsigned tid = 0; tid < numThreads; tid++) {
+        const ThreadHistory &hist = threadHistory[tid];
+        registers.push_back(hist.pos);
+        outcomes.insert(outcomes.end(), hist.outcomes.begin(),
+                        hist.outcomes.end());
+    }
+
+    BPSnapshotWriter writer(path, snapshotConfig());
+    writer.add("weights", weightStorage.data(), weightStorage.size());
+    writer.add("registers", &registers[0],
+               registers.size() * sizeof(registers[0]));
+    writer.add("history", &outcomes[0], outcomes.size());
+    writer.write();
+}
+
+void
+PerceptronBP::restoreSnapshot(const std::string &path)
+{
+    BPSnapshotReader reader(path, snapshotConfig());
+    std::vector<uint64_t> registers(numThreads);
+    reader.read("registers", &registers[0],
+                registers.size() * sizeof(registers[0]));
+    std::vector<int8_t> outcomes(numThreads * 2 * ringSize);
+    reader.read("history", &outcomes[0], outcomes.size());
+
+    weightStorage.mapFile(reader.descriptor(),
+                          reader.sectionOffset("weights",
+                                               weightStorage.size()),
+                          weightStorage.size());
+    weights = static_cast<int8_t *>(weightStorage.data());
+    biases = weights + (size_t)tableSize * historyLength;
+
+    for (unsigned tid = 0; tid < numThreads; tid++) {
+        ThreadHistory &hist = threadHistory[tid];
+        hist.pos = registers[tid] & ringMask;
+        std::copy(outcomes.begin() + tid * 2 * ringSize,
+                  outcomes.begin() + (tid + 1) * 2 * ringSize,
+                  hist.outcomes.begin());
+        // no branch is in flight across a snapshot
+        historyRing[tid].clear();
+    }
+}
+
+void
+PerceptronBP::serialize(std::ostream &os)
+{
+    std::string snapshot = name() + ".bpsnap";
+    saveSnapshot(Checkpoint::dir() + "/" + snapshot);
+    SERIALIZE_SCALAR(snapshot);
+}
+
+void
+PerceptronBP::unserialize(Checkpoint *cp, const std::string &section)
+{
+    std::string snapshot;
+    UNSERIALIZE_SCALAR(snapshot);
+    restoreSnapshot(cp->cptDir + "/" + snapshot);
+}
+
+/*
+ * Weights and history
+ */
+void
+PerceptronBP::pushHistory(ThreadHistory &hist, bool taken)
+{
+    hist.pos = (hist.pos - 1) & ringMask;
+    int8_t outcome = taken ? 1 : -1;
+    hist.outcomes[hist.pos] = outcome;
+    hist.outcomes[hist.pos + ringSize] = outcome;
+}
+
+unsigned
+PerceptronBP::rowIndex(Addr branch_addr, unsigned salt) const
+{
+    Addr pc = branch_addr >> instShiftAmt;
+    return (unsigned)(pc ^ (pc >> rowBits) ^ salt) & (tableSize - 1);
+}
+
+int
+PerceptronBP::output(unsigned row, const int8_t *head, const int8_t *hist)
+{
+    stats.dotProducts++;
+    return bias(row) + dotProduct(weightRow(row), head, hist,
+                                  historyLength);
+}
+
+void
+PerceptronBP::train(unsigned row, const int8_t *head, const int8_t *hist,
+                    int output, bool taken)
+{
+    stats.trainings += trainPerceptron(weightRow(row), bias(row), head,
+                                       hist, historyLength, output, taken,
+                                       threshold);
+}
+
+/*
+ * BPredUnit hooks
+ */
+void
+PerceptronBP::uncondBranch(ThreadID tid, Addr pc, void * &bp_history)
+{
+    ThreadHistory &hist = threadHistory[tid];
+    BPHistory *history = historyRing[tid].push(bp_history);
+    history->pos = hist.pos;
+    history->finalPred = true;
+    history->uncond = true;
+    pushHistory(hist, true);
+}
+
+bool
+PerceptronBP::lookup(ThreadID tid, Addr branch_addr, void * &bp_history)
+{
+    ThreadHistory &hist = threadHistory[tid];
+    BPHistory *history = historyRing[tid].push(bp_history);
+    history->pos = hist.pos;
+    history->row = rowIndex(branch_addr, threadSalt[tid]);
+    const int8_t *outcomes = &hist.outcomes[hist.pos];
+    history->output = output(history->row, outcomes, outcomes);
+    history->finalPred = history->output >= 0;
+    history->uncond = false;
+
+    // speculatively update the history with the prediction
+    pushHistory(hist, history->finalPred);
+    return history->finalPred;
+}
+
+void
+PerceptronBP::btbUpdate(ThreadID tid, Addr branch_addr, void * &bp_history)
+{
+    // the last outcome becomes not taken
+    ThreadHistory &hist = threadHistory[tid];
+    hist.outcomes[hist.pos] = -1;
+    hist.outcomes[hist.pos + ringSize] = -1;
+}
+
+void
+PerceptronBP::update(ThreadID tid, Addr branch_addr, bool taken,
+                     void *bp_history, bool squashed)
+{
+    if (!bp_history)
+        return;
+
+    ThreadHistory &hist = threadHistory[tid];
+    BPHistory &history = historyRing[tid].get(bp_history);
+    if (squashed) {
+        // mispredicted: repair the history with the outcome; the
+        // weights are trained once, at commit
+        hist.pos = history.pos;
+        pushHistory(hist, taken);
+        return;
+    }
+
+    if (!history.uncond) {
+        // the outcomes the prediction read are still in the ring
+        const int8_t *outcomes = &hist.outcomes[history.pos];
+        train(history.row, outcomes, outcomes, history.output, taken);
+        if (profiler)
+            profiler->record(branch_addr, history.finalPred != taken, 0);
+    }
+    // a trace holds one thread's branches, thread 0's
+    if (traceCapture && tid == 0)
+        traceCapture->record(branch_addr, taken, !history.uncond);
+    historyRing[tid].release(bp_history);
+}
+
+void
+PerceptronBP::squash(ThreadID tid, void *bp_history)
+{
+    threadHistory[tid].pos = historyRing[tid].get(bp_history).pos;
+    historyRing[tid].squash(bp_history);
+}
+
+/*
+ * Offline replay of committed branches: lookup()/uncondBranch(), the
+ * squashing update() of a mispredicted branch and the committing
+ * update(), folded together
+ */
+uint64_t
+PerceptronBP::predictBatch(const BranchRecord *recs, size_t count,
+                           uint64_t *pred_bits)
+{
+    // the profiling code is compiled out unless mispredictProfile is set
+    if (profiler)
+        return predictBatchRun<true>(recs, count, pred_bits);
+    return predictBatchRun<false>(recs, count, pred_bits);
+}
+
+template <bool Extended>
+uint64_t
+PerceptronBP::predictBatchRun(const BranchRecord *recs, size_t count,
+                              uint64_t *pred_bits)
+{
+    ThreadHistory &hist = threadHistory[0];
+    // members the loop reads are copied: every weight store is an
+    // int8_t, which may alias them, so they would be reloaded per branch
+    int8_t *const ring = &hist.outcomes[0];
+    const unsigned ring_size = ringSize;
+    const unsigned ring_mask = ringMask;
+    unsigned pos = hist.pos;
+    const unsigned shift = instShiftAmt;
+    const unsigned row_bits = rowBits;
+    const unsigned row_mask = tableSize - 1;
+    const unsigned length = historyLength;
+    const int limit = threshold;
+    int8_t *const rows = weights;
+    int8_t *const row_biases = biases;
+    uint64_t misses = 0;
+    uint64_t outputs = 0;
+    uint64_t trainings = 0;
+
+    alignas(32) int8_t head[kernelWidth];
+    std::copy(ring + pos, ring + pos + kernelWidth, head);
+
+    for (size_t i = 0; i < count; i++) {
+        const BranchRecord &rec = recs[i];
+        // bitwise: a branch on rec.taken would be a coin flip on random
+        // outcomes
+        bool taken = rec.taken | !rec.conditional;
+        int8_t outcome = 2 * taken - 1;
+        bool pred = true;
+        if (rec.conditional) {
+            // rowIndex() with a salt of 0
+            Addr pc = rec.pc >> shift;
+            unsigned row = (unsigned)(pc ^ (pc >> row_bits)) & row_mask;
+            int8_t *w = rows + (size_t)row * length;
+            int out = row_biases[row] +
+                dotProduct(w, head, ring + pos, length);
+            outputs++;
+            pred = out >= 0;
+            misses += pred != taken;
+            trainings += trainPerceptron(w, row_biases[row], head,
+                                         ring + pos, length, out, taken,
+                                         limit);
+            if (Extended && profiler)
+                profiler->record(rec.pc, pred != taken, 0);
+        }
+        if (pred_bits) {
+            uint64_t bit = ULL(1) << (i & 63);
+            pred_bits[i >> 6] = pred ? pred_bits[i >> 6] | bit :
+                                       pred_bits[i >> 6] & ~bit;
+        }
+        // either the prediction was right or the history was repaired,
+        // so the history always ends up holding the outcome; this is
+        // pushHistory() on the copies
+        pos = (pos - 1) & ring_mask;
+        ring[pos] = outcome;
+        ring[pos + ring_size] = outcome;
+        pushHead(head, outcome);
+    }
+
+    hist.pos = pos;
+    stats.dotProducts += outputs;
+    stats.trainings += trainings;
+    return misses;
+}
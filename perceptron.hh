@@ -0,0 +1,210 @@
+/* @file
+ * Header file for a perceptron branch predictor
+ *
+ * The perceptron predictor (Jimenez and Lin, "Dynamic branch
+ * prediction with perceptrons") keeps, for each row of its table, one
+ * signed weight per bit of global history and a bias weight. A branch
+ * selects a row by a hash of its PC, and is predicted taken if the bias
+ * plus the dot product of the weights with the history (+1 for a taken
+ * branch, -1 for a not-taken one) is not negative. At commit the row is
+ * trained, each weight moving toward agreement of its history bit with
+ * the outcome, if the prediction was wrong or its magnitude was within
+ * the training threshold. Unlike a counter table, its size grows
+ * linearly with the history length, so it can use histories far longer
+ * than gshare's index.
+ *
+ * Weights are int8 and the table has perceptronTableSize rows of
+ * perceptronHistoryLength weights (a multiple of 32). Each thread keeps
+ * its history as a ring of +1/-1 bytes written twice, so the last
+ * perceptronHistoryLength outcomes are always contiguous and line up
+ * with a row: the dot product and the training are 32 weights per
+ * instruction with AVX2 (build with -mavx2 or -march=native), 16 with
+ * SSE2, and a plain loop on hosts with neither; AVX-512 VNNI sums the
+ * products in one instruction. A history checkpoint is the ring
+ * position alone.
+ */
+
+#ifndef __CPU_PRED_PERCEPTRON_PRED_HH__
+#define __CPU_PRED_PERCEPTRON_PRED_HH__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/statistics.hh"
+#include "cpu/pred/bp_trace.hh"
+#include "cpu/pred/bp_trace_capture.hh"
+#include "cpu/pred/bpred_unit.hh"
+#include "cpu/pred/history_ring.hh"
+#include "cpu/pred/mispredict_profile.hh"
+#include "cpu/pred/table_storage.hh"
+
+/** Access counts of a PerceptronBP, for tuning and power models. */
+struct PerceptronStats
+{
+    PerceptronStats()
+        : dotProducts(0), trainings(0)
+    { }
+
+    /** Rows read and summed to predict a branch. */
+    uint64_t dotProducts;
+    /** Rows trained at commit. */
+    uint64_t trainings;
+};
+
+/*
+ * Each of the numThreads hardware threads has its own history and
+ * history checkpoints, while the weights are shared. With
+ * threadIndexSalt, every thread but thread 0 XORs a fixed salt into the
+ * row index.
+ */
+class PerceptronBP : public BPredUnit
+{
+  public:
+    PerceptronBP(const Params *params);
+    void uncondBranch(ThreadID tid, Addr pc, void * &bp_history);
+    void squash(ThreadID tid, void *bp_history);
+    bool lookup(ThreadID tid, Addr branch_addr, void * &bp_history);
+    void btbUpdate(ThreadID tid, Addr branch_addr, void * &bp_history);
+    void update(ThreadID tid, Addr branch_addr, bool taken, void *bp_history,
+                bool squashed);
+    void reset();
+
+    /**
+     * Predict and train on a run of committed branches of thread 0
+     * without going through the BPredUnit hooks; the weights end up
+     * exactly as after lookup()/uncondBranch() and update() for every
+     * record. Branches are not recorded to branchTraceFile.
+     * @param recs The branches, in program order.
+     * @param count Number of branches.
+     * @param pred_bits If not NULL, bit i of word i / 64 is set to the
+     * prediction for recs[i] (unconditional branches predict taken).
+     * @return The number of mispredicted conditional branches.
+     */
+    uint64_t predictBatch(const BranchRecord *recs, size_t count,
+                          uint64_t *pred_bits);
+
+    /**
+     * Write the weights and the histories to a snapshot file (see
+     * bp_snapshot.hh). No branch may be in flight.
+     */
+    void saveSnapshot(const std::string &path) const;
+
+    /**
+     * Restore the state saved by saveSnapshot() from a predictor with
+     * the same table parameters, mapping the weights copy-on-write.
+     */
+    void restoreSnapshot(const std::string &path);
+
+    /** Checkpointing: the tables go to a snapshot next to the
+     *  checkpoint, named in the checkpoint. */
+    void serialize(std::ostream &os);
+    void unserialize(Checkpoint *cp, const std::string &section);
+
+    /** Occupancy counts of a thread's history checkpoint ring. */
+    const HistoryRingStats &historyStats(ThreadID tid = 0) const
+    { return historyRing[tid].getStats(); }
+
+    /** Row access counts. */
+    const PerceptronStats &accessStats() const { return stats; }
+
+    /** Register accessStats() as gem5 statistics. */
+    void regStats();
+
+    /** Bits of predictor state: weights, biases and histories. */
+    uint64_t storageBits() const;
+
+  private:
+    struct BPHistory
+    {
+        /** Ring position of the thread's history before this branch. */
+        unsigned pos;
+        unsigned row;
+        /** Perceptron output; the prediction is output >= 0. */
+        int output;
+        bool finalPred;
+        /** True if the history belongs to an unconditional branch. */
+        bool uncond;
+    };
+
+    /**
+     * The history of one thread: the outcomes, +1 or -1 (0 before the
+     * first branches), newest first from outcomes[pos]. Each outcome is
+     * stored at pos and pos + ringSize so that historyLength of them
+     * are contiguous wherever pos is.
+     */
+    struct ThreadHistory
+    {
+        std::vector<int8_t> outcomes;
+        unsigned pos;
+    };
+
+    void pushHistory(ThreadHistory &hist, bool taken);
+
+    /** Row 'row' of the weights, and its bias. */
+    int8_t *weightRow(unsigned row)
+    { return weights + (size_t)row * historyLength; }
+    int8_t &bias(unsigned row) { return biases[row]; }
+
+    unsigned rowIndex(Addr branch_addr, unsigned salt) const;
+    /**
+     * Output of row 'row' for the history starting at 'hist', whose
+     * first 32 outcomes are read from 'head' instead (the same bytes,
+     * possibly in another buffer).
+     */
+    int output(unsigned row, const int8_t *head, const int8_t *hist);
+    /** Train row 'row', which gave 'output', on the outcome. */
+    void train(unsigned row, const int8_t *head, const int8_t *hist,
+               int output, bool taken);
+
+    /** predictBatch(), with or without mispredictProfile. */
+    template <bool Extended>
+    uint64_t predictBatchRun(const BranchRecord *recs, size_t count,
+                             uint64_t *pred_bits);
+
+    /** Parameters a snapshot must agree on, as a string. */
+    std::string snapshotConfig() const;
+
+    /** Number of hardware threads. */
+    unsigned numThreads;
+
+    /** Per thread, the checkpoints handed out as bp_history by lookup()
+     *  and uncondBranch(). */
+    std::vector<HistoryRing<BPHistory> > historyRing;
+    std::vector<ThreadHistory> threadHistory;
+    /** Outcomes a ring holds, a power of two, and that minus one. */
+    unsigned ringSize;
+    unsigned ringMask;
+
+    unsigned instShiftAmt;
+
+    /** Weights per row, the history length. */
+    unsigned historyLength;
+    unsigned tableSize;
+    unsigned rowBits;
+    /** Train a correct prediction whose output is within this. */
+    int threshold;
+
+    /** The rows, then the biases, all 0 initially. */
+    TableStorage weightStorage;
+    int8_t *weights;
+    int8_t *biases;
+
+    /** Per thread, the salt XORed into the row index (0 unless
+     *  threadIndexSalt is set). */
+    std::vector<unsigned> threadSalt;
+
+    /** Records committed branches if branchTraceFile is set. */
+    std::unique_ptr<BranchTraceCapture> traceCapture;
+    /** Profiles mispredicted branches if mispredictProfile is set. */
+    std::unique_ptr<MispredictProfiler> profiler;
+
+    PerceptronStats stats;
+
+    /** The counts of 'stats' as gem5 statistics. */
+    Stats::Value statDotProducts;
+    Stats::Value statTrainings;
+};
+
+#endif // __CPU_PRED_PERCEPTRON_PRED_HH__
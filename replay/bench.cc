@@ -0,0 +1,408 @@
+/* @file
+ * bp_bench: microbenchmarks of the predictor hot paths.
+ *
+ * Usage: bp_bench [--branches=N] [--repeat=N] [--sizes=L1,L2,...]
+ *                 [--ways=W1,W2,...] [--wrong-path=N] [--trace=FILE]
+ *                 [--filter=TEXT] [--format=csv|json]
+ *
+ * Every combination of predictor, table size, branch stream and mode
+ * is timed and reported as one row, in nanoseconds per branch:
+ *
+ *   predictor  gshare, gskew, yags with each of --ways
+ *              associativities, tage or perceptron
+ *   size       log2 of localPredictorSize (gshare), gskewBankSize
+ *              (gskew, whose three banks hold three times as many
+ *              counters), globalPredictorSize (yags), the tagged
+ *              entries (tage, tageTableSize in each default bank, the
+ *              bank count rounded up to a power of two) or the weights
+ *              (perceptron, perceptronTableSize rows of the default
+ *              history length), from --sizes; the defaults run from
+ *              L1-resident to DRAM-resident tables
+ *   stream     random (unpredictable outcomes of 4K static branches),
+ *              loop (nested loops of varying trip counts), correlated
+ *              (outcomes that are functions of the global history) and,
+ *              with --trace, the first --branches records of a trace
+ *   mode       batch: predictBatch(); hooks: lookup()/uncondBranch()
+ *              and update() per branch, as the CPU calls them; squash:
+ *              the hooks plus, on every misprediction, --wrong-path
+ *              wrong-path lookups that are squashed youngest first
+ *              before the mispredicted branch is updated; tage has
+ *              no predictBatch() and so no batch rows
+ *
+ * Each row is the fastest of --repeat runs, each on a new predictor;
+ * construction is not timed. --filter keeps the rows whose
+ * "predictor/size/stream/mode" name contains the given text. Results
+ * go to stdout as CSV (the default) or JSON.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "base/bitfield.hh"
+#include "branch_replay.hh"
+#include "cpu/pred/gshare.hh"
+#include "cpu/pred/gskew.hh"
+#include "cpu/pred/perceptron.hh"
+#include "cpu/pred/set_replacement.hh"
+#include "cpu/pred/yags.hh"
+#include "predictor_factory.hh"
+#include "trace_source.hh"
+
+namespace
+{
+
+struct BenchOptions
+{
+    BenchOptions()
+        : branches(2 * 1024 * 1024), repeat(3), wrongPath(8), json(false)
+    {
+        unsigned default_sizes[] = { 10, 14, 18, 22, 26 };
+        unsigned default_ways[] = { 1, 2, 4, 8 };
+        sizes.assign(default_sizes, default_sizes + 5);
+        ways.assign(default_ways, default_ways + 4);
+    }
+
+    uint64_t branches;
+    unsigned repeat;
+    unsigned wrongPath;
+    std::vector<unsigned> sizes;
+    std::vector<unsigned> ways;
+    std::string tracePath;
+    std::string filter;
+    bool json;
+};
+
+struct Stream
+{
+    std::string name;
+    std::vector<BranchRecord> recs;
+};
+
+BranchRecord
+makeRecord(Addr pc, bool taken, bool conditional)
+{
+    BranchRecord rec;
+    rec.pc = pc;
+    rec.instGap = 5;
+    rec.taken = taken;
+    rec.conditional = conditional;
+    return rec;
+}
+
+/** Random static branches with coin-flip outcomes, 1 in 10 unconditional. */
+void
+randomStream(uint64_t count, std::vector<BranchRecord> &recs)
+{
+    uint64_t rng = ULL(0x853c49e6748fea9b);
+    std::vector<Addr> pcs(4096);
+    for (size_t i = 0; i < pcs.size(); i++)
+        pcs[i] = 0x400000 + (SetReplacement::nextRandom(rng) & 0xffffc);
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t r = SetReplacement::nextRandom(rng);
+        recs.push_back(makeRecord(pcs[r % pcs.size()], (r >> 32) & 1,
+                                  (r >> 40) % 10 != 0));
+    }
+}
+
+/**
+ * 256 loops run in turn, each with a trip count of 2 to 64, a loop
+ * branch taken on all but the last iteration and a body branch taken on
+ * alternate iterations.
+ */
+void
+loopStream(uint64_t count, std::vector<BranchRecord> &recs)
+{
+    uint64_t rng = ULL(0xda3e39cb94b95bdb);
+    std::vector<unsigned> trips(256);
+    for (size_t i = 0; i < trips.size(); i++)
+        trips[i] = 2 + SetReplacement::nextRandom(rng) % 63;
+    for (unsigned loop = 0; recs.size() < count;
+         loop = (loop + 1) % trips.size()) {
+        Addr base = 0x500000 + loop * 0x100;
+        for (unsigned i = 0; i < trips[loop] && recs.size() < count; i++) {
+            recs.push_back(makeRecord(base + 0x10, i & 1, true));
+            if (recs.size() < count)
+                recs.push_back(makeRecord(base + 0x40, i + 1 < trips[loop],
+                                          true));
+        }
+        if (recs.size() < count)
+            recs.push_back(makeRecord(base + 0x80, true, false));
+    }
+}
+
+/**
+ * 1024 static branches whose outcome is the parity of the last one to
+ * eight outcomes, flipped per branch: learnable from global history.
+ */
+void
+correlatedStream(uint64_t count, std::vector<BranchRecord> &recs)
+{
+    uint64_t rng = ULL(0x2545f4914f6cdd1d);
+    uint64_t history = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        unsigned branch = SetReplacement::nextRandom(rng) % 1024;
+        unsigned depth = 1 + branch % 8;
+        bool taken = (popCount(history & mask(depth)) +
+                      (branch >> 3)) & 1;
+        recs.push_back(makeRecord(0x600000 + branch * 4, taken, true));
+        history = (history << 1) | taken;
+    }
+}
+
+/** Replay through the hooks with wrong-path branches squashed. */
+uint64_t
+replaySquash(BPredUnit &bp, const BranchRecord *recs, size_t count,
+             unsigned wrong_path)
+{
+    std::vector<void *> wrong(wrong_path);
+    uint64_t misses = 0;
+    for (size_t i = 0; i < count; i++) {
+        const BranchRecord &rec = recs[i];
+        void *bp_history = NULL;
+        if (!rec.conditional) {
+            bp.uncondBranch(0, rec.pc, bp_history);
+            bp.update(0, rec.pc, true, bp_history, false);
+            continue;
+        }
+        if (bp.lookup(0, rec.pc, bp_history) != rec.taken) {
+            misses++;
+            // fetch runs down the wrong path until the branch executes
+            for (unsigned w = 0; w < wrong_path; w++)
+                bp.lookup(0, rec.pc + 4 * (w + 1), wrong[w]);
+            for (unsigned w = wrong_path; w-- > 0; )
+                bp.squash(0, wrong[w]);
+            bp.update(0, rec.pc, rec.taken, bp_history, true);
+        }
+        bp.update(0, rec.pc, rec.taken, bp_history, false);
+    }
+    return misses;
+}
+
+/** Time one mode on a new predictor; returns seconds, sets 'misses'. */
+double
+runOnce(const PredictorConfig &config, const std::string &mode,
+        const Stream &stream, unsigned wrong_path, uint64_t &misses)
+{
+    std::unique_ptr<BPredUnit> bp(config.create());
+    const BranchRecord *recs = &stream.recs[0];
+    size_t count = stream.recs.size();
+
+    auto start = std::chrono::steady_clock::now();
+    if (mode == "batch") {
+        // TageBP has no predictBatch(); main() times it by hooks only
+        if (GshareBP *gshare = dynamic_cast<GshareBP *>(bp.get()))
+            misses = gshare->predictBatch(recs, count, NULL);
+        else if (GskewBP *gskew = dynamic_cast<GskewBP *>(bp.get()))
+            misses = gskew->predictBatch(recs, count, NULL);
+        else if (PerceptronBP *perceptron =
+                 dynamic_cast<PerceptronBP *>(bp.get()))
+            misses = perceptron->predictBatch(recs, count, NULL);
+        else
+            misses = dynamic_cast<YagsBP &>(*bp).predictBatch(recs, count,
+                                                              NULL);
+    } else if (mode == "hooks") {
+        BranchReplay replay(*bp);
+        replay.replay(recs, count);
+        misses = replay.getResults().mispredicts;
+    } else {
+        misses = replaySquash(*bp, recs, count, wrong_path);
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+std::vector<unsigned>
+parseList(const std::string &list)
+{
+    std::vector<unsigned> values;
+    std::istringstream is(list);
+    std::string value;
+    while (std::getline(is, value, ','))
+        values.push_back(std::strtoul(value.c_str(), NULL, 0));
+    return values;
+}
+
+void
+usage(const char *prog)
+{
+    std::fprintf(stderr,
+                 "usage: %s [--branches=N] [--repeat=N] [--sizes=L1,...] "
+                 "[--ways=W1,...]\n"
+                 "       [--wrong-path=N] [--trace=FILE] [--filter=TEXT] "
+                 "[--format=csv|json]\n", prog);
+    std::exit(2);
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char **argv)
+{
+    BenchOptions opts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 11, "--branches=") == 0)
+            opts.branches = std::strtoull(arg.c_str() + 11, NULL, 0);
+        else if (arg.compare(0, 9, "--repeat=") == 0)
+            opts.repeat = std::strtoul(arg.c_str() + 9, NULL, 0);
+        else if (arg.compare(0, 8, "--sizes=") == 0)
+            opts.sizes = parseList(arg.substr(8));
+        else if (arg.compare(0, 7, "--ways=") == 0)
+            opts.ways = parseList(arg.substr(7));
+        else if (arg.compare(0, 13, "--wrong-path=") == 0)
+            opts.wrongPath = std::strtoul(arg.c_str() + 13, NULL, 0);
+        else if (arg.compare(0, 8, "--trace=") == 0)
+            opts.tracePath = arg.substr(8);
+        else if (arg.compare(0, 9, "--filter=") == 0)
+            opts.filter = arg.substr(9);
+        else if (arg == "--format=json")
+            opts.json = true;
+        else if (arg == "--format=csv")
+            opts.json = false;
+        else
+            usage(argv[0]);
+    }
+    if (!opts.branches || !opts.repeat)
+        usage(argv[0]);
+
+    std::vector<Stream> streams(3);
+    streams[0].name = "random";
+    randomStream(opts.branches, streams[0].recs);
+    streams[1].name = "loop";
+    loopStream(opts.branches, streams[1].recs);
+    streams[2].name = "correlated";
+    correlatedStream(opts.branches, streams[2].recs);
+    if (!opts.tracePath.empty()) {
+        Stream trace;
+        trace.name = "trace";
+        trace.recs.resize(opts.branches);
+        std::unique_ptr<TraceSource> source = openTrace(opts.tracePath);
+        size_t got = 0;
+        size_t n;
+        while (got < trace.recs.size() &&
+               (n = source->read(&trace.recs[got],
+                                 trace.recs.size() - got)) != 0)
+            got += n;
+        if (!got)
+            fatal("Trace '%s' is empty.\n", opts.tracePath.c_str());
+        trace.recs.resize(got);
+        streams.push_back(trace);
+    }
+
+    // (predictor name, configuration) pairs
+    std::vector<std::pair<std::string, PredictorConfig> > predictors;
+    for (size_t s = 0; s < opts.sizes.size(); s++) {
+        std::ostringstream size;
+        size << (1ULL << opts.sizes[s]);
+        PredictorConfig gshare;
+        gshare.set("localPredictorSize=" + size.str());
+        predictors.push_back(std::make_pair("gshare", gshare));
+        PredictorConfig gskew;
+        gskew.set("predType=gskew");
+        gskew.set("gskewBankSize=" + size.str());
+        predictors.push_back(std::make_pair("gskew", gskew));
+        for (size_t w = 0; w < opts.ways.size(); w++) {
+            std::ostringstream ways;
+            ways << opts.ways[w];
+            PredictorConfig yags;
+            yags.set("predType=yags");
+            yags.set("globalPredictorSize=" + size.str());
+            yags.set("yagsAssociativity=" + ways.str());
+            predictors.push_back(std::make_pair("yags" + ways.str(), yags));
+        }
+        PredictorConfig tage;
+        tage.set("predType=tage");
+        std::ostringstream entries;
+        entries << std::max(1ULL << opts.sizes[s] >>
+                            ceilLog2(tage.params.tageTables), 2ULL);
+        tage.set("tageTableSize=" + entries.str());
+        predictors.push_back(std::make_pair("tage", tage));
+        PredictorConfig perceptron;
+        perceptron.set("predType=perceptron");
+        std::ostringstream rows;
+        rows << std::max(1ULL << opts.sizes[s] >>
+                         ceilLog2(perceptron.params.perceptronHistoryLength),
+                         1ULL);
+        perceptron.set("perceptronTableSize=" + rows.str());
+        predictors.push_back(std::make_pair("perceptron", perceptron));
+    }
+
+    const char *modes[] = { "batch", "hooks", "squash" };
+    bool first = true;
+    if (opts.json)
+        std::printf("[\n");
+    else
+        std::printf("predictor,log2_size,stream,mode,branches,mispredicts,"
+                    "ns_per_branch\n");
+
+    for (size_t p = 0; p < predictors.size(); p++) {
+        const PredictorConfig &config = predictors[p].second;
+        unsigned log2_size;
+        if (config.predType == "gshare")
+            log2_size = ceilLog2(config.params.localPredictorSize);
+        else if (config.predType == "gskew")
+            log2_size = ceilLog2(config.params.gskewBankSize);
+        else if (config.predType == "tage")
+            log2_size = ceilLog2(config.params.tageTableSize) +
+                ceilLog2(config.params.tageTables);
+        else if (config.predType == "perceptron")
+            log2_size = ceilLog2(config.params.perceptronTableSize *
+                                 config.params.perceptronHistoryLength);
+        else
+            log2_size = ceilLog2(config.params.globalPredictorSize);
+        for (size_t s = 0; s < streams.size(); s++) {
+            for (unsigned m = 0; m < 3; m++) {
+                if (config.predType == "tage" && m == 0)
+                    continue;
+                std::ostringstream name;
+                name << predictors[p].first << "/" << log2_size << "/"
+                     << streams[s].name << "/" << modes[m];
+                if (name.str().find(opts.filter) == std::string::npos)
+                    continue;
+
+                double best = 0;
+                uint64_t misses = 0;
+                for (unsigned r = 0; r < opts.repeat; r++) {
+                    double secs = runOnce(config, modes[m], streams[s],
+                                          opts.wrongPath, misses);
+                    if (r == 0 || secs < best)
+                        best = secs;
+                }
+                double ns = best * 1e9 / streams[s].recs.size();
+
+                if (opts.json) {
+                    std::printf("%s  {\"predictor\": \"%s\", "
+                                "\"log2_size\": %u, \"stream\": \"%s\", "
+                                "\"mode\": \"%s\", \"branches\": %zu, "
+                                "\"mispredicts\": %llu, "
+                                "\"ns_per_branch\": %.3f}",
+                                first ? "" : ",\n",
+                                predictors[p].first.c_str(), log2_size,
+                                streams[s].name.c_str(), modes[m],
+                                streams[s].recs.size(),
+                                (unsigned long long)misses, ns);
+                } else {
+                    std::printf("%s,%u,%s,%s,%zu,%llu,%.3f\n",
+                                predictors[p].first.c_str(), log2_size,
+                                streams[s].name.c_str(), modes[m],
+                                streams[s].recs.size(),
+                                (unsigned long long)misses, ns);
+                }
+                std::fflush(stdout);
+                first = false;
+            }
+        }
+    }
+    if (opts.json)
+        std::printf("%s]\n", first ? "" : "\n");
+
+    return 0;
+}
@@ -0,0 +1,274 @@
+/* @file
+ * bp_replay: replay a branch trace through GshareBP, GskewBP, YagsBP,
+ * TageBP or PerceptronBP without running gem5, and report
+ * mispredictions and MPKI.
+ *
+ * Usage: bp_replay [name=value ...] [--skip=N] [--limit=N] [--hooks]
+ *                  [--restore=SNAPSHOT] [--save=SNAPSHOT] [--stats]
+ *                  <trace> [<trace> ...]
+ *
+ * The options are the BranchPredictor parameters read by the predictors
+ * (localPredictorSize=..., choiceCtrBits=..., ...) plus
+ * predType=gshare|gskew|yags|tage|perceptron. --skip and --limit select
+ * a window of the trace; binary traces seek to the window through their
+ * block index. Replay goes through the predictor's predictBatch()
+ * unless --hooks asks for the lookup()/update() sequence of the CPU
+ * (TageBP has no predictBatch() and always replays through the hooks).
+ * --restore starts from the predictor state of a snapshot and --save
+ * writes the state at the end of the replay to one (see
+ * bp_snapshot.hh). --stats appends the predictor's statistics, as gem5
+ * would dump them.
+ *
+ * Several traces are replayed as the hardware threads of an SMT core,
+ * trace i as thread i, one branch of each thread in turn through the
+ * hooks; numThreads must be at least the number of traces. --skip and
+ * --limit then apply to each trace, and the report adds the
+ * mispredictions of each thread.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/statistics.hh"
+#include "branch_replay.hh"
+#include "cpu/pred/gshare.hh"
+#include "cpu/pred/gskew.hh"
+#include "cpu/pred/perceptron.hh"
+#include "cpu/pred/tage.hh"
+#include "cpu/pred/yags.hh"
+#include "predictor_factory.hh"
+#include "trace_source.hh"
+
+namespace
+{
+
+void
+usage(const char *prog)
+{
+    std::fprintf(stderr,
+                 "usage: %s [predType=gshare|gskew|yags|tage|perceptron] "
+                 "[param=value ...] [--skip=N] [--limit=N] [--hooks]\n"
+                 "       [--restore=SNAPSHOT] [--save=SNAPSHOT] [--stats] "
+                 "<trace> [<trace> ...]\n",
+                 prog);
+    std::exit(2);
+}
+
+/** Feed up to 'limit' branches of 'trace' to 'replay'; returns seconds. */
+template <class Replay>
+double
+runReplay(Replay &replay, TraceSource &trace, uint64_t limit)
+{
+    std::vector<BranchRecord> chunk(64 * 1024);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t n;
+    while (limit &&
+           (n = trace.read(&chunk[0],
+                           std::min<uint64_t>(limit, chunk.size()))) != 0) {
+        replay.replay(&chunk[0], n);
+        limit -= n;
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+/**
+ * Replay up to 'limit' branches of each trace as one thread each,
+ * interleaved a branch at a time; returns seconds.
+ */
+double
+runThreads(std::vector<BranchReplay> &replays,
+           std::vector<std::unique_ptr<TraceSource> > &traces,
+           uint64_t limit)
+{
+    size_t threads = traces.size();
+    std::vector<std::vector<BranchRecord> > chunks(threads);
+    std::vector<size_t> counts(threads);
+
+    auto start = std::chrono::steady_clock::now();
+    while (limit) {
+        size_t want = std::min<uint64_t>(limit, 64 * 1024);
+        size_t longest = 0;
+        for (size_t t = 0; t < threads; t++) {
+            chunks[t].resize(want);
+            counts[t] = traces[t]->read(&chunks[t][0], want);
+            longest = std::max(longest, counts[t]);
+        }
+        if (!longest)
+            break;
+        for (size_t i = 0; i < longest; i++) {
+            for (size_t t = 0; t < threads; t++) {
+                if (i < counts[t])
+                    replays[t].replay(chunks[t][i]);
+            }
+        }
+        limit -= longest;
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char **argv)
+{
+    PredictorConfig config;
+    std::vector<std::string> trace_paths;
+    uint64_t skip = 0;
+    uint64_t limit = UINT64_MAX;
+    bool hooks = false;
+    bool stats = false;
+    std::string restore_path;
+    std::string save_path;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 7, "--skip=") == 0) {
+            skip = std::strtoull(arg.c_str() + 7, NULL, 0);
+        } else if (arg.compare(0, 8, "--limit=") == 0) {
+            limit = std::strtoull(arg.c_str() + 8, NULL, 0);
+        } else if (arg == "--hooks") {
+            hooks = true;
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg.compare(0, 10, "--restore=") == 0) {
+            restore_path = arg.substr(10);
+        } else if (arg.compare(0, 7, "--save=") == 0) {
+            save_path = arg.substr(7);
+        } else if (arg.find('=') != std::string::npos) {
+            if (!config.set(arg))
+                fatal("Unknown parameter '%s'.\n", arg.c_str());
+        } else if (arg.compare(0, 2, "--") != 0) {
+            trace_paths.push_back(arg);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (trace_paths.empty())
+        usage(argv[0]);
+    if (trace_paths.size() > config.params.numThreads)
+        fatal("%zu traces need numThreads=%zu.\n", trace_paths.size(),
+              trace_paths.size());
+
+    std::unique_ptr<BPredUnit> bp(config.create());
+    bp->regStats();
+    std::vector<std::unique_ptr<TraceSource> > traces;
+    for (size_t t = 0; t < trace_paths.size(); t++) {
+        traces.push_back(openTrace(trace_paths[t]));
+        traces[t]->skip(skip);
+    }
+    TraceSource &trace = *traces[0];
+    GshareBP *gshare = dynamic_cast<GshareBP *>(bp.get());
+    GskewBP *gskew = dynamic_cast<GskewBP *>(bp.get());
+    YagsBP *yags = dynamic_cast<YagsBP *>(bp.get());
+    TageBP *tage = dynamic_cast<TageBP *>(bp.get());
+    PerceptronBP *perceptron = dynamic_cast<PerceptronBP *>(bp.get());
+    ReplayResults res;
+    std::vector<ReplayResults> thread_res;
+    double secs;
+
+    if (!restore_path.empty()) {
+        if (gshare)
+            gshare->restoreSnapshot(restore_path);
+        else if (gskew)
+            gskew->restoreSnapshot(restore_path);
+        else if (yags)
+            yags->restoreSnapshot(restore_path);
+        else if (tage)
+            tage->restoreSnapshot(restore_path);
+        else if (perceptron)
+            perceptron->restoreSnapshot(restore_path);
+        else
+            fatal("predType=%s has no snapshots.\n", config.predType.c_str());
+    }
+
+    if (traces.size() > 1) {
+        std::vector<BranchReplay> replays;
+        for (size_t t = 0; t < traces.size(); t++)
+            replays.push_back(BranchReplay(*bp, t));
+        secs = runThreads(replays, traces, limit);
+        for (size_t t = 0; t < replays.size(); t++) {
+            const ReplayResults &r = replays[t].getResults();
+            thread_res.push_back(r);
+            res.branches += r.branches;
+            res.condBranches += r.condBranches;
+            res.mispredicts += r.mispredicts;
+            res.instructions += r.instructions;
+        }
+    } else if (!hooks && gshare) {
+        BatchReplay<GshareBP> replay(*gshare);
+        secs = runReplay(replay, trace, limit);
+        res = replay.getResults();
+    } else if (!hooks && gskew) {
+        BatchReplay<GskewBP> replay(*gskew);
+        secs = runReplay(replay, trace, limit);
+        res = replay.getResults();
+    } else if (!hooks && yags) {
+        BatchReplay<YagsBP> replay(*yags);
+        secs = runReplay(replay, trace, limit);
+        res = replay.getResults();
+    } else if (!hooks && perceptron) {
+        BatchReplay<PerceptronBP> replay(*perceptron);
+        secs = runReplay(replay, trace, limit);
+        res = replay.getResults();
+    } else {
+        BranchReplay replay(*bp);
+        secs = runReplay(replay, trace, limit);
+        res = replay.getResults();
+    }
+
+    if (!save_path.empty()) {
+        if (gshare)
+            gshare->saveSnapshot(save_path);
+        else if (gskew)
+            gskew->saveSnapshot(save_path);
+        else if (yags)
+            yags->saveSnapshot(save_path);
+        else if (tage)
+            tage->saveSnapshot(save_path);
+        else if (perceptron)
+            perceptron->saveSnapshot(save_path);
+        else
+            fatal("predType=%s has no snapshots.\n", config.predType.c_str());
+    }
+
+    std::printf("config          %s\n", config.describe().c_str());
+    std::printf("branches        %llu\n", (unsigned long long)res.branches);
+    std::printf("cond_branches   %llu\n",
+                (unsigned long long)res.condBranches);
+    std::printf("mispredicts     %llu\n",
+                (unsigned long long)res.mispredicts);
+    std::printf("instructions    %llu\n",
+                (unsigned long long)res.instructions);
+    std::printf("miss_rate       %.4f\n", res.missRate());
+    if (res.instructions || !res.branches)
+        std::printf("mpki            %.4f\n", res.mpki());
+    else
+        std::printf("mpki            n/a (the trace has no instruction "
+                    "counts, as traces captured by a predictor)\n");
+    std::printf("seconds         %.3f\n", secs);
+    std::printf("branches_per_s  %.0f\n", secs > 0 ? res.branches / secs : 0);
+    for (size_t t = 0; t < thread_res.size(); t++) {
+        std::printf("thread%zu_mispredicts %llu\n", t,
+                    (unsigned long long)thread_res[t].mispredicts);
+        std::printf("thread%zu_miss_rate   %.4f\n", t,
+                    thread_res[t].missRate());
+    }
+
+    if (stats) {
+        std::fflush(stdout);
+        Stats::dump(std::cout);
+    }
+
+    return 0;
+}
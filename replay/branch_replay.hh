@@ -0,0 +1,136 @@
+/* @file
+ * Trace-driven replay of a direction predictor outside gem5.
+ *
+ * BranchReplay drives the BPredUnit hooks of a predictor in the same
+ * order the O3 CPU does for a correct-path branch stream: lookup() or
+ * uncondBranch() at fetch, update(..., true) when a misprediction is
+ * detected, and update(..., false) at commit. Since a trace only holds
+ * committed branches, every branch resolves before the next one is
+ * fetched and squash() is never needed. Each BranchReplay drives one
+ * hardware thread, so several of them on one predictor, fed in turn,
+ * replay an SMT workload.
+ *
+ * BatchReplay gives the same results through a predictor's
+ * predictBatch(), which folds that call sequence into one loop.
+ */
+
+#ifndef __REPLAY_BRANCH_REPLAY_HH__
+#define __REPLAY_BRANCH_REPLAY_HH__
+
+#include <cstdint>
+#include <vector>
+
+#include "cpu/pred/bp_trace.hh"
+#include "cpu/pred/bpred_unit.hh"
+
+/** Counts accumulated over one replay. */
+struct ReplayResults
+{
+    ReplayResults()
+        : branches(0), condBranches(0), mispredicts(0), instructions(0)
+    { }
+
+    /** Mispredictions per thousand instructions, 0 if unknown. */
+    double
+    mpki() const
+    {
+        return instructions ? 1000.0 * mispredicts / instructions : 0.0;
+    }
+
+    /** Fraction of conditional branches mispredicted. */
+    double
+    missRate() const
+    {
+        return condBranches ? (double)mispredicts / condBranches : 0.0;
+    }
+
+    uint64_t branches;
+    uint64_t condBranches;
+    uint64_t mispredicts;
+    uint64_t instructions;
+};
+
+class BranchReplay
+{
+  public:
+    BranchReplay(BPredUnit &bp, ThreadID tid = 0)
+        : bp(bp), tid(tid)
+    { }
+
+    /** Feed one committed branch through the predictor. */
+    void
+    replay(const BranchRecord &rec)
+    {
+        void *bp_history = NULL;
+
+        results.branches++;
+        results.instructions += rec.instGap;
+
+        if (rec.conditional) {
+            results.condBranches++;
+            bool pred = bp.lookup(tid, rec.pc, bp_history);
+            if (pred != rec.taken) {
+                // Misprediction detected at execute: the unit restores
+                // its history with the actual outcome.
+                results.mispredicts++;
+                bp.update(tid, rec.pc, rec.taken, bp_history, true);
+            }
+        } else {
+            bp.uncondBranch(tid, rec.pc, bp_history);
+        }
+
+        // Commit.
+        bp.update(tid, rec.pc, rec.conditional ? rec.taken : true,
+                  bp_history, false);
+    }
+
+    /** Feed a run of records. */
+    void
+    replay(const BranchRecord *recs, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+            replay(recs[i]);
+    }
+
+    const ReplayResults &getResults() const { return results; }
+
+  private:
+    BPredUnit &bp;
+    ThreadID tid;
+    ReplayResults results;
+};
+
+/** Replay through Predictor::predictBatch() instead of the hooks. */
+template <class Predictor>
+class BatchReplay
+{
+  public:
+    BatchReplay(Predictor &bp)
+        : bp(bp)
+    { }
+
+    /** Feed a run of records. */
+    void
+    replay(const BranchRecord *recs, size_t count)
+    {
+        predBits.resize((count + 63) / 64);
+        results.mispredicts += bp.predictBatch(recs, count, &predBits[0]);
+        results.branches += count;
+        for (size_t i = 0; i < count; i++) {
+            results.condBranches += recs[i].conditional;
+            results.instructions += recs[i].instGap;
+        }
+    }
+
+    const ReplayResults &getResults() const { return results; }
+
+    /** Predictions of the last run, one bit per record. */
+    const std::vector<uint64_t> &predictions() const { return predBits; }
+
+  private:
+    Predictor &bp;
+    ReplayResults results;
+    std::vector<uint64_t> predBits;
+};
+
+#endif // __REPLAY_BRANCH_REPLAY_HH__
@@ -0,0 +1,189 @@
+/* @file
+ * Reader for the BT9 traces of the 2016 Championship Branch Prediction.
+ */
+
+#include "bt9_trace.hh"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "base/misc.hh"
+
+const char *const Bt9TraceReader::magic = "BT9_SPA_TRACE_FORMAT";
+
+namespace
+{
+
+/** The next whitespace-separated field of 'p', NUL-terminated, or NULL. */
+char *
+nextField(char *&p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r')
+        p++;
+    if (!*p)
+        return NULL;
+    char *field = p;
+    while (*p && *p != ' ' && *p != '\t' && *p != '\r')
+        p++;
+    if (*p)
+        *p++ = '\0';
+    return field;
+}
+
+/** Parse 'field' as an unsigned number in 'base', false if it is not. */
+bool
+parseNumber(const char *field, int base, uint64_t &value)
+{
+    if (!field)
+        return false;
+    char *end;
+    value = std::strtoull(field, &end, base);
+    return end != field && *end == '\0';
+}
+
+} // anonymous namespace
+
+Bt9TraceReader::Bt9TraceReader(const std::string &path)
+    : lines(path), pending(0), ended(false)
+{
+    enum { Magic, Header, Nodes, Edges } section = Magic;
+    char *line;
+
+    while ((line = lines.next())) {
+        char *p = line;
+        char *key = nextField(p);
+        if (!key || *key == '#')
+            continue;
+
+        if (section == Magic) {
+            if (std::strcmp(key, magic) != 0)
+                fatal("'%s' is not a BT9 trace.\n", path.c_str());
+            section = Header;
+        } else if (std::strcmp(key, "BT9_NODES") == 0) {
+            section = Nodes;
+        } else if (std::strcmp(key, "BT9_EDGES") == 0) {
+            section = Edges;
+        } else if (std::strcmp(key, "BT9_EDGE_SEQUENCE") == 0) {
+            return;
+        } else if (section == Nodes) {
+            if (std::strcmp(key, "NODE") != 0)
+                malformed();
+            readNode(p);
+        } else if (section == Edges) {
+            if (std::strcmp(key, "EDGE") != 0)
+                malformed();
+            readEdge(p);
+        }
+    }
+    fatal("BT9 trace '%s' has no edge sequence.\n", path.c_str());
+}
+
+void
+Bt9TraceReader::malformed()
+{
+    fatal("Malformed BT9 trace line %llu.\n",
+          (unsigned long long)lines.lineNumber());
+}
+
+void
+Bt9TraceReader::readNode(char *p)
+{
+    // NODE <id> <vaddr> <paddr> <opcode> <size> [class: <class> ...]
+    uint64_t id, pc;
+    if (!parseNumber(nextField(p), 10, id) ||
+        !parseNumber(nextField(p), 0, pc))
+        malformed();
+    for (unsigned i = 0; i < 3; i++) {
+        if (!nextField(p))
+            malformed();
+    }
+
+    Node node;
+    node.pc = pc;
+    node.conditional = false;
+    node.dummy = true;
+    char *field;
+    while ((field = nextField(p))) {
+        if (std::strcmp(field, "class:") == 0) {
+            char *cls = nextField(p);
+            if (!cls)
+                malformed();
+            node.conditional = std::strstr(cls, "CND") != NULL;
+            node.dummy = false;
+            break;
+        }
+    }
+
+    if (id >= nodes.size()) {
+        Node missing = { 0, false, true };
+        nodes.resize(id + 1, missing);
+    }
+    nodes[id] = node;
+}
+
+void
+Bt9TraceReader::readEdge(char *p)
+{
+    // EDGE <id> <src> <dest> <T|N> <vaddr> <paddr> <inst_cnt> ...
+    uint64_t id, src, dest, count;
+    if (!parseNumber(nextField(p), 10, id) ||
+        !parseNumber(nextField(p), 10, src) ||
+        !parseNumber(nextField(p), 10, dest))
+        malformed();
+    char *dir = nextField(p);
+    if (!dir || (std::strcmp(dir, "T") != 0 && std::strcmp(dir, "N") != 0))
+        malformed();
+    if (!nextField(p) || !nextField(p) ||
+        !parseNumber(nextField(p), 10, count))
+        malformed();
+    if (src >= nodes.size())
+        malformed();
+
+    Edge edge;
+    edge.src = src;
+    edge.taken = *dir == 'T';
+    edge.instCount = count;
+
+    if (id >= edges.size()) {
+        // a source past every node marks ids missing from the table
+        Edge missing = { UINT32_MAX, false, 0 };
+        edges.resize(id + 1, missing);
+    }
+    edges[id] = edge;
+}
+
+size_t
+Bt9TraceReader::read(BranchRecord *recs, size_t max)
+{
+    size_t n = 0;
+    char *line;
+
+    while (n < max && !ended && (line = lines.next())) {
+        char *p = line;
+        char *field = nextField(p);
+        if (!field || *field == '#')
+            continue;
+        if (std::strcmp(field, "EOF") == 0) {
+            ended = true;
+            break;
+        }
+
+        uint64_t id;
+        if (!parseNumber(field, 10, id) || id >= edges.size() ||
+            edges[id].src >= nodes.size())
+            malformed();
+        const Edge &edge = edges[id];
+        const Node &node = nodes[edge.src];
+        if (!node.dummy) {
+            BranchRecord &rec = recs[n++];
+            rec.pc = node.pc;
+            rec.instGap = pending + 1;
+            rec.conditional = node.conditional;
+            rec.taken = !node.conditional || edge.taken;
+            pending = 0;
+        }
+        pending += edge.instCount;
+    }
+
+    return n;
+}
@@ -0,0 +1,63 @@
+/* @file
+ * Reader for the BT9 traces of the 2016 Championship Branch Prediction.
+ *
+ * A BT9 trace is text, usually gzip-compressed: a header, a table of
+ * branch nodes (BT9_NODES), a table of edges between them (BT9_EDGES)
+ * and the executed path as one edge id per line (BT9_EDGE_SEQUENCE),
+ * ended by EOF. Only the two tables are held in memory; the sequence
+ * is streamed. Each edge gives one branch: the address of its source
+ * node, taken if the edge is taken or the node unconditional, and an
+ * instGap of one plus the non-branch instructions on the previous edge.
+ */
+
+#ifndef __REPLAY_BT9_TRACE_HH__
+#define __REPLAY_BT9_TRACE_HH__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "decompress_stream.hh"
+#include "trace_source.hh"
+
+class Bt9TraceReader : public TraceSource
+{
+  public:
+    Bt9TraceReader(const std::string &path);
+
+    size_t read(BranchRecord *recs, size_t max);
+
+    /** First line of every BT9 trace. */
+    static const char *const magic;
+
+  private:
+    struct Node
+    {
+        Addr pc;
+        bool conditional;
+        /** The start node, which is not a branch. */
+        bool dummy;
+    };
+
+    struct Edge
+    {
+        uint32_t src;
+        bool taken;
+        /** Non-branch instructions from the source to the target. */
+        uint32_t instCount;
+    };
+
+    void readNode(char *line);
+    void readEdge(char *line);
+    /** Report a malformed line and exit. */
+    void malformed();
+
+    LineReader lines;
+    std::vector<Node> nodes;
+    std::vector<Edge> edges;
+    /** Non-branch instructions since the last branch. */
+    uint32_t pending;
+    bool ended;
+};
+
+#endif // __REPLAY_BT9_TRACE_HH__
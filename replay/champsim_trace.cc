@@ -0,0 +1,66 @@
+/* @file
+ * Reader for ChampSim instruction traces.
+ */
+
+#include "champsim_trace.hh"
+
+#include "base/misc.hh"
+
+ChampSimTraceReader::ChampSimTraceReader(const std::string &path)
+    : stream(path), buf(1 << 14), pos(0), end(0), gap(0)
+{
+}
+
+size_t
+ChampSimTraceReader::read(BranchRecord *recs, size_t max)
+{
+    size_t n = 0;
+
+    while (n < max) {
+        if (pos == end) {
+            size_t bytes = stream.read(&buf[0],
+                                       buf.size() * sizeof(ChampSimInstr));
+            if (bytes % sizeof(ChampSimInstr))
+                fatal("ChampSim trace ends in a partial record.\n");
+            pos = 0;
+            end = bytes / sizeof(ChampSimInstr);
+            if (!end)
+                break;
+        }
+
+        const ChampSimInstr &instr = buf[pos++];
+        gap++;
+
+        bool writes_ip = false;
+        bool writes_sp = false;
+        for (unsigned i = 0; i < 2; i++) {
+            writes_ip |= instr.destRegs[i] == regInstructionPointer;
+            writes_sp |= instr.destRegs[i] == regStackPointer;
+        }
+        if (!writes_ip)
+            continue;
+
+        bool reads_sp = false;
+        bool reads_flags = false;
+        bool reads_other = false;
+        for (unsigned i = 0; i < 4; i++) {
+            uint8_t reg = instr.srcRegs[i];
+            if (reg == regStackPointer)
+                reads_sp = true;
+            else if (reg == regFlags)
+                reads_flags = true;
+            else if (reg != 0 && reg != regInstructionPointer)
+                reads_other = true;
+        }
+
+        BranchRecord &rec = recs[n++];
+        rec.pc = instr.ip;
+        rec.instGap = gap;
+        rec.conditional = reads_flags && !reads_sp && !writes_sp &&
+            !reads_other;
+        rec.taken = !rec.conditional || instr.branchTaken;
+        gap = 0;
+    }
+
+    return n;
+}
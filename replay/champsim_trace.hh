@@ -0,0 +1,59 @@
+/* @file
+ * Reader for ChampSim instruction traces.
+ *
+ * A ChampSim trace is a sequence of 64-byte input_instr records, one
+ * per retired instruction, usually xz-compressed. The reader streams
+ * the file and keeps only the branches: an instruction is a branch if
+ * it writes the instruction pointer, and a conditional branch if it
+ * also reads the flags but neither the stack pointer nor any other
+ * register, the classification ChampSim itself uses. instGap counts
+ * the instructions since the previous branch, this one included.
+ */
+
+#ifndef __REPLAY_CHAMPSIM_TRACE_HH__
+#define __REPLAY_CHAMPSIM_TRACE_HH__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "decompress_stream.hh"
+#include "trace_source.hh"
+
+/** One instruction of a ChampSim trace, as stored in the file. */
+struct ChampSimInstr
+{
+    uint64_t ip;
+    uint8_t isBranch;
+    uint8_t branchTaken;
+    uint8_t destRegs[2];
+    uint8_t srcRegs[4];
+    uint64_t destMem[2];
+    uint64_t srcMem[4];
+};
+
+static_assert(sizeof(ChampSimInstr) == 64,
+              "ChampSimInstr must match the trace record layout");
+
+class ChampSimTraceReader : public TraceSource
+{
+  public:
+    ChampSimTraceReader(const std::string &path);
+
+    size_t read(BranchRecord *recs, size_t max);
+
+    /** Register numbers ChampSim uses to classify branches. */
+    static const uint8_t regStackPointer = 6;
+    static const uint8_t regFlags = 25;
+    static const uint8_t regInstructionPointer = 26;
+
+  private:
+    DecompressStream stream;
+    std::vector<ChampSimInstr> buf;
+    size_t pos;
+    size_t end;
+    /** Instructions since the last branch. */
+    uint32_t gap;
+};
+
+#endif // __REPLAY_CHAMPSIM_TRACE_HH__
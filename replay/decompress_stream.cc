@@ -0,0 +1,341 @@
+/* @file
+ * Streaming reads of possibly compressed trace files.
+ */
+
+#include "decompress_stream.hh"
+
+#include <lzma.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "base/misc.hh"
+
+/** Decompresses a file into consecutive runs of bytes. */
+class DecompressStream::Decoder
+{
+  public:
+    Decoder(std::FILE *file)
+        : file(file), in(1 << 16), inputEnd(false)
+    { }
+
+    virtual ~Decoder() { std::fclose(file); }
+
+    /**
+     * Decompress up to 'max' bytes into 'out'. Returns fewer only at
+     * the end of the data; sets 'error' if the data is corrupt.
+     */
+    virtual size_t decode(char *out, size_t max, std::string &error) = 0;
+
+  protected:
+    /** Read the next input bytes into 'in'; 0 at the end of the file. */
+    size_t
+    readInput()
+    {
+        size_t n = std::fread(&in[0], 1, in.size(), file);
+        if (n == 0)
+            inputEnd = true;
+        return n;
+    }
+
+    std::FILE *file;
+    std::vector<unsigned char> in;
+    bool inputEnd;
+};
+
+namespace
+{
+
+class PlainDecoder : public DecompressStream::Decoder
+{
+  public:
+    PlainDecoder(std::FILE *file)
+        : Decoder(file)
+    { }
+
+    size_t
+    decode(char *out, size_t max, std::string &error)
+    {
+        size_t got = 0;
+        size_t n;
+        while (got < max &&
+               (n = std::fread(out + got, 1, max - got, file)) != 0)
+            got += n;
+        return got;
+    }
+};
+
+class GzipDecoder : public DecompressStream::Decoder
+{
+  public:
+    GzipDecoder(std::FILE *file)
+        : Decoder(file), memberEnded(false)
+    {
+        std::memset(&zs, 0, sizeof(zs));
+        // 32: take the gzip header, 15: the largest window
+        if (inflateInit2(&zs, 15 + 32) != Z_OK)
+            fatal("Cannot initialize zlib.\n");
+    }
+
+    ~GzipDecoder() { inflateEnd(&zs); }
+
+    size_t
+    decode(char *out, size_t max, std::string &error)
+    {
+        zs.next_out = reinterpret_cast<Bytef *>(out);
+        zs.avail_out = max;
+        while (zs.avail_out) {
+            if (!zs.avail_in) {
+                zs.next_in = &in[0];
+                zs.avail_in = readInput();
+                if (!zs.avail_in) {
+                    if (!memberEnded)
+                        error = "truncated gzip data";
+                    break;
+                }
+            }
+            int ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                // another member may follow
+                memberEnded = true;
+                inflateReset(&zs);
+            } else if (ret == Z_OK || ret == Z_BUF_ERROR) {
+                memberEnded = false;
+            } else {
+                error = zs.msg ? zs.msg : "corrupt gzip data";
+                break;
+            }
+        }
+        return max - zs.avail_out;
+    }
+
+  private:
+    z_stream zs;
+    /** The last member ended and nothing of the next was read. */
+    bool memberEnded;
+};
+
+class XzDecoder : public DecompressStream::Decoder
+{
+  public:
+    XzDecoder(std::FILE *file)
+        : Decoder(file), streamEnded(false)
+    {
+        lzma_stream init = LZMA_STREAM_INIT;
+        xs = init;
+        if (lzma_stream_decoder(&xs, UINT64_MAX, LZMA_CONCATENATED) !=
+            LZMA_OK)
+            fatal("Cannot initialize liblzma.\n");
+    }
+
+    ~XzDecoder() { lzma_end(&xs); }
+
+    size_t
+    decode(char *out, size_t max, std::string &error)
+    {
+        xs.next_out = reinterpret_cast<uint8_t *>(out);
+        xs.avail_out = max;
+        while (xs.avail_out && !streamEnded) {
+            if (!xs.avail_in && !inputEnd) {
+                xs.next_in = &in[0];
+                xs.avail_in = readInput();
+            }
+            lzma_ret ret = lzma_code(&xs, inputEnd ? LZMA_FINISH : LZMA_RUN);
+            if (ret == LZMA_STREAM_END) {
+                streamEnded = true;
+            } else if (ret != LZMA_OK) {
+                error = ret == LZMA_BUF_ERROR ? "truncated xz data" :
+                    "corrupt xz data";
+                break;
+            }
+        }
+        return max - xs.avail_out;
+    }
+
+  private:
+    lzma_stream xs;
+    bool streamEnded;
+};
+
+/** Open 'path' and a decoder for its format, or return NULL. */
+DecompressStream::Decoder *
+openDecoder(const std::string &path, DecompressStream::Format &fmt)
+{
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return NULL;
+
+    static const unsigned char gzipMagic[] = { 0x1f, 0x8b };
+    static const unsigned char xzMagic[] = { 0xfd, '7', 'z', 'X', 'Z', 0 };
+    unsigned char magic[sizeof(xzMagic)];
+    size_t n = std::fread(magic, 1, sizeof(magic), file);
+    std::rewind(file);
+
+    if (n >= sizeof(gzipMagic) &&
+        std::memcmp(magic, gzipMagic, sizeof(gzipMagic)) == 0) {
+        fmt = DecompressStream::Gzip;
+        return new GzipDecoder(file);
+    }
+    if (n >= sizeof(xzMagic) &&
+        std::memcmp(magic, xzMagic, sizeof(xzMagic)) == 0) {
+        fmt = DecompressStream::Xz;
+        return new XzDecoder(file);
+    }
+    fmt = DecompressStream::Plain;
+    return new PlainDecoder(file);
+}
+
+} // anonymous namespace
+
+DecompressStream::DecompressStream(const std::string &path)
+    : fmt(Plain), chunks(numChunks), current(NULL), pos(0),
+      finished(false), stopping(false)
+{
+    decoder.reset(openDecoder(path, fmt));
+    if (!decoder)
+        fatal("Cannot open trace '%s'.\n", path.c_str());
+    for (unsigned i = 0; i < numChunks; i++) {
+        chunks[i].data.resize(chunkBytes);
+        chunks[i].size = 0;
+        spare.push_back(&chunks[i]);
+    }
+    producer = std::thread(&DecompressStream::produce, this);
+}
+
+DecompressStream::~DecompressStream()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    drained.notify_all();
+    producer.join();
+}
+
+void
+DecompressStream::produce()
+{
+    for (;;) {
+        Chunk *chunk;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            drained.wait(lock, [this] { return stopping || !spare.empty(); });
+            if (stopping)
+                return;
+            chunk = spare.back();
+            spare.pop_back();
+        }
+
+        std::string err;
+        chunk->size = decoder->decode(&chunk->data[0], chunkBytes, err);
+
+        std::lock_guard<std::mutex> lock(mtx);
+        if (chunk->size)
+            full.push_back(chunk);
+        else
+            spare.push_back(chunk);
+        // a short chunk is the end of the data
+        if (chunk->size < chunkBytes || !err.empty()) {
+            error = err;
+            finished = true;
+        }
+        filled.notify_one();
+        if (finished)
+            return;
+    }
+}
+
+size_t
+DecompressStream::read(void *buf, size_t max)
+{
+    char *out = static_cast<char *>(buf);
+    size_t got = 0;
+    while (got < max) {
+        if (current && pos < current->size) {
+            size_t n = std::min(max - got, current->size - pos);
+            std::memcpy(out + got, &current->data[pos], n);
+            pos += n;
+            got += n;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mtx);
+        if (current) {
+            spare.push_back(current);
+            current = NULL;
+            drained.notify_one();
+        }
+        filled.wait(lock, [this] { return finished || !full.empty(); });
+        if (full.empty()) {
+            if (!error.empty())
+                fatal("Cannot decompress trace: %s.\n", error.c_str());
+            break;
+        }
+        current = full.front();
+        full.pop_front();
+        pos = 0;
+    }
+    return got;
+}
+
+size_t
+DecompressStream::peek(const std::string &path, void *buf, size_t max)
+{
+    Format fmt;
+    std::unique_ptr<Decoder> decoder(openDecoder(path, fmt));
+    if (!decoder)
+        return 0;
+    // corrupt data shows up when the trace is read
+    std::string err;
+    return decoder->decode(static_cast<char *>(buf), max, err);
+}
+
+LineReader::LineReader(const std::string &path)
+    : stream(path), buf(1 << 20), pos(0), end(0), eof(false), lineNo(0)
+{
+}
+
+bool
+LineReader::fill()
+{
+    if (eof)
+        return false;
+
+    if (pos == 0 && end == buf.size() - 1)
+        fatal("Trace line %llu is too long.\n",
+              (unsigned long long)lineNo + 1);
+
+    std::memmove(&buf[0], &buf[pos], end - pos);
+    end -= pos;
+    pos = 0;
+    size_t want = buf.size() - end - 1;
+    size_t n = stream.read(&buf[end], want);
+    end += n;
+    if (n < want) {
+        eof = true;
+        // Terminate a last line that has no trailing newline.
+        if (end > 0 && buf[end - 1] != '\n')
+            buf[end++] = '\n';
+    }
+    return true;
+}
+
+char *
+LineReader::next()
+{
+    for (;;) {
+        char *line = &buf[pos];
+        char *nl = (char *)std::memchr(line, '\n', end - pos);
+        if (!nl) {
+            if (!fill())
+                return NULL;
+            continue;
+        }
+        *nl = '\0';
+        pos = nl - &buf[0] + 1;
+        lineNo++;
+        return line;
+    }
+}
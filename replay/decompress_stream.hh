@@ -0,0 +1,117 @@
+/* @file
+ * Streaming reads of possibly compressed trace files.
+ *
+ * Trace corpora are usually kept gzip- or xz-compressed and are far
+ * too large to decompress to disk first. A DecompressStream reads a
+ * file and, if it starts with the gzip or xz magic, decompresses it
+ * with zlib or liblzma on a background thread that keeps a few
+ * chunkBytes buffers filled ahead of the reader, so decompression
+ * overlaps the replay; a plain file is read ahead the same way.
+ * Concatenated gzip members and xz streams read as one stream.
+ *
+ * LineReader splits such a stream into lines for the text formats.
+ */
+
+#ifndef __REPLAY_DECOMPRESS_STREAM_HH__
+#define __REPLAY_DECOMPRESS_STREAM_HH__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class DecompressStream
+{
+  public:
+    enum Format { Plain, Gzip, Xz };
+
+    /** Open 'path' and start decompressing it. */
+    DecompressStream(const std::string &path);
+    ~DecompressStream();
+
+    /**
+     * Copy up to 'max' bytes of decompressed data into 'buf'. Returns
+     * fewer only at the end of the data, 0 once it has all been read.
+     */
+    size_t read(void *buf, size_t max);
+
+    Format format() const { return fmt; }
+
+    /**
+     * Decompress the first 'max' bytes of 'path' into 'buf' on the
+     * calling thread, e.g. to identify a trace format. Returns the
+     * bytes decompressed, 0 if the file cannot be read.
+     */
+    static size_t peek(const std::string &path, void *buf, size_t max);
+
+    /** Bytes of decompressed data per buffer. */
+    static const size_t chunkBytes = 1 << 20;
+    /** Buffers filled ahead of the reader at most. */
+    static const unsigned numChunks = 4;
+
+    class Decoder;
+
+  private:
+    struct Chunk
+    {
+        std::vector<char> data;
+        size_t size;
+    };
+
+    /** The background thread: decode into spare chunks until the end of
+     *  the data, an error or the destructor. */
+    void produce();
+
+    Format fmt;
+    std::unique_ptr<Decoder> decoder;
+
+    std::vector<Chunk> chunks;
+    /** Chunks filled and not yet read, oldest first. */
+    std::deque<Chunk *> full;
+    /** Chunks free to be filled. */
+    std::vector<Chunk *> spare;
+    /** The chunk being read and the read position in it. */
+    Chunk *current;
+    size_t pos;
+
+    std::mutex mtx;
+    std::condition_variable filled;
+    std::condition_variable drained;
+    /** The producer is done: end of data or 'error'. */
+    bool finished;
+    bool stopping;
+    std::string error;
+    std::thread producer;
+};
+
+class LineReader
+{
+  public:
+    LineReader(const std::string &path);
+
+    /**
+     * The next line, NUL-terminated and without its newline, or NULL
+     * at the end of the file. It stays valid until the next call.
+     */
+    char *next();
+
+    /** Number of the line next() returned last, from 1. */
+    uint64_t lineNumber() const { return lineNo; }
+
+  private:
+    /** Refill the buffer, keeping any partial line. */
+    bool fill();
+
+    DecompressStream stream;
+    std::vector<char> buf;
+    size_t pos;
+    size_t end;
+    bool eof;
+    uint64_t lineNo;
+};
+
+#endif // __REPLAY_DECOMPRESS_STREAM_HH__
@@ -0,0 +1,318 @@
+/* @file
+ * Replay of several gshare configurations in lockstep.
+ */
+
+#include "gshare_lanes.hh"
+
+#include <cstring>
+
+#if defined(__AVX2__)
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12's AVX-512 intrinsics start from a self-initialized
+// _mm512_undefined_epi32(), which -Wall reports at every use
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+#endif
+
+#include "base/intmath.hh"
+#include "base/misc.hh"
+
+namespace
+{
+
+/** Words per cache line; lane tables start on a line. */
+const unsigned lineWords = 16;
+
+} // anonymous namespace
+
+GshareLanes::GshareLanes()
+    : numLanes(0), finalized(false), tables(NULL), branches(0),
+      condBranches(0), instructions(0)
+{
+    std::memset(misses, 0, sizeof(misses));
+}
+
+bool
+GshareLanes::supports(const PredictorConfig &config)
+{
+    if (config.predType != "gshare")
+        return false;
+
+    PredictorConfig rest = config;
+    BPredUnit::Params defaults;
+    rest.params.instShiftAmt = defaults.instShiftAmt;
+    rest.params.localPredictorSize = defaults.localPredictorSize;
+    rest.params.localCtrBits = defaults.localCtrBits;
+    return rest.describe() == PredictorConfig().describe();
+}
+
+unsigned
+GshareLanes::addLane(const BPredUnit::Params &params)
+{
+    if (numLanes == Width)
+        fatal("At most %u gshare lanes.\n", Width);
+    if (finalized)
+        fatal("Gshare lanes must be added before replaying.\n");
+    if (!isPowerOf2(params.localPredictorSize))
+        fatal("Invalid local predictor size.\n");
+    if (params.localCtrBits < 1 || params.localCtrBits > 8)
+        fatal("Saturating counters must have 1 to 8 bits.\n");
+    if (params.instShiftAmt > 32)
+        fatal("Invalid instruction shift amount.\n");
+
+    // the same settings GshareBP derives from its parameters
+    unsigned lane = numLanes++;
+    instShift[lane] = params.instShiftAmt;
+    historyMask[lane] = params.localPredictorSize - 1;
+    slotShift[lane] = ceilLog2(params.localCtrBits);
+    wordShift[lane] = 5 - slotShift[lane];
+    slotMask[lane] = (1 << wordShift[lane]) - 1;
+    ctrMax[lane] = (1 << params.localCtrBits) - 1;
+    threshold[lane] = (1 << (params.localCtrBits - 1)) - 1;
+    ghr[lane] = 0;
+    return lane;
+}
+
+void
+GshareLanes::finalize()
+{
+    // idle lanes run a one-counter predictor whose results are ignored
+    for (unsigned lane = numLanes; lane < Width; lane++) {
+        instShift[lane] = 0;
+        historyMask[lane] = 0;
+        slotShift[lane] = 1;
+        wordShift[lane] = 4;
+        slotMask[lane] = 15;
+        ctrMax[lane] = 3;
+        threshold[lane] = 1;
+        ghr[lane] = 0;
+    }
+
+    uint64_t words = 0;
+    for (unsigned lane = 0; lane < Width; lane++) {
+        tableBase[lane] = words;
+        uint64_t lane_words =
+            ((uint64_t)historyMask[lane] >> wordShift[lane]) + 1;
+        words += (lane_words + lineWords - 1) / lineWords * lineWords;
+        if (words > INT32_MAX)
+            fatal("Gshare lane tables exceed 2^31 words.\n");
+    }
+    storage.assign(words + lineWords, 0);
+    uintptr_t addr = reinterpret_cast<uintptr_t>(&storage[0]);
+    tables = &storage[0] + ((64 - addr % 64) % 64) / sizeof(uint32_t);
+    finalized = true;
+}
+
+void
+GshareLanes::replay(const BranchRecord *recs, size_t count)
+{
+    if (!finalized)
+        finalize();
+
+    for (size_t i = 0; i < count; i++) {
+        condBranches += recs[i].conditional;
+        instructions += recs[i].instGap;
+    }
+    branches += count;
+
+#if defined(__AVX2__)
+    replayVector(recs, count);
+#else
+    replayScalar(recs, count);
+#endif
+}
+
+ReplayResults
+GshareLanes::getResults(unsigned lane) const
+{
+    ReplayResults res;
+    res.branches = branches;
+    res.condBranches = condBranches;
+    res.instructions = instructions;
+    res.mispredicts = misses[lane];
+    return res;
+}
+
+/*
+ * As GshareBP::predictBatch(): a mispredicted branch trains its counter
+ * twice (squashing update and commit), a correct one once, and the
+ * history always ends up holding the outcome.
+ */
+void
+GshareLanes::replayScalar(const BranchRecord *recs, size_t count)
+{
+    for (unsigned lane = 0; lane < numLanes; lane++) {
+        uint32_t *table = tables + tableBase[lane];
+        uint32_t h = ghr[lane];
+        uint64_t miss = 0;
+        for (size_t i = 0; i < count; i++) {
+            const BranchRecord &rec = recs[i];
+            bool taken = rec.taken || !rec.conditional;
+            uint32_t idx = ((uint32_t)(rec.pc >> instShift[lane]) ^ h) &
+                historyMask[lane];
+            uint32_t &word = table[idx >> wordShift[lane]];
+            unsigned pos = (idx & slotMask[lane]) << slotShift[lane];
+            unsigned ctr = (word >> pos) & ctrMax[lane];
+            unsigned steps = 1;
+            if (rec.conditional && (ctr > threshold[lane]) != taken) {
+                miss++;
+                steps = 2;
+            }
+            unsigned next = taken ? std::min(ctr + steps, ctrMax[lane]) :
+                (ctr > steps ? ctr - steps : 0);
+            word = (word & ~(ctrMax[lane] << pos)) | (next << pos);
+            h = ((h << 1) | taken) & historyMask[lane];
+        }
+        ghr[lane] = h;
+        misses[lane] += miss;
+    }
+}
+
+#if defined(__AVX512F__)
+
+void
+GshareLanes::replayVector(const BranchRecord *recs, size_t count)
+{
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i shift = _mm512_loadu_si512(instShift);
+    const __m512i hi_shift = _mm512_sub_epi32(_mm512_set1_epi32(32), shift);
+    const __m512i hmask = _mm512_loadu_si512(historyMask);
+    const __m512i slot_shift = _mm512_loadu_si512(slotShift);
+    const __m512i word_shift = _mm512_loadu_si512(wordShift);
+    const __m512i slot_mask = _mm512_loadu_si512(slotMask);
+    const __m512i max = _mm512_loadu_si512(ctrMax);
+    const __m512i thr = _mm512_loadu_si512(threshold);
+    const __m512i base = _mm512_loadu_si512(tableBase);
+    __m512i h = _mm512_loadu_si512(ghr);
+    __m512i miss = zero;
+    uint32_t lane_misses[Width];
+
+    for (size_t i = 0; i < count; i++) {
+        const BranchRecord &rec = recs[i];
+        bool taken = rec.taken || !rec.conditional;
+
+        __m512i pcs = _mm512_or_si512(
+            _mm512_srlv_epi32(_mm512_set1_epi32((uint32_t)rec.pc), shift),
+            _mm512_sllv_epi32(_mm512_set1_epi32((uint32_t)(rec.pc >> 32)),
+                              hi_shift));
+        __m512i idx = _mm512_and_si512(_mm512_xor_si512(pcs, h), hmask);
+        __m512i widx = _mm512_add_epi32(base,
+                                        _mm512_srlv_epi32(idx, word_shift));
+        __m512i pos = _mm512_sllv_epi32(_mm512_and_si512(idx, slot_mask),
+                                        slot_shift);
+        __m512i words = _mm512_i32gather_epi32(widx, tables, 4);
+        __m512i ctr = _mm512_and_si512(_mm512_srlv_epi32(words, pos), max);
+
+        __mmask16 mis = 0;
+        if (rec.conditional) {
+            __mmask16 pred = _mm512_cmpgt_epu32_mask(ctr, thr);
+            mis = taken ? (__mmask16)~pred : pred;
+        }
+        miss = _mm512_mask_add_epi32(miss, mis, miss, one);
+        __m512i steps = _mm512_mask_add_epi32(one, mis, one, one);
+        __m512i next = taken ?
+            _mm512_min_epu32(_mm512_add_epi32(ctr, steps), max) :
+            _mm512_max_epi32(_mm512_sub_epi32(ctr, steps), zero);
+        words = _mm512_or_si512(
+            _mm512_andnot_si512(_mm512_sllv_epi32(max, pos), words),
+            _mm512_sllv_epi32(next, pos));
+        // lanes have separate tables, so the scatter never conflicts
+        _mm512_i32scatter_epi32(tables, widx, words, 4);
+
+        h = _mm512_and_si512(
+            _mm512_or_si512(_mm512_slli_epi32(h, 1),
+                            _mm512_set1_epi32(taken)), hmask);
+
+        // flush the 32-bit miss counts long before they can wrap
+        if ((i & 0x3fffffff) == 0x3fffffff || i + 1 == count) {
+            _mm512_storeu_si512(lane_misses, miss);
+            for (unsigned lane = 0; lane < Width; lane++)
+                misses[lane] += lane_misses[lane];
+            miss = zero;
+        }
+    }
+    _mm512_storeu_si512(ghr, h);
+}
+
+#elif defined(__AVX2__)
+
+void
+GshareLanes::replayVector(const BranchRecord *recs, size_t count)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i shift = _mm256_loadu_si256((const __m256i *)instShift);
+    const __m256i hi_shift = _mm256_sub_epi32(_mm256_set1_epi32(32), shift);
+    const __m256i hmask = _mm256_loadu_si256((const __m256i *)historyMask);
+    const __m256i slot_shift = _mm256_loadu_si256((const __m256i *)slotShift);
+    const __m256i word_shift = _mm256_loadu_si256((const __m256i *)wordShift);
+    const __m256i slot_mask = _mm256_loadu_si256((const __m256i *)slotMask);
+    const __m256i max = _mm256_loadu_si256((const __m256i *)ctrMax);
+    const __m256i thr = _mm256_loadu_si256((const __m256i *)threshold);
+    const __m256i base = _mm256_loadu_si256((const __m256i *)tableBase);
+    __m256i h = _mm256_loadu_si256((const __m256i *)ghr);
+    __m256i miss = zero;
+    alignas(32) uint32_t lane_words[Width];
+    alignas(32) uint32_t lane_index[Width];
+    alignas(32) uint32_t lane_misses[Width];
+
+    for (size_t i = 0; i < count; i++) {
+        const BranchRecord &rec = recs[i];
+        bool taken = rec.taken || !rec.conditional;
+        const __m256i taken_mask = _mm256_set1_epi32(taken ? -1 : 0);
+
+        __m256i pcs = _mm256_or_si256(
+            _mm256_srlv_epi32(_mm256_set1_epi32((uint32_t)rec.pc), shift),
+            _mm256_sllv_epi32(_mm256_set1_epi32((uint32_t)(rec.pc >> 32)),
+                              hi_shift));
+        __m256i idx = _mm256_and_si256(_mm256_xor_si256(pcs, h), hmask);
+        __m256i widx = _mm256_add_epi32(base,
+                                        _mm256_srlv_epi32(idx, word_shift));
+        __m256i pos = _mm256_sllv_epi32(_mm256_and_si256(idx, slot_mask),
+                                        slot_shift);
+        __m256i words = _mm256_i32gather_epi32((const int *)tables, widx, 4);
+        __m256i ctr = _mm256_and_si256(_mm256_srlv_epi32(words, pos), max);
+
+        // all ones in the lanes that mispredict
+        __m256i mis = zero;
+        if (rec.conditional)
+            mis = _mm256_xor_si256(_mm256_cmpgt_epi32(ctr, thr), taken_mask);
+        miss = _mm256_sub_epi32(miss, mis);
+        __m256i steps = _mm256_sub_epi32(one, mis);
+        __m256i next = taken ?
+            _mm256_min_epu32(_mm256_add_epi32(ctr, steps), max) :
+            _mm256_max_epi32(_mm256_sub_epi32(ctr, steps), zero);
+        words = _mm256_or_si256(
+            _mm256_andnot_si256(_mm256_sllv_epi32(max, pos), words),
+            _mm256_sllv_epi32(next, pos));
+
+        // no scatter in AVX2; lanes have separate tables, so the stores
+        // never conflict
+        _mm256_store_si256((__m256i *)lane_words, words);
+        _mm256_store_si256((__m256i *)lane_index, widx);
+        for (unsigned lane = 0; lane < Width; lane++)
+            tables[lane_index[lane]] = lane_words[lane];
+
+        h = _mm256_and_si256(
+            _mm256_or_si256(_mm256_slli_epi32(h, 1),
+                            _mm256_srli_epi32(taken_mask, 31)), hmask);
+
+        // flush the 32-bit miss counts long before they can wrap
+        if ((i & 0x3fffffff) == 0x3fffffff || i + 1 == count) {
+            _mm256_store_si256((__m256i *)lane_misses, miss);
+            for (unsigned lane = 0; lane < Width; lane++)
+                misses[lane] += lane_misses[lane];
+            miss = zero;
+        }
+    }
+    _mm256_storeu_si256((__m256i *)ghr, h);
+}
+
+#endif // __AVX512F__ / __AVX2__
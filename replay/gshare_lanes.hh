@@ -0,0 +1,101 @@
+/* @file
+ * Replay of several gshare configurations in lockstep.
+ *
+ * GshareLanes holds up to Width independent gshare predictors, each
+ * with its own instShiftAmt, localPredictorSize and localCtrBits, and
+ * advances all of them by one branch record at a time: the per-lane
+ * index ((pc >> instShiftAmt) ^ ghr) & mask, the counter gather, the
+ * training and the history update are done for all lanes in vector
+ * registers (16 lanes with AVX-512, 8 with AVX2; a scalar loop over 8
+ * lanes otherwise). Each lane ends up with exactly the counters and
+ * mispredictions GshareBP::predictBatch() gives for its configuration.
+ *
+ * Counters are packed into 32-bit words, each lane's table aligned to a
+ * cache line in one shared allocation, so a gather can fetch the words
+ * of all lanes with one instruction.
+ */
+
+#ifndef __REPLAY_GSHARE_LANES_HH__
+#define __REPLAY_GSHARE_LANES_HH__
+
+#include <cstdint>
+#include <vector>
+
+#include "branch_replay.hh"
+#include "cpu/pred/bp_trace.hh"
+#include "cpu/pred/bpred_unit.hh"
+#include "predictor_factory.hh"
+
+class GshareLanes
+{
+  public:
+#if defined(__AVX512F__)
+    static const unsigned Width = 16;
+#else
+    static const unsigned Width = 8;
+#endif
+
+    GshareLanes();
+
+    /**
+     * True if a lane replays 'config' exactly: a gshare configuration
+     * that sets nothing but instShiftAmt, localPredictorSize and
+     * localCtrBits. Any other parameter may change what GshareBP does
+     * (history length, loop predictor, traces, profiles, statistics),
+     * which the lanes do not model.
+     */
+    static bool supports(const PredictorConfig &config);
+
+    /**
+     * Add a lane with the gshare parameters of 'params'; returns its
+     * number. At most Width lanes, all added before the first replay().
+     */
+    unsigned addLane(const BPredUnit::Params &params);
+
+    unsigned lanes() const { return numLanes; }
+
+    /** Predict and train every lane on a run of records. */
+    void replay(const BranchRecord *recs, size_t count);
+
+    /** Counts of lane 'lane' so far. */
+    ReplayResults getResults(unsigned lane) const;
+
+  private:
+    /** Lay out the tables; called by the first replay(). */
+    void finalize();
+
+    void replayScalar(const BranchRecord *recs, size_t count);
+#if defined(__AVX2__)
+    void replayVector(const BranchRecord *recs, size_t count);
+#endif
+
+    unsigned numLanes;
+    bool finalized;
+
+    /** Per-lane parameters and state, as 32-bit lanes for the kernel. */
+    uint32_t instShift[Width];
+    uint32_t historyMask[Width];
+    /** log2 of the counter slot width in bits. */
+    uint32_t slotShift[Width];
+    /** log2 of the counters per 32-bit word. */
+    uint32_t wordShift[Width];
+    /** Counters per 32-bit word, less one: the slot bits of an index. */
+    uint32_t slotMask[Width];
+    uint32_t ctrMax[Width];
+    uint32_t threshold[Width];
+    /** Offset, in words, of the lane's table in 'tables'. */
+    uint32_t tableBase[Width];
+    uint32_t ghr[Width];
+    uint64_t misses[Width];
+
+    /** Counter tables of all lanes, cache line aligned. */
+    std::vector<uint32_t> storage;
+    uint32_t *tables;
+
+    /** Counts common to all lanes. */
+    uint64_t branches;
+    uint64_t condBranches;
+    uint64_t instructions;
+};
+
+#endif // __REPLAY_GSHARE_LANES_HH__
@@ -0,0 +1,246 @@
+/* @file
+ * Construction of the predictors in this directory from key=value
+ * options.
+ */
+
+#include "predictor_factory.hh"
+
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include "cpu/pred/gshare.hh"
+#include "cpu/pred/gskew.hh"
+#include "cpu/pred/perceptron.hh"
+#include "cpu/pred/tage.hh"
+#include "cpu/pred/yags.hh"
+
+namespace
+{
+
+/** Unsigned parameters settable by name. */
+struct UnsignedParam
+{
+    const char *name;
+    unsigned BPredUnit::Params::*field;
+};
+
+const UnsignedParam unsignedParams[] = {
+    { "numThreads", &BPredUnit::Params::numThreads },
+    { "instShiftAmt", &BPredUnit::Params::instShiftAmt },
+    { "localPredictorSize", &BPredUnit::Params::localPredictorSize },
+    { "localCtrBits", &BPredUnit::Params::localCtrBits },
+    { "globalPredictorSize", &BPredUnit::Params::globalPredictorSize },
+    { "globalCtrBits", &BPredUnit::Params::globalCtrBits },
+    { "choicePredictorSize", &BPredUnit::Params::choicePredictorSize },
+    { "choiceCtrBits", &BPredUnit::Params::choiceCtrBits },
+    { "historyCheckpoints", &BPredUnit::Params::historyCheckpoints },
+    { "yagsAssociativity", &BPredUnit::Params::yagsAssociativity },
+    { "yagsTagLength", &BPredUnit::Params::yagsTagLength },
+    { "profileEntries", &BPredUnit::Params::profileEntries },
+    { "profileTop", &BPredUnit::Params::profileTop },
+    { "tageTables", &BPredUnit::Params::tageTables },
+    { "tageTableSize", &BPredUnit::Params::tageTableSize },
+    { "tageTagLength", &BPredUnit::Params::tageTagLength },
+    { "tageCtrBits", &BPredUnit::Params::tageCtrBits },
+    { "tageMinHistory", &BPredUnit::Params::tageMinHistory },
+    { "tageMaxHistory", &BPredUnit::Params::tageMaxHistory },
+    { "globalHistoryLength", &BPredUnit::Params::globalHistoryLength },
+    { "perceptronHistoryLength",
+      &BPredUnit::Params::perceptronHistoryLength },
+    { "perceptronTableSize", &BPredUnit::Params::perceptronTableSize },
+    { "gskewBankSize", &BPredUnit::Params::gskewBankSize },
+    { "loopPredictorEntries", &BPredUnit::Params::loopPredictorEntries },
+};
+
+const size_t numUnsignedParams =
+    sizeof(unsignedParams) / sizeof(unsignedParams[0]);
+
+/** String parameters settable by name. */
+struct StringParam
+{
+    const char *name;
+    std::string BPredUnit::Params::*field;
+};
+
+const StringParam stringParams[] = {
+    { "yagsReplacement", &BPredUnit::Params::yagsReplacement },
+    { "branchTraceFile", &BPredUnit::Params::branchTraceFile },
+    { "mispredictProfile", &BPredUnit::Params::mispredictProfile },
+};
+
+const size_t numStringParams =
+    sizeof(stringParams) / sizeof(stringParams[0]);
+
+/** Boolean parameters settable by name, as 0/1 or false/true. */
+struct BoolParam
+{
+    const char *name;
+    bool BPredUnit::Params::*field;
+};
+
+const BoolParam boolParams[] = {
+    { "tableHugePages", &BPredUnit::Params::tableHugePages },
+    { "trackAliasing", &BPredUnit::Params::trackAliasing },
+    { "threadIndexSalt", &BPredUnit::Params::threadIndexSalt },
+};
+
+const size_t numBoolParams = sizeof(boolParams) / sizeof(boolParams[0]);
+
+} // anonymous namespace
+
+bool
+PredictorConfig::set(const std::string &option)
+{
+    size_t eq = option.find('=');
+    if (eq == std::string::npos)
+        return false;
+
+    std::string name = option.substr(0, eq);
+    std::string value = option.substr(eq + 1);
+
+    if (name == "predType") {
+        predType = value;
+        return true;
+    }
+
+    for (size_t i = 0; i < numUnsignedParams; i++) {
+        if (name == unsignedParams[i].name) {
+            params.*(unsignedParams[i].field) =
+                std::strtoul(value.c_str(), NULL, 0);
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < numStringParams; i++) {
+        if (name == stringParams[i].name) {
+            params.*(stringParams[i].field) = value;
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < numBoolParams; i++) {
+        if (name == boolParams[i].name) {
+            if (value != "0" && value != "1" && value != "false" &&
+                value != "true")
+                fatal("Parameter %s must be 0/1 or false/true.\n",
+                      name.c_str());
+            params.*(boolParams[i].field) = value == "1" || value == "true";
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::string
+PredictorConfig::describe() const
+{
+    BPredUnit::Params defaults;
+    std::ostringstream os;
+
+    os << "predType=" << predType;
+    for (size_t i = 0; i < numUnsignedParams; i++) {
+        unsigned value = params.*(unsignedParams[i].field);
+        if (value != defaults.*(unsignedParams[i].field))
+            os << " " << unsignedParams[i].name << "=" << value;
+    }
+    for (size_t i = 0; i < numStringParams; i++) {
+        const std::string &value = params.*(stringParams[i].field);
+        if (value != defaults.*(stringParams[i].field))
+            os << " " << stringParams[i].name << "=" << value;
+    }
+    for (size_t i = 0; i < numBoolParams; i++) {
+        bool value = params.*(boolParams[i].field);
+        if (value != defaults.*(boolParams[i].field))
+            os << " " << boolParams[i].name << "=" << value;
+    }
+    return os.str();
+}
+
+BPredUnit *
+PredictorConfig::create() const
+{
+    if (predType == "gshare")
+        return new GshareBP(&params);
+    if (predType == "yags")
+        return new YagsBP(&params);
+    if (predType == "tage")
+        return new TageBP(&params);
+    if (predType == "perceptron")
+        return new PerceptronBP(&params);
+    if (predType == "gskew")
+        return new GskewBP(&params);
+
+    fatal("Unknown predictor type '%s'.\n", predType.c_str());
+}
+
+void
+expandConfigs(const std::vector<std::string> &group,
+              std::vector<PredictorConfig> &configs)
+{
+    std::vector<PredictorConfig> expanded(1);
+    for (size_t i = 0; i < group.size(); i++) {
+        size_t eq = group[i].find('=');
+        if (eq == std::string::npos)
+            fatal("Bad configuration option '%s'.\n", group[i].c_str());
+        std::string name = group[i].substr(0, eq + 1);
+        std::vector<std::string> values;
+        std::istringstream list(group[i].substr(eq + 1));
+        std::string value;
+        while (std::getline(list, value, ','))
+            values.push_back(value);
+
+        std::vector<PredictorConfig> next;
+        for (size_t c = 0; c < expanded.size(); c++) {
+            for (size_t v = 0; v < values.size(); v++) {
+                PredictorConfig config = expanded[c];
+                if (!config.set(name + values[v]))
+                    fatal("Unknown parameter '%s'.\n", group[i].c_str());
+                next.push_back(config);
+            }
+        }
+        expanded.swap(next);
+    }
+    configs.insert(configs.end(), expanded.begin(), expanded.end());
+}
+
+void
+readConfigFile(const std::string &path,
+               std::vector<PredictorConfig> &configs)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+        fatal("Cannot open config file '%s'.\n", path.c_str());
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream words(line);
+        std::vector<std::string> group;
+        std::string word;
+        while (words >> word && word[0] != '#')
+            group.push_back(word);
+        if (!group.empty())
+            expandConfigs(group, configs);
+    }
+}
+
+void
+checkOutputFiles(const std::vector<PredictorConfig> &configs,
+                 unsigned copies)
+{
+    std::set<std::string> paths;
+    for (size_t i = 0; i < configs.size(); i++) {
+        const std::string *files[] = {
+            &configs[i].params.branchTraceFile,
+            &configs[i].params.mispredictProfile,
+        };
+        for (unsigned f = 0; f < 2; f++) {
+            if (files[f]->empty())
+                continue;
+            if (copies > 1 || !paths.insert(*files[f]).second)
+                fatal("More than one predictor would write '%s'.\n",
+                      files[f]->c_str());
+        }
+    }
+}
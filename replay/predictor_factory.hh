@@ -0,0 +1,58 @@
+/* @file
+ * Construction of the predictors in this directory from key=value
+ * options, so the replay tools can be configured from the command line
+ * the same way a gem5 config script sets BranchPredictor parameters.
+ */
+
+#ifndef __REPLAY_PREDICTOR_FACTORY_HH__
+#define __REPLAY_PREDICTOR_FACTORY_HH__
+
+#include <string>
+#include <vector>
+
+#include "cpu/pred/bpred_unit.hh"
+
+struct PredictorConfig
+{
+    PredictorConfig()
+        : predType("gshare")
+    { }
+
+    /** "gshare", "yags" or "tage". */
+    std::string predType;
+    BPredUnit::Params params;
+
+    /**
+     * Apply one "name=value" option. Returns false if the name is not
+     * a known parameter.
+     */
+    bool set(const std::string &option);
+
+    /** Parameters that differ from the defaults, as "name=value ...". */
+    std::string describe() const;
+
+    /** Instantiate the configured predictor. */
+    BPredUnit *create() const;
+};
+
+/**
+ * Expand one group of "name=value" options, where a value may be a
+ * comma separated list, into every combination, appended to 'configs'.
+ */
+void expandConfigs(const std::vector<std::string> &group,
+                   std::vector<PredictorConfig> &configs);
+
+/** Expand each non-empty, non-# line of the file at 'path' as a group
+ *  of expandConfigs(). */
+void readConfigFile(const std::string &path,
+                    std::vector<PredictorConfig> &configs);
+
+/**
+ * Exit with an error if two of the predictors of 'configs', 'copies'
+ * of each, would write the same branchTraceFile or mispredictProfile:
+ * each would overwrite the file of the one before.
+ */
+void checkOutputFiles(const std::vector<PredictorConfig> &configs,
+                      unsigned copies = 1);
+
+#endif // __REPLAY_PREDICTOR_FACTORY_HH__
@@ -0,0 +1,110 @@
+/* @file
+ * repl_cost: storage and per-access cost of the set replacement
+ * policies in set_replacement.hh.
+ *
+ * Usage: repl_cost [--sets=N] [--accesses=N] [--hit-rate=P]
+ *
+ * For 2, 4 and 8 ways, every policy runs the same random stream of
+ * hits (touch) and misses (victim, then insert) over --sets sets, and
+ * the report gives the bits of state each policy models per set, the
+ * bytes it occupies in a YAGS cache set, and nanoseconds per access.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "cpu/pred/set_replacement.hh"
+
+namespace
+{
+
+struct CostOptions
+{
+    CostOptions() : sets(4096), accesses(50000000), hitRate(0.9) { }
+
+    unsigned sets;
+    uint64_t accesses;
+    double hitRate;
+};
+
+/** Run the access stream through one policy and print its line. */
+template <class Repl, unsigned Ways>
+void
+measure(const CostOptions &opts)
+{
+    std::vector<typename Repl::State> sets(opts.sets);
+    uint64_t hit_threshold = (uint64_t)(opts.hitRate * 65536);
+    uint64_t stream = ULL(0x2545f4914f6cdd1d);
+    uint64_t rng = ULL(0x9e3779b97f4a7c15);
+    unsigned checksum = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < opts.accesses; i++) {
+        uint64_t r = SetReplacement::nextRandom(stream);
+        typename Repl::State &state = sets[(r >> 16) % opts.sets];
+        if ((r & 0xffff) < hit_threshold) {
+            Repl::touch(state, (r >> 48) & (Ways - 1));
+        } else {
+            unsigned way = Repl::victim(state, rng);
+            Repl::insert(state, way);
+            checksum += way;
+        }
+    }
+    auto stop = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    std::printf("%-7s %4u %10u %11zu %10.2f %10u\n", Repl::name(), Ways,
+                Repl::stateBits(), sizeof(typename Repl::State),
+                seconds * 1e9 / opts.accesses, checksum);
+}
+
+template <unsigned Ways>
+void
+measureWays(const CostOptions &opts)
+{
+    measure<LRUReplacement<Ways>, Ways>(opts);
+    measure<TreePLRUReplacement<Ways>, Ways>(opts);
+    measure<SRRIPReplacement<Ways>, Ways>(opts);
+    measure<RandomReplacement<Ways>, Ways>(opts);
+}
+
+void
+usage(const char *prog)
+{
+    std::fprintf(stderr,
+                 "usage: %s [--sets=N] [--accesses=N] [--hit-rate=P]\n",
+                 prog);
+    std::exit(2);
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char **argv)
+{
+    CostOptions opts;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 7, "--sets=") == 0)
+            opts.sets = std::strtoul(arg.c_str() + 7, NULL, 0);
+        else if (arg.compare(0, 11, "--accesses=") == 0)
+            opts.accesses = std::strtoull(arg.c_str() + 11, NULL, 0);
+        else if (arg.compare(0, 11, "--hit-rate=") == 0)
+            opts.hitRate = std::strtod(arg.c_str() + 11, NULL);
+        else
+            usage(argv[0]);
+    }
+    if (!opts.sets || !opts.accesses)
+        usage(argv[0]);
+
+    std::printf("%-7s %4s %10s %11s %10s %10s\n", "policy", "ways",
+                "state_bits", "state_bytes", "ns_access", "checksum");
+    measureWays<2>(opts);
+    measureWays<4>(opts);
+    measureWays<8>(opts);
+    return 0;
+}
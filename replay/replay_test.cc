@@ -0,0 +1,571 @@
+/* @file
+ * replay_test: checks of the equivalences the replay tools rely on, on
+ * a generated trace.
+ *
+ * Usage: replay_test
+ *
+ *   batch      predictBatch() gives the mispredictions and the final
+ *              predictor state (as a snapshot) of the hooks
+ *   lanes      every GshareLanes lane matches GshareBP::predictBatch(),
+ *              as bp_sweep with and without --no-lanes, and the sweep
+ *              keeps the configurations the lanes cannot model off them
+ *   snapshot   a predictor saved halfway and restored into a new one
+ *              ends like one that replayed the whole trace, and can
+ *              save over the snapshot it was restored from
+ *   trace      the binary trace format round-trips, also after a seek,
+ *              and corrupt traces are rejected
+ *   capture    a destroyed predictor has finished its branch trace and
+ *              misprediction profile
+ *   compress   gzip and xz text traces read like the plain file
+ *
+ * Scratch files go to a temporary directory that is removed at the
+ * end. Prints one line per failed check and exits 1 if there was any.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <lzma.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "branch_replay.hh"
+#include "cpu/pred/bp_trace.hh"
+#include "cpu/pred/bp_trace_capture.hh"
+#include "cpu/pred/gshare.hh"
+#include "cpu/pred/gskew.hh"
+#include "cpu/pred/perceptron.hh"
+#include "cpu/pred/tage.hh"
+#include "cpu/pred/yags.hh"
+#include "gshare_lanes.hh"
+#include "predictor_factory.hh"
+#include "text_trace.hh"
+
+namespace
+{
+
+unsigned failures = 0;
+std::string scratch;
+
+void
+check(bool ok, const std::string &what)
+{
+    if (!ok) {
+        std::printf("FAIL: %s\n", what.c_str());
+        failures++;
+    }
+}
+
+std::string
+scratchPath(const char *name)
+{
+    return scratch + "/" + name;
+}
+
+std::string
+readFile(const std::string &path)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+}
+
+uint64_t
+nextRandom(uint64_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+/**
+ * A branch stream with loops, biased, history-correlated and random
+ * branches and a few unconditional ones, so every table and the loop
+ * predictor see some traffic.
+ */
+std::vector<BranchRecord>
+generateTrace(size_t count)
+{
+    std::vector<BranchRecord> recs;
+    recs.reserve(count);
+    uint64_t rng = 0x9e3779b97f4a7c15ULL;
+    uint64_t history = 0;
+    unsigned trip[16] = { 0 };
+
+    while (recs.size() < count) {
+        uint64_t r = nextRandom(rng);
+        unsigned branch = r % 512;
+        BranchRecord rec;
+        rec.pc = 0x400000 + branch * 4 + ((r >> 20) & 1) * 0x100000;
+        rec.instGap = 1 + (r >> 32) % 12;
+        rec.conditional = branch % 16 != 15;
+        if (!rec.conditional)
+            rec.taken = true;
+        else if (branch < 16)
+            rec.taken = ++trip[branch] % (3 + branch) != 0;
+        else if (branch < 192)
+            rec.taken = (r >> 40) % 8 != 0;
+        else if (branch < 384)
+            rec.taken = ((history >> (branch % 7)) ^ (history >> 3)) & 1;
+        else
+            rec.taken = (r >> 45) & 1;
+        history = (history << 1) | rec.taken;
+        recs.push_back(rec);
+    }
+    return recs;
+}
+
+bool
+sameRecords(const BranchRecord *a, const BranchRecord *b, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (a[i].pc != b[i].pc || a[i].instGap != b[i].instGap ||
+            a[i].taken != b[i].taken || a[i].conditional != b[i].conditional)
+            return false;
+    }
+    return true;
+}
+
+/** Save the state of any of the predictors to 'path'. */
+void
+saveAny(BPredUnit *bp, const std::string &path)
+{
+    if (GshareBP *gshare = dynamic_cast<GshareBP *>(bp))
+        gshare->saveSnapshot(path);
+    else if (GskewBP *gskew = dynamic_cast<GskewBP *>(bp))
+        gskew->saveSnapshot(path);
+    else if (YagsBP *yags = dynamic_cast<YagsBP *>(bp))
+        yags->saveSnapshot(path);
+    else if (TageBP *tage = dynamic_cast<TageBP *>(bp))
+        tage->saveSnapshot(path);
+    else if (PerceptronBP *perceptron = dynamic_cast<PerceptronBP *>(bp))
+        perceptron->saveSnapshot(path);
+}
+
+void
+restoreAny(BPredUnit *bp, const std::string &path)
+{
+    if (GshareBP *gshare = dynamic_cast<GshareBP *>(bp))
+        gshare->restoreSnapshot(path);
+    else if (GskewBP *gskew = dynamic_cast<GskewBP *>(bp))
+        gskew->restoreSnapshot(path);
+    else if (YagsBP *yags = dynamic_cast<YagsBP *>(bp))
+        yags->restoreSnapshot(path);
+    else if (TageBP *tage = dynamic_cast<TageBP *>(bp))
+        tage->restoreSnapshot(path);
+    else if (PerceptronBP *perceptron = dynamic_cast<PerceptronBP *>(bp))
+        perceptron->restoreSnapshot(path);
+}
+
+PredictorConfig
+makeConfig(const std::string &options)
+{
+    PredictorConfig config;
+    std::vector<std::string> group;
+    std::string option;
+    for (size_t i = 0; i <= options.size(); i++) {
+        if (i == options.size() || options[i] == ' ') {
+            if (!option.empty())
+                group.push_back(option);
+            option.clear();
+        } else {
+            option += options[i];
+        }
+    }
+    for (size_t i = 0; i < group.size(); i++) {
+        if (!config.set(group[i]))
+            fatal("Unknown parameter '%s'.\n", group[i].c_str());
+    }
+    return config;
+}
+
+template <class Predictor>
+void
+checkBatch(const std::string &options,
+           const std::vector<BranchRecord> &trace)
+{
+    PredictorConfig config = makeConfig(options);
+    std::unique_ptr<BPredUnit> hooks_bp(config.create());
+    std::unique_ptr<BPredUnit> batch_bp(config.create());
+    Predictor &batch_pred = *static_cast<Predictor *>(batch_bp.get());
+
+    BranchReplay hooks(*hooks_bp);
+    BatchReplay<Predictor> batch(batch_pred);
+    // uneven runs, so runs end mid-way through the internal blocks
+    for (size_t pos = 0; pos < trace.size(); ) {
+        size_t n = std::min<size_t>(trace.size() - pos, 4093);
+        hooks.replay(&trace[pos], n);
+        batch.replay(&trace[pos], n);
+        pos += n;
+    }
+
+    check(hooks.getResults().mispredicts == batch.getResults().mispredicts,
+          "batch: mispredictions of " + options);
+    saveAny(hooks_bp.get(), scratchPath("hooks.snap"));
+    saveAny(batch_bp.get(), scratchPath("batch.snap"));
+    check(readFile(scratchPath("hooks.snap")) ==
+          readFile(scratchPath("batch.snap")),
+          "batch: final state of " + options);
+}
+
+void
+checkLanes(const std::vector<std::string> &options,
+           const std::vector<BranchRecord> &trace)
+{
+    GshareLanes lanes;
+    std::vector<std::unique_ptr<BPredUnit> > preds;
+    std::vector<uint64_t> misses;
+    for (size_t i = 0; i < options.size(); i++) {
+        PredictorConfig config = makeConfig(options[i]);
+        check(GshareLanes::supports(config),
+              "lanes: sweep would not use lanes for " + options[i]);
+        lanes.addLane(config.params);
+        preds.push_back(std::unique_ptr<BPredUnit>(config.create()));
+        BatchReplay<GshareBP> batch(*static_cast<GshareBP *>(
+                                        preds.back().get()));
+        batch.replay(&trace[0], trace.size());
+        misses.push_back(batch.getResults().mispredicts);
+    }
+    lanes.replay(&trace[0], trace.size());
+    for (size_t i = 0; i < options.size(); i++)
+        check(lanes.getResults(i).mispredicts == misses[i],
+              "lanes: mispredictions of " + options[i]);
+}
+
+void
+checkSnapshot(const std::string &options,
+              const std::vector<BranchRecord> &trace)
+{
+    PredictorConfig config = makeConfig(options);
+    size_t half = trace.size() / 2;
+    std::string path = scratchPath("half.snap");
+
+    std::unique_ptr<BPredUnit> whole(config.create());
+    BranchReplay whole_first(*whole);
+    whole_first.replay(&trace[0], half);
+    BranchReplay whole_second(*whole);
+    whole_second.replay(&trace[half], trace.size() - half);
+
+    {
+        std::unique_ptr<BPredUnit> first(config.create());
+        BranchReplay replay(*first);
+        replay.replay(&trace[0], half);
+        saveAny(first.get(), path);
+    }
+    std::unique_ptr<BPredUnit> second(config.create());
+    restoreAny(second.get(), path);
+    BranchReplay replay(*second);
+    replay.replay(&trace[half], trace.size() - half);
+
+    check(replay.getResults().mispredicts ==
+          whole_second.getResults().mispredicts,
+          "snapshot: mispredictions after restoring " + options);
+    // saved over the snapshot its tables are still mapped from
+    saveAny(whole.get(), scratchPath("whole.snap"));
+    saveAny(second.get(), path);
+    check(readFile(scratchPath("whole.snap")) == readFile(path),
+          "snapshot: final state after restoring " + options);
+    replay.replay(&trace[0], half);
+    BranchReplay whole_again(*whole);
+    whole_again.replay(&trace[0], half);
+    check(replay.getResults().mispredicts -
+          whole_second.getResults().mispredicts ==
+          whole_again.getResults().mispredicts,
+          "snapshot: replay after saving over the restored snapshot of " +
+          options);
+}
+
+/** True if reading all of the binary trace at 'path' exits with an
+ *  error, as it must for a corrupt trace. */
+bool
+rejectsTrace(const std::string &path)
+{
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDERR_FILENO);
+        BranchTraceFile file(path);
+        BranchTraceReader reader(file);
+        std::vector<BranchRecord> recs(4096);
+        while (reader.read(&recs[0], recs.size()))
+            ;
+        _exit(0);
+    }
+    int status;
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+        WEXITSTATUS(status) != 0;
+}
+
+void
+writeFile(const std::string &path, const std::string &bytes)
+{
+    std::FILE *file = std::fopen(path.c_str(), "wb");
+    std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+}
+
+void
+checkTrace(const std::vector<BranchRecord> &trace)
+{
+    std::string path = scratchPath("trace.bpt");
+    uint64_t insts = 0;
+    {
+        BranchTraceWriter writer(path, 1000);
+        writer.write(&trace[0], trace.size());
+        for (size_t i = 0; i < trace.size(); i++)
+            insts += trace[i].instGap;
+    }
+
+    BranchTraceFile file(path);
+    check(file.numRecords() == trace.size() &&
+          file.getHeader().instCount == insts,
+          "trace: header counts");
+
+    std::vector<BranchRecord> read(trace.size() + 1);
+    BranchTraceReader reader(file);
+    size_t n = 0, got;
+    while ((got = reader.read(&read[n], 777)) != 0)
+        n += got;
+    check(n == trace.size() && sameRecords(&read[0], &trace[0], n),
+          "trace: records read back");
+
+    uint64_t seek_to = 12345;
+    reader.seek(seek_to);
+    n = reader.read(&read[0], 5000);
+    check(n == 5000 && sameRecords(&read[0], &trace[seek_to], n),
+          "trace: records after a seek");
+
+    std::string bytes = readFile(path);
+    BranchTraceHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    std::string bad = scratchPath("bad.bpt");
+
+    std::string corrupt = bytes;
+    BranchTraceBlock block;
+    size_t entry = header.indexOffset + 3 * sizeof(block);
+    std::memcpy(&block, &corrupt[entry], sizeof(block));
+    block.offset = header.indexOffset + 1000;
+    std::memcpy(&corrupt[entry], &block, sizeof(block));
+    writeFile(bad, corrupt);
+    check(rejectsTrace(bad), "trace: corrupt block index accepted");
+
+    corrupt = bytes;
+    std::memcpy(&block, &corrupt[header.indexOffset + 5 * sizeof(block)],
+                sizeof(block));
+    std::memset(&corrupt[block.offset + 100], 0xff, 20);
+    writeFile(bad, corrupt);
+    check(rejectsTrace(bad), "trace: overlong varint accepted");
+
+    corrupt = bytes;
+    BranchTraceHeader wrong = header;
+    wrong.recordCount += header.blockRecords;
+    std::memcpy(&corrupt[0], &wrong, sizeof(wrong));
+    writeFile(bad, corrupt);
+    check(rejectsTrace(bad), "trace: corrupt header accepted");
+
+    // the last two bytes of the last block cut off
+    corrupt = bytes;
+    wrong = header;
+    wrong.indexOffset -= 2;
+    std::memcpy(&corrupt[0], &wrong, sizeof(wrong));
+    corrupt.erase(wrong.indexOffset, 2);
+    writeFile(bad, corrupt);
+    check(rejectsTrace(bad), "trace: truncated block accepted");
+}
+
+void
+checkCapture(const std::vector<BranchRecord> &trace)
+{
+    const char *types[] = { "gshare", "gskew", "yags", "tage",
+                            "perceptron" };
+    std::string captured = scratchPath("captured.bpt");
+    std::string profile = scratchPath("profile.txt");
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        std::string options = std::string("predType=") + types[i] +
+            " branchTraceFile=" + captured + " mispredictProfile=" +
+            profile;
+        {
+            std::unique_ptr<BPredUnit> bp(makeConfig(options).create());
+            BranchReplay replay(*bp);
+            replay.replay(&trace[0], 1000);
+        }
+        // both are finished when the predictor goes, not at exit
+        BranchTraceFile file(captured);
+        check(file.numRecords() == 1000,
+              std::string("capture: trace of a destroyed ") + types[i]);
+        check(!readFile(profile).empty(),
+              std::string("capture: profile of a destroyed ") + types[i]);
+        unlink(profile.c_str());
+    }
+
+    // records after close(), as after the exit callback, are dropped
+    // rather than handed to the stopped writer
+    {
+        BranchTraceCapture capture(captured, 16);
+        for (size_t i = 0; i < 40; i++)
+            capture.record(trace[i].pc, trace[i].taken, true);
+        capture.close();
+        for (size_t i = 0; i < 100; i++)
+            capture.record(trace[i].pc, trace[i].taken, true);
+    }
+    BranchTraceFile file(captured);
+    check(file.numRecords() == 40, "capture: records after close()");
+}
+
+/** Read all of the text trace at 'path'. */
+std::vector<BranchRecord>
+readText(const std::string &path)
+{
+    TextTraceReader reader(path);
+    std::vector<BranchRecord> recs(4096);
+    size_t n = 0, got;
+    while ((got = reader.read(&recs[n], recs.size() - n)) != 0) {
+        n += got;
+        recs.resize(n + 4096);
+    }
+    recs.resize(n);
+    return recs;
+}
+
+void
+checkCompressed(const std::vector<BranchRecord> &trace)
+{
+    std::string text;
+    char line[64];
+    for (size_t i = 0; i < trace.size(); i++) {
+        std::snprintf(line, sizeof(line), "%llx %d %d %u\n",
+                      (unsigned long long)trace[i].pc, trace[i].taken,
+                      trace[i].conditional, trace[i].instGap);
+        text += line;
+    }
+
+    std::string plain = scratchPath("trace.txt");
+    writeFile(plain, text);
+
+    // two gzip members, which must read as one stream
+    std::string gz = scratchPath("trace.txt.gz");
+    size_t split = text.size() / 2;
+    const char *modes[2] = { "wb", "ab" };
+    for (unsigned m = 0; m < 2; m++) {
+        gzFile out = gzopen(gz.c_str(), modes[m]);
+        size_t begin = m ? split : 0;
+        size_t end = m ? text.size() : split;
+        gzwrite(out, text.data() + begin, end - begin);
+        gzclose(out);
+    }
+
+    std::string xz = scratchPath("trace.txt.xz");
+    std::vector<uint8_t> packed(lzma_stream_buffer_bound(text.size()));
+    size_t packed_size = 0;
+    lzma_easy_buffer_encode(1, LZMA_CHECK_CRC32, NULL,
+                            (const uint8_t *)text.data(), text.size(),
+                            &packed[0], &packed_size, packed.size());
+    writeFile(xz, std::string((const char *)&packed[0], packed_size));
+
+    std::vector<BranchRecord> from_plain = readText(plain);
+    check(from_plain.size() == trace.size() &&
+          sameRecords(&from_plain[0], &trace[0], trace.size()),
+          "compress: plain text trace");
+    std::vector<BranchRecord> from_gz = readText(gz);
+    check(from_gz.size() == trace.size() &&
+          sameRecords(&from_gz[0], &trace[0], trace.size()),
+          "compress: gzip text trace");
+    std::vector<BranchRecord> from_xz = readText(xz);
+    check(from_xz.size() == trace.size() &&
+          sameRecords(&from_xz[0], &trace[0], trace.size()),
+          "compress: xz text trace");
+}
+
+void
+removeScratch()
+{
+    DIR *dir = opendir(scratch.c_str());
+    if (!dir)
+        return;
+    while (struct dirent *entry = readdir(dir)) {
+        if (std::strcmp(entry->d_name, ".") != 0 &&
+            std::strcmp(entry->d_name, "..") != 0)
+            unlink((scratch + "/" + entry->d_name).c_str());
+    }
+    closedir(dir);
+    rmdir(scratch.c_str());
+}
+
+} // anonymous namespace
+
+int
+main()
+{
+    char dir[] = "/tmp/replay_test.XXXXXX";
+    if (!mkdtemp(dir))
+        fatal("Cannot create a scratch directory.\n");
+    scratch = dir;
+
+    std::vector<BranchRecord> trace = generateTrace(200000);
+
+    checkBatch<GshareBP>("predType=gshare", trace);
+    checkBatch<GshareBP>("predType=gshare localPredictorSize=4096 "
+                         "globalHistoryLength=40", trace);
+    checkBatch<GshareBP>("predType=gshare loopPredictorEntries=64",
+                         trace);
+    checkBatch<GskewBP>("predType=gskew", trace);
+    checkBatch<YagsBP>("predType=yags", trace);
+    checkBatch<YagsBP>("predType=yags yagsAssociativity=4 "
+                       "yagsReplacement=plru loopPredictorEntries=32",
+                       trace);
+    checkBatch<PerceptronBP>("predType=perceptron", trace);
+
+    std::vector<std::string> lanes;
+    lanes.push_back("predType=gshare");
+    lanes.push_back("predType=gshare localPredictorSize=256");
+    lanes.push_back("predType=gshare localPredictorSize=65536");
+    lanes.push_back("predType=gshare localCtrBits=1");
+    lanes.push_back("predType=gshare localCtrBits=3 instShiftAmt=0");
+    lanes.push_back("predType=gshare localCtrBits=4 "
+                    "localPredictorSize=16384");
+    checkLanes(lanes, trace);
+
+    // the lanes model none of these, so bp_sweep must not use them
+    const char *no_lanes[] = {
+        "predType=yags",
+        "predType=gshare globalHistoryLength=40",
+        "predType=gshare loopPredictorEntries=64",
+        "predType=gshare mispredictProfile=profile.txt",
+        "predType=gshare branchTraceFile=trace.bpt",
+        "predType=gshare trackAliasing=1",
+    };
+    for (size_t i = 0; i < sizeof(no_lanes) / sizeof(no_lanes[0]); i++)
+        check(!GshareLanes::supports(makeConfig(no_lanes[i])),
+              std::string("lanes: sweep would use lanes for ") +
+              no_lanes[i]);
+
+    checkSnapshot("predType=gshare loopPredictorEntries=64", trace);
+    checkSnapshot("predType=gskew", trace);
+    checkSnapshot("predType=yags yagsAssociativity=2", trace);
+    checkSnapshot("predType=tage", trace);
+    checkSnapshot("predType=perceptron", trace);
+
+    checkTrace(trace);
+    checkCapture(trace);
+    checkCompressed(trace);
+
+    removeScratch();
+    if (failures) {
+        std::printf("%u checks failed\n", failures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
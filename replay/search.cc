@@ -0,0 +1,430 @@
+/* @file
+ * bp_search: find the predictor configurations with the lowest MPKI
+ * for their storage, within a storage budget.
+ *
+ * Usage: bp_search --budget=BITS [--threads=N] [--prefix=N] [--eta=N]
+ *                  [--limit=N] [--window=N] [--configs=FILE]
+ *                  [--output=FILE]
+ *                  [name=v1,v2,... ...] [+ name=v1,... ...]
+ *                  <trace> [<trace> ...]
+ *
+ * Candidates are given as for bp_sweep. Without any, the search covers
+ * gshare (localPredictorSize, localCtrBits) and YAGS
+ * (choicePredictorSize, globalPredictorSize, both counter widths,
+ * yagsAssociativity and yagsTagLength) at power-of-two table sizes.
+ * Every candidate is built once to read its exact storageBits() (the
+ * counters, tags, replacement state and history registers), and those
+ * over --budget bits are dropped before anything is replayed.
+ *
+ * The rest are ranked by successive halving on trace prefixes: the
+ * first round replays the first --prefix records of every trace
+ * through every candidate, and each later round keeps the best
+ * 1 / --eta of the candidates and replays --eta times as many records,
+ * until the traces (or --limit records of each) run out. A predictor
+ * keeps its state from round to round, so a round only replays the
+ * records its prefix adds, and the final round has replayed the whole
+ * traces. Candidates are ranked by Pareto front of storage and MPKI,
+ * then by MPKI within a front, and a round never drops a candidate of
+ * the first front: a small configuration that is the best at its size
+ * survives next to the large ones.
+ *
+ * Each (candidate, trace) pair replays a window of --window records as
+ * one task of a work-stealing pool, while other tasks decode the
+ * next window (trace_windows.hh). The MPKI of a candidate is its mean
+ * over the traces; a trace without instruction counts (see
+ * branchTraceFile) counts mispredictions per thousand branches
+ * instead.
+ *
+ * The output is the Pareto front of the final round, by storage.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "branch_replay.hh"
+#include "cpu/pred/gshare.hh"
+#include "cpu/pred/gskew.hh"
+#include "cpu/pred/perceptron.hh"
+#include "cpu/pred/tage.hh"
+#include "cpu/pred/yags.hh"
+#include "predictor_factory.hh"
+#include "trace_source.hh"
+#include "trace_windows.hh"
+#include "work_pool.hh"
+
+namespace
+{
+
+/** Candidates searched when none are given, as bp_sweep groups. */
+const char *const defaultSpace[] = {
+    "predType=gshare "
+    "localPredictorSize=256,512,1024,2048,4096,8192,16384,32768,65536,"
+    "131072,262144,524288,1048576 localCtrBits=1,2,3",
+    "predType=yags "
+    "choicePredictorSize=256,1024,4096,16384,65536 "
+    "globalPredictorSize=256,512,1024,2048,4096,8192,16384,32768,65536 "
+    "choiceCtrBits=2,3 globalCtrBits=2,3 yagsAssociativity=1,2,4 "
+    "yagsTagLength=4,6,8,10,12",
+};
+
+/** One predictor and the replay of one trace through it. */
+class TraceRun
+{
+  public:
+    virtual ~TraceRun() { }
+    virtual void replay(const BranchRecord *recs, size_t count) = 0;
+    virtual const ReplayResults &getResults() const = 0;
+    virtual uint64_t storageBits() const = 0;
+};
+
+template <class Predictor>
+class BatchRun : public TraceRun
+{
+  public:
+    BatchRun(Predictor *bp)
+        : bp(bp), replayer(*bp)
+    { }
+
+    void
+    replay(const BranchRecord *recs, size_t count)
+    {
+        replayer.replay(recs, count);
+    }
+
+    const ReplayResults &getResults() const
+    {
+        return replayer.getResults();
+    }
+
+    uint64_t storageBits() const { return bp->storageBits(); }
+
+  private:
+    std::unique_ptr<Predictor> bp;
+    BatchReplay<Predictor> replayer;
+};
+
+/** TAGE replays through the hooks. */
+class TageRun : public TraceRun
+{
+  public:
+    TageRun(TageBP *bp)
+        : bp(bp), replayer(*bp)
+    { }
+
+    void
+    replay(const BranchRecord *recs, size_t count)
+    {
+        for (size_t i = 0; i < count; i++)
+            replayer.replay(recs[i]);
+    }
+
+    const ReplayResults &getResults() const
+    {
+        return replayer.getResults();
+    }
+
+    uint64_t storageBits() const { return bp->storageBits(); }
+
+  private:
+    std::unique_ptr<TageBP> bp;
+    BranchReplay replayer;
+};
+
+TraceRun *
+createRun(const PredictorConfig &config)
+{
+    BPredUnit *bp = config.create();
+    if (GshareBP *gshare = dynamic_cast<GshareBP *>(bp))
+        return new BatchRun<GshareBP>(gshare);
+    if (YagsBP *yags = dynamic_cast<YagsBP *>(bp))
+        return new BatchRun<YagsBP>(yags);
+    if (GskewBP *gskew = dynamic_cast<GskewBP *>(bp))
+        return new BatchRun<GskewBP>(gskew);
+    if (PerceptronBP *perceptron = dynamic_cast<PerceptronBP *>(bp))
+        return new BatchRun<PerceptronBP>(perceptron);
+    if (TageBP *tage = dynamic_cast<TageBP *>(bp))
+        return new TageRun(tage);
+    fatal("Predictor type '%s' has no storage model.\n",
+          config.predType.c_str());
+}
+
+/** A candidate configuration and its replay of each trace. */
+struct Candidate
+{
+    PredictorConfig config;
+    uint64_t storage;
+    std::vector<std::unique_ptr<TraceRun> > runs;
+    /** Mean MPKI over the traces after the last round. */
+    double mpki;
+    /** Pareto front, 0 for the non-dominated candidates. */
+    unsigned front;
+};
+
+/** MPKI, or mispredictions per thousand branches without
+ *  instruction counts. */
+double
+traceMpki(const ReplayResults &res)
+{
+    if (res.instructions)
+        return res.mpki();
+    return res.branches ? 1000.0 * res.mispredicts / res.branches : 0.0;
+}
+
+/**
+ * Set the front of every candidate: front 0 has no candidate with at
+ * most its storage and a lower MPKI, front 1 would have none without
+ * front 0, and so on.
+ */
+void
+rankFronts(std::vector<Candidate *> &cands)
+{
+    std::sort(cands.begin(), cands.end(),
+              [](const Candidate *a, const Candidate *b) {
+                  return a->storage != b->storage ? a->storage < b->storage :
+                      a->mpki < b->mpki;
+              });
+    std::vector<Candidate *> left(cands);
+    for (unsigned front = 0; !left.empty(); front++) {
+        std::vector<Candidate *> rest;
+        double best = std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i < left.size(); i++) {
+            if (left[i]->mpki < best) {
+                best = left[i]->mpki;
+                left[i]->front = front;
+            } else {
+                rest.push_back(left[i]);
+            }
+        }
+        left.swap(rest);
+    }
+}
+
+/**
+ * Replay the records of trace 't' up to record 'end' through the runs
+ * of 'cands', one window at a time.
+ */
+void
+replayUpTo(WorkPool &pool, TraceWindows &trace, unsigned t, uint64_t end,
+           uint64_t window, const std::vector<Candidate *> &cands)
+{
+    std::vector<BranchRecord> bufs[2];
+    std::vector<WorkPool::Task> tasks;
+    unsigned cur = 0;
+
+    if (trace.decoded() < end)
+        trace.decodeTasks(bufs[cur], std::min(window, end - trace.decoded()),
+                          tasks);
+    pool.run(tasks);
+    while (!bufs[cur].empty()) {
+        const BranchRecord *recs = &bufs[cur][0];
+        size_t count = bufs[cur].size();
+        for (size_t i = 0; i < cands.size(); i++) {
+            TraceRun *run = cands[i]->runs[t].get();
+            tasks.push_back([run, recs, count] { run->replay(recs, count); });
+        }
+        bufs[cur ^ 1].clear();
+        if (trace.decoded() < end)
+            trace.decodeTasks(bufs[cur ^ 1],
+                              std::min(window, end - trace.decoded()), tasks);
+        pool.run(tasks);
+        cur ^= 1;
+    }
+}
+
+void
+usage(const char *prog)
+{
+    std::fprintf(stderr,
+                 "usage: %s --budget=BITS [--threads=N] [--prefix=N] "
+                 "[--eta=N] [--limit=N] [--window=N]\n"
+                 "       [--configs=FILE] [--output=FILE] "
+                 "[name=v1,v2,... ...] [+ name=v1,... ...]\n"
+                 "       <trace> [<trace> ...]\n", prog);
+    std::exit(2);
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char **argv)
+{
+    std::vector<PredictorConfig> configs;
+    std::vector<std::string> group;
+    std::vector<std::string> trace_paths;
+    std::string output_path;
+    unsigned threads = 0;
+    uint64_t budget = 0;
+    uint64_t prefix = 1000000;
+    unsigned eta = 3;
+    uint64_t limit = UINT64_MAX;
+    uint64_t window = 4 * 1024 * 1024;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 9, "--budget=") == 0) {
+            budget = std::strtoull(arg.c_str() + 9, NULL, 0);
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            threads = std::strtoul(arg.c_str() + 10, NULL, 0);
+        } else if (arg.compare(0, 9, "--prefix=") == 0) {
+            prefix = std::strtoull(arg.c_str() + 9, NULL, 0);
+        } else if (arg.compare(0, 6, "--eta=") == 0) {
+            eta = std::strtoul(arg.c_str() + 6, NULL, 0);
+        } else if (arg.compare(0, 8, "--limit=") == 0) {
+            limit = std::strtoull(arg.c_str() + 8, NULL, 0);
+        } else if (arg.compare(0, 9, "--window=") == 0) {
+            window = std::strtoull(arg.c_str() + 9, NULL, 0);
+        } else if (arg.compare(0, 10, "--configs=") == 0) {
+            readConfigFile(arg.substr(10), configs);
+        } else if (arg.compare(0, 9, "--output=") == 0) {
+            output_path = arg.substr(9);
+        } else if (arg == "+") {
+            if (!group.empty())
+                expandConfigs(group, configs);
+            group.clear();
+        } else if (arg.compare(0, 2, "--") != 0 &&
+                   arg.find('=') != std::string::npos) {
+            group.push_back(arg);
+        } else if (arg.compare(0, 2, "--") != 0) {
+            trace_paths.push_back(arg);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (!group.empty())
+        expandConfigs(group, configs);
+    if (trace_paths.empty() || !budget || !prefix || eta < 2 || !window)
+        usage(argv[0]);
+    if (configs.empty()) {
+        for (size_t i = 0; i < sizeof(defaultSpace) / sizeof(*defaultSpace);
+             i++) {
+            std::vector<std::string> words;
+            std::string space = defaultSpace[i];
+            size_t pos = 0;
+            while (pos < space.size()) {
+                size_t end = space.find(' ', pos);
+                if (end == std::string::npos)
+                    end = space.size();
+                words.push_back(space.substr(pos, end - pos));
+                pos = end + 1;
+            }
+            expandConfigs(words, configs);
+        }
+    }
+    // one predictor per configuration and trace
+    checkOutputFiles(configs, trace_paths.size());
+
+    FILE *out = stdout;
+    if (!output_path.empty() && !(out = std::fopen(output_path.c_str(), "w")))
+        fatal("Cannot open output file '%s'.\n", output_path.c_str());
+
+    // build each candidate's first predictor for its storage, and the
+    // others only if it is within the budget
+    std::vector<std::unique_ptr<Candidate> > all;
+    for (size_t i = 0; i < configs.size(); i++) {
+        std::unique_ptr<TraceRun> first(createRun(configs[i]));
+        if (first->storageBits() > budget)
+            continue;
+        Candidate *cand = new Candidate;
+        cand->config = configs[i];
+        cand->storage = first->storageBits();
+        cand->runs.push_back(std::move(first));
+        for (size_t t = 1; t < trace_paths.size(); t++)
+            cand->runs.push_back(
+                std::unique_ptr<TraceRun>(createRun(configs[i])));
+        cand->mpki = 0;
+        cand->front = 0;
+        all.push_back(std::unique_ptr<Candidate>(cand));
+    }
+    std::fprintf(out, "# %zu traces; %zu candidates, %zu within %llu bits\n",
+                 trace_paths.size(), configs.size(), all.size(),
+                 (unsigned long long)budget);
+    if (all.empty()) {
+        if (out != stdout)
+            std::fclose(out);
+        return 1;
+    }
+
+    WorkPool pool(threads);
+    std::vector<std::unique_ptr<TraceWindows> > traces;
+    for (size_t t = 0; t < trace_paths.size(); t++)
+        traces.push_back(std::unique_ptr<TraceWindows>(
+            new TraceWindows(trace_paths[t], limit)));
+
+    std::vector<Candidate *> live;
+    for (size_t i = 0; i < all.size(); i++)
+        live.push_back(all[i].get());
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t end = prefix;
+    for (unsigned round = 0;; round++) {
+        bool last = true;
+        uint64_t records = 0;
+        for (size_t t = 0; t < traces.size(); t++) {
+            replayUpTo(pool, *traces[t], t, end, window, live);
+            last = last && traces[t]->ended();
+            records = std::max(records, traces[t]->decoded());
+        }
+
+        for (size_t i = 0; i < live.size(); i++) {
+            double sum = 0;
+            for (size_t t = 0; t < traces.size(); t++)
+                sum += traceMpki(live[i]->runs[t]->getResults());
+            live[i]->mpki = sum / traces.size();
+        }
+        rankFronts(live);
+        std::fprintf(out, "# round %u: %zu candidates on up to %llu "
+                     "records per trace\n", round, live.size(),
+                     (unsigned long long)records);
+        if (last)
+            break;
+
+        // keep the best 1/eta, and at least the whole first front
+        std::stable_sort(live.begin(), live.end(),
+                         [](const Candidate *a, const Candidate *b) {
+                             return a->front != b->front ?
+                                 a->front < b->front : a->mpki < b->mpki;
+                         });
+        size_t keep = (live.size() + eta - 1) / eta;
+        while (keep < live.size() && live[keep]->front == 0)
+            keep++;
+        for (size_t i = keep; i < live.size(); i++)
+            live[i]->runs.clear();
+        live.resize(keep);
+
+        // the last round replays the rest of the traces
+        end = live.size() == 1 || end > UINT64_MAX / eta ? UINT64_MAX :
+            end * eta;
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(stop - start).count();
+
+    for (size_t t = 0; t < trace_paths.size(); t++) {
+        if (!live[0]->runs[t]->getResults().instructions)
+            std::fprintf(out, "# trace %s has no instruction counts; its "
+                         "mpki is per thousand branches\n",
+                         trace_paths[t].c_str());
+    }
+    std::fprintf(out, "# Pareto front in %.3f s on %u threads\n", secs,
+                 pool.size());
+    std::fprintf(out, "%14s %10s %9s  %s\n", "storage_bits", "KiB", "mpki",
+                 "config");
+    for (size_t i = 0; i < live.size(); i++) {
+        if (live[i]->front != 0)
+            continue;
+        std::fprintf(out, "%14llu %10.2f %9.4f  %s\n",
+                     (unsigned long long)live[i]->storage,
+                     live[i]->storage / 8192.0, live[i]->mpki,
+                     live[i]->config.describe().c_str());
+    }
+    if (out != stdout)
+        std::fclose(out);
+
+    return 0;
+}
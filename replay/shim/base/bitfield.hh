@@ -0,0 +1,41 @@
+/* @file
+ * Minimal stand-in for gem5's base/bitfield.hh, used by the standalone
+ * branch replay harness.
+ */
+
+#ifndef __REPLAY_SHIM_BASE_BITFIELD_HH__
+#define __REPLAY_SHIM_BASE_BITFIELD_HH__
+
+#include <cstdint>
+
+/** Generate a 64-bit mask of 'nbits' 1s, right justified. */
+inline uint64_t
+mask(int nbits)
+{
+    return (nbits == 64) ? (uint64_t)-1LL : (1ULL << nbits) - 1;
+}
+
+/** Extract the bitfield from position 'first' to 'last' (inclusive). */
+template <class T>
+inline T
+bits(T val, int first, int last)
+{
+    int nbits = first - last + 1;
+    return (val >> last) & mask(nbits);
+}
+
+/** Returns the bit position of the LSB that is set in the input. */
+inline int
+findLsbSet(uint64_t val)
+{
+    return val ? __builtin_ctzll(val) : 64;
+}
+
+/** Returns the number of set ones in the provided value. */
+inline int
+popCount(uint64_t val)
+{
+    return __builtin_popcountll(val);
+}
+
+#endif // __REPLAY_SHIM_BASE_BITFIELD_HH__
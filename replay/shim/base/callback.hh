@@ -0,0 +1,30 @@
+/* @file
+ * Minimal stand-in for gem5's base/callback.hh, used by the standalone
+ * branch replay harness.
+ */
+
+#ifndef __REPLAY_SHIM_BASE_CALLBACK_HH__
+#define __REPLAY_SHIM_BASE_CALLBACK_HH__
+
+class Callback
+{
+  public:
+    virtual ~Callback() { }
+    virtual void process() = 0;
+};
+
+template <class T, void (T::* F)()>
+class MakeCallback : public Callback
+{
+  private:
+    T *object;
+
+  public:
+    MakeCallback(T *o)
+        : object(o)
+    { }
+
+    void process() { (object->*F)(); }
+};
+
+#endif // __REPLAY_SHIM_BASE_CALLBACK_HH__
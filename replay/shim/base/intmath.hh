@@ -0,0 +1,36 @@
+/* @file
+ * Minimal stand-in for gem5's base/intmath.hh, used by the standalone
+ * branch replay harness.
+ */
+
+#ifndef __REPLAY_SHIM_BASE_INTMATH_HH__
+#define __REPLAY_SHIM_BASE_INTMATH_HH__
+
+#include <cstdint>
+
+template <class T>
+inline bool
+isPowerOf2(const T& n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+inline int
+floorLog2(uint64_t x)
+{
+    int y = 0;
+    while (x >>= 1)
+        y++;
+    return y;
+}
+
+template <class T>
+inline int
+ceilLog2(const T& n)
+{
+    if (n == 1)
+        return 0;
+    return floorLog2(n - (T)1) + 1;
+}
+
+#endif // __REPLAY_SHIM_BASE_INTMATH_HH__
@@ -0,0 +1,29 @@
+/* @file
+ * Minimal stand-in for gem5's base/misc.hh (fatal/panic/warn), used by
+ * the standalone branch replay harness.
+ */
+
+#ifndef __REPLAY_SHIM_BASE_MISC_HH__
+#define __REPLAY_SHIM_BASE_MISC_HH__
+
+#include <cstdio>
+#include <cstdlib>
+
+#define fatal(...)                                                  \
+    do {                                                            \
+        std::fprintf(stderr, "fatal: " __VA_ARGS__);                \
+        std::exit(1);                                               \
+    } while (0)
+
+#define panic(...)                                                  \
+    do {                                                            \
+        std::fprintf(stderr, "panic: " __VA_ARGS__);                \
+        std::abort();                                               \
+    } while (0)
+
+#define warn(...)                                                   \
+    do {                                                            \
+        std::fprintf(stderr, "warn: " __VA_ARGS__);                 \
+    } while (0)
+
+#endif // __REPLAY_SHIM_BASE_MISC_HH__
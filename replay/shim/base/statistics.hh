@@ -0,0 +1,95 @@
+/* @file
+ * Minimal stand-in for gem5's base/statistics.hh, used by the
+ * standalone branch replay harness. Only Stats::Value bound to a
+ * counter with scalar() is provided; every named Value is listed by
+ * Stats::dump() in the "name value # desc" format of stats.txt.
+ */
+
+#ifndef __REPLAY_SHIM_BASE_STATISTICS_HH__
+#define __REPLAY_SHIM_BASE_STATISTICS_HH__
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Stats
+{
+
+class Value;
+
+inline std::vector<Value *> &
+registry()
+{
+    static std::vector<Value *> values;
+    return values;
+}
+
+class Value
+{
+  public:
+    Value()
+        : source(NULL), read(NULL)
+    {
+        registry().push_back(this);
+    }
+
+    ~Value()
+    {
+        std::vector<Value *> &values = registry();
+        values.erase(std::find(values.begin(), values.end(), this));
+    }
+
+    /** Report the current value of 'value', which must outlive this. */
+    template <class T>
+    Value &
+    scalar(T &value)
+    {
+        source = &value;
+        read = &readScalar<T>;
+        return *this;
+    }
+
+    Value &name(const std::string &name) { _name = name; return *this; }
+    Value &desc(const std::string &desc) { _desc = desc; return *this; }
+
+    const std::string &name() const { return _name; }
+    const std::string &desc() const { return _desc; }
+    double value() const { return read ? read(source) : 0; }
+
+  private:
+    Value(const Value &);
+    Value &operator=(const Value &);
+
+    template <class T>
+    static double readScalar(const void *value)
+    {
+        return *static_cast<const T *>(value);
+    }
+
+    const void *source;
+    double (*read)(const void *);
+    std::string _name;
+    std::string _desc;
+};
+
+/** Write every named statistic, in registration order. */
+inline void
+dump(std::ostream &os)
+{
+    const std::vector<Value *> &values = registry();
+    for (size_t i = 0; i < values.size(); i++) {
+        if (values[i]->name().empty())
+            continue;
+        char line[256];
+        std::snprintf(line, sizeof(line), "%-40s %14.0f # %s\n",
+                      values[i]->name().c_str(), values[i]->value(),
+                      values[i]->desc().c_str());
+        os << line;
+    }
+}
+
+} // namespace Stats
+
+#endif // __REPLAY_SHIM_BASE_STATISTICS_HH__
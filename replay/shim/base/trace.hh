@@ -0,0 +1,11 @@
+/* @file
+ * Minimal stand-in for gem5's base/trace.hh, used by the standalone
+ * branch replay harness. Debug output is compiled out.
+ */
+
+#ifndef __REPLAY_SHIM_BASE_TRACE_HH__
+#define __REPLAY_SHIM_BASE_TRACE_HH__
+
+#define DPRINTF(flag, ...) do { } while (0)
+
+#endif // __REPLAY_SHIM_BASE_TRACE_HH__
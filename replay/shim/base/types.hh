@@ -0,0 +1,21 @@
+/* @file
+ * Minimal stand-in for gem5's base/types.hh, used by the standalone
+ * branch replay harness.
+ */
+
+#ifndef __REPLAY_SHIM_BASE_TYPES_HH__
+#define __REPLAY_SHIM_BASE_TYPES_HH__
+
+#include <cstdint>
+
+#define ULL(N) ((uint64_t)N##ULL)
+#define LL(N) ((int64_t)N##LL)
+
+typedef uint64_t Addr;
+typedef uint64_t Tick;
+typedef uint64_t Counter;
+typedef int16_t ThreadID;
+
+const ThreadID InvalidThreadID = (ThreadID)-1;
+
+#endif // __REPLAY_SHIM_BASE_TYPES_HH__
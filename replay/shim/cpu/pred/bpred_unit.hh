@@ -0,0 +1,102 @@
+/* @file
+ * Stand-in for gem5's cpu/pred/bpred_unit.hh, used by the standalone
+ * branch replay harness. Only the direction predictor hooks and the
+ * parameters read by the predictors in this directory are provided;
+ * BTB, RAS and the per-instruction history bookkeeping of the real
+ * BPredUnit are the replay driver's job.
+ */
+
+#ifndef __REPLAY_SHIM_CPU_PRED_BPRED_UNIT_HH__
+#define __REPLAY_SHIM_CPU_PRED_BPRED_UNIT_HH__
+
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "base/misc.hh"
+#include "base/types.hh"
+#include "sim/serialize.hh"
+
+/** The subset of gem5's generated BranchPredictorParams we rely on. */
+struct BranchPredictorParams
+{
+    BranchPredictorParams()
+        : name("bp"), numThreads(1), instShiftAmt(2),
+          localPredictorSize(2048), localCtrBits(2),
+          globalPredictorSize(8192), globalCtrBits(2),
+          choicePredictorSize(8192), choiceCtrBits(2),
+          historyCheckpoints(256), yagsAssociativity(1), yagsTagLength(8),
+          yagsReplacement("lru"), tableHugePages(false),
+          trackAliasing(false), profileEntries(4096), profileTop(50),
+          threadIndexSalt(false), tageTables(7), tageTableSize(1024),
+          tageTagLength(9), tageCtrBits(3), tageMinHistory(5),
+          tageMaxHistory(130), globalHistoryLength(0),
+          perceptronHistoryLength(64), perceptronTableSize(1024),
+          gskewBankSize(2048), loopPredictorEntries(0)
+    { }
+
+    std::string name;
+    unsigned numThreads;
+    unsigned instShiftAmt;
+    unsigned localPredictorSize;
+    unsigned localCtrBits;
+    unsigned globalPredictorSize;
+    unsigned globalCtrBits;
+    unsigned choicePredictorSize;
+    unsigned choiceCtrBits;
+    unsigned historyCheckpoints;
+    unsigned yagsAssociativity;
+    unsigned yagsTagLength;
+    std::string yagsReplacement;
+    bool tableHugePages;
+    bool trackAliasing;
+    std::string branchTraceFile;
+    std::string mispredictProfile;
+    unsigned profileEntries;
+    unsigned profileTop;
+    bool threadIndexSalt;
+    unsigned tageTables;
+    unsigned tageTableSize;
+    unsigned tageTagLength;
+    unsigned tageCtrBits;
+    unsigned tageMinHistory;
+    unsigned tageMaxHistory;
+    unsigned globalHistoryLength;
+    unsigned perceptronHistoryLength;
+    unsigned perceptronTableSize;
+    unsigned gskewBankSize;
+    unsigned loopPredictorEntries;
+};
+
+class BPredUnit : public Serializable
+{
+  public:
+    typedef BranchPredictorParams Params;
+
+    BPredUnit(const Params *params)
+        : _name(params->name)
+    { }
+
+    virtual ~BPredUnit() { }
+
+    const std::string &name() const { return _name; }
+
+    /** Register statistics; called once, after construction. */
+    virtual void regStats() { }
+
+    virtual void uncondBranch(ThreadID tid, Addr pc,
+                              void * &bp_history) = 0;
+    virtual bool lookup(ThreadID tid, Addr instPC, void * &bp_history) = 0;
+    virtual void btbUpdate(ThreadID tid, Addr instPC,
+                           void * &bp_history) = 0;
+    virtual void update(ThreadID tid, Addr instPC, bool taken,
+                        void *bp_history, bool squashed) = 0;
+    virtual void squash(ThreadID tid, void *bp_history) = 0;
+    virtual void retireSquashed(ThreadID tid, void *bp_history) { }
+
+  private:
+    std::string _name;
+};
+
+#endif // __REPLAY_SHIM_CPU_PRED_BPRED_UNIT_HH__
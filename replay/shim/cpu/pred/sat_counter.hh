@@ -0,0 +1,68 @@
+/* @file
+ * Stand-in for gem5's cpu/pred/sat_counter.hh, used by the standalone
+ * branch replay harness. Behaviour matches the gem5 class exactly.
+ */
+
+#ifndef __REPLAY_SHIM_CPU_PRED_SAT_COUNTER_HH__
+#define __REPLAY_SHIM_CPU_PRED_SAT_COUNTER_HH__
+
+#include <cstdint>
+
+/**
+ * Private counter class for the internal saturating counters.
+ * Implements an n bit saturating counter and provides methods to
+ * increment, decrement, and read it.
+ */
+class SatCounter
+{
+  public:
+    /** Constructor for the counter. */
+    SatCounter()
+        : initialVal(0), counter(0)
+    { }
+
+    /** Constructor for the counter.
+     *  @param bits How many bits the counter will have.
+     */
+    SatCounter(unsigned bits)
+        : initialVal(0), maxVal((1 << bits) - 1), counter(0)
+    { }
+
+    /** Constructor for the counter.
+     *  @param bits How many bits the counter will have.
+     *  @param initial_val Starting value for each counter.
+     */
+    SatCounter(unsigned bits, uint8_t initial_val)
+        : initialVal(initial_val), maxVal((1 << bits) - 1),
+          counter(initial_val)
+    { }
+
+    /** Sets the number of bits. */
+    void setBits(unsigned bits) { maxVal = (1 << bits) - 1; }
+
+    void reset() { counter = initialVal; }
+
+    /** Increments the counter's current value. */
+    void increment()
+    {
+        if (counter < maxVal)
+            ++counter;
+    }
+
+    /** Decrements the counter's current value. */
+    void decrement()
+    {
+        if (counter > 0)
+            --counter;
+    }
+
+    /** Read the counter's value. */
+    uint8_t read() const { return counter; }
+
+  private:
+    uint8_t initialVal;
+    uint8_t maxVal;
+    uint8_t counter;
+};
+
+#endif // __REPLAY_SHIM_CPU_PRED_SAT_COUNTER_HH__
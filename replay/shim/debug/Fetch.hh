@@ -0,0 +1,9 @@
+/* @file
+ * Minimal stand-in for gem5's generated debug/Fetch.hh, used by the
+ * standalone branch replay harness; its DPRINTF ignores the flag.
+ */
+
+#ifndef __REPLAY_SHIM_DEBUG_FETCH_HH__
+#define __REPLAY_SHIM_DEBUG_FETCH_HH__
+
+#endif // __REPLAY_SHIM_DEBUG_FETCH_HH__
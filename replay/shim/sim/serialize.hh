@@ -0,0 +1,93 @@
+/* @file
+ * Minimal stand-in for gem5's sim/serialize.hh: the Serializable
+ * interface, a Checkpoint holding "section.entry" values and the
+ * paramOut/paramIn helpers, used by the standalone branch replay
+ * harness.
+ */
+
+#ifndef __REPLAY_SHIM_SIM_SERIALIZE_HH__
+#define __REPLAY_SHIM_SIM_SERIALIZE_HH__
+
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+#include "base/misc.hh"
+
+class Checkpoint
+{
+  public:
+    Checkpoint(const std::string &cpt_dir)
+        : cptDir(cpt_dir)
+    { }
+
+    /** Directory the checkpoint being written goes to. */
+    static std::string dir() { return currentDir(); }
+    static void setDir(const std::string &dir) { currentDir() = dir; }
+
+    bool
+    find(const std::string &section, const std::string &entry,
+         std::string &value) const
+    {
+        std::map<std::string, std::string>::const_iterator it =
+            entries.find(section + "." + entry);
+        if (it == entries.end())
+            return false;
+        value = it->second;
+        return true;
+    }
+
+    /** Set 'section.entry', as read from a checkpoint file. */
+    void
+    set(const std::string &section, const std::string &entry,
+        const std::string &value)
+    {
+        entries[section + "." + entry] = value;
+    }
+
+    const std::string cptDir;
+
+  private:
+    static std::string &
+    currentDir()
+    {
+        static std::string dir(".");
+        return dir;
+    }
+
+    std::map<std::string, std::string> entries;
+};
+
+class Serializable
+{
+  public:
+    virtual ~Serializable() { }
+
+    virtual void serialize(std::ostream &os) { }
+    virtual void unserialize(Checkpoint *cp, const std::string &section) { }
+};
+
+template <class T>
+void
+paramOut(std::ostream &os, const std::string &name, const T &param)
+{
+    os << name << "=" << param << "\n";
+}
+
+template <class T>
+void
+paramIn(Checkpoint *cp, const std::string &section, const std::string &name,
+        T &param)
+{
+    std::string value;
+    if (!cp->find(section, name, value))
+        fatal("Can't unserialize '%s:%s'\n", section.c_str(), name.c_str());
+    std::istringstream is(value);
+    is >> param;
+}
+
+#define SERIALIZE_SCALAR(scalar)        paramOut(os, #scalar, scalar)
+#define UNSERIALIZE_SCALAR(scalar)      paramIn(cp, section, #scalar, scalar)
+
+#endif // __REPLAY_SHIM_SIM_SERIALIZE_HH__
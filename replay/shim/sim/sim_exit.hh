@@ -0,0 +1,40 @@
+/* @file
+ * Minimal stand-in for gem5's sim/sim_exit.hh, used by the standalone
+ * branch replay harness. Exit callbacks run from atexit().
+ */
+
+#ifndef __REPLAY_SHIM_SIM_SIM_EXIT_HH__
+#define __REPLAY_SHIM_SIM_SIM_EXIT_HH__
+
+#include <cstdlib>
+#include <vector>
+
+#include "base/callback.hh"
+
+namespace SimExit
+{
+    inline std::vector<Callback *> &
+    callbacks()
+    {
+        static std::vector<Callback *> queue;
+        return queue;
+    }
+
+    inline void
+    runCallbacks()
+    {
+        for (size_t i = 0; i < callbacks().size(); i++)
+            callbacks()[i]->process();
+    }
+}
+
+/** Register a callback to be called when the simulator exits. */
+inline void
+registerExitCallback(Callback *callback)
+{
+    if (SimExit::callbacks().empty())
+        std::atexit(SimExit::runCallbacks);
+    SimExit::callbacks().push_back(callback);
+}
+
+#endif // __REPLAY_SHIM_SIM_SIM_EXIT_HH__
@@ -0,0 +1,300 @@
+/* @file
+ * bp_sweep: replay one trace through many GshareBP, GskewBP, YagsBP or
+ * PerceptronBP configurations at once and report them in one table.
+ *
+ * Usage: bp_sweep [--threads=N] [--window=N] [--limit=N] [--no-lanes]
+ *                 [--configs=FILE] [--output=FILE]
+ *                 [name=v1,v2,... ...] [+ name=v1,... ...] <trace>
+ *
+ * A group of name=value options, where a value may be a comma
+ * separated list, stands for every combination of the listed values;
+ * '+' starts another group, and each line of --configs is a group too.
+ * For example
+ *
+ *   bp_sweep predType=gshare localPredictorSize=4096,16384 \
+ *            + predType=yags yagsAssociativity=1,2,4 trace.bpt
+ *
+ * runs five configurations.
+ *
+ * The trace is decoded once, a window of --window records at a time,
+ * into a buffer all configurations read. Every configuration keeps its
+ * own predictor and replays the window through predictBatch() as one
+ * task of a work-stealing pool; the next window is decoded by tasks of
+ * the same round into a second buffer. Binary traces decode their
+ * blocks in parallel.
+ *
+ * Unless --no-lanes is given, gshare configurations that set nothing
+ * but instShiftAmt, localPredictorSize and localCtrBits (so no
+ * globalHistoryLength, loopPredictorEntries, mispredictProfile,
+ * branchTraceFile or trackAliasing, which GshareLanes does not model;
+ * see GshareLanes::supports()) are replayed GshareLanes::Width at a
+ * time by the vector kernel of gshare_lanes.hh, and the seconds
+ * reported for each is the time of its whole group.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "branch_replay.hh"
+#include "cpu/pred/gshare.hh"
+#include "cpu/pred/gskew.hh"
+#include "cpu/pred/perceptron.hh"
+#include "cpu/pred/yags.hh"
+#include "gshare_lanes.hh"
+#include "predictor_factory.hh"
+#include "trace_source.hh"
+#include "trace_windows.hh"
+#include "work_pool.hh"
+
+namespace
+{
+
+/** What replays a window as one task: one predictor or a lane group. */
+class SweepUnit
+{
+  public:
+    SweepUnit() : seconds(0) { }
+    virtual ~SweepUnit() { }
+
+    virtual void replay(const BranchRecord *recs, size_t count) = 0;
+
+    /** Thread time spent replaying. */
+    double seconds;
+};
+
+/** One row of the table. */
+struct SweepPoint
+{
+    PredictorConfig config;
+    const SweepUnit *unit;
+    std::function<ReplayResults()> results;
+};
+
+/** A predictor of its own, replayed through BatchReplay or, for
+ *  predictors without predictBatch(), BranchReplay. */
+template <class Predictor, class Replayer>
+class PredictorUnit : public SweepUnit
+{
+  public:
+    PredictorUnit(Predictor *bp)
+        : bp(bp), replayer(*bp)
+    { }
+
+    void
+    replay(const BranchRecord *recs, size_t count)
+    {
+        replayer.replay(recs, count);
+    }
+
+    const ReplayResults &getResults() const
+    {
+        return replayer.getResults();
+    }
+
+  private:
+    std::unique_ptr<Predictor> bp;
+    Replayer replayer;
+};
+
+/** Up to GshareLanes::Width gshare configurations in lockstep. */
+class LaneUnit : public SweepUnit
+{
+  public:
+    void
+    replay(const BranchRecord *recs, size_t count)
+    {
+        group.replay(recs, count);
+    }
+
+    GshareLanes group;
+};
+
+template <class Predictor, class Replayer>
+SweepUnit *
+predictorPoint(Predictor *bp, SweepPoint &point)
+{
+    PredictorUnit<Predictor, Replayer> *unit =
+        new PredictorUnit<Predictor, Replayer>(bp);
+    point.unit = unit;
+    point.results = [unit] { return unit->getResults(); };
+    return unit;
+}
+
+/**
+ * Build the units replaying 'configs', one table row each in
+ * 'points'. With 'lanes', gshare configurations share lane groups.
+ */
+void
+createUnits(const std::vector<PredictorConfig> &configs, bool lanes,
+            std::vector<std::unique_ptr<SweepUnit> > &units,
+            std::vector<SweepPoint> &points)
+{
+    LaneUnit *lane_unit = NULL;
+    points.resize(configs.size());
+    for (size_t i = 0; i < configs.size(); i++) {
+        SweepPoint &point = points[i];
+        point.config = configs[i];
+
+        if (lanes && GshareLanes::supports(configs[i])) {
+            if (!lane_unit || lane_unit->group.lanes() == GshareLanes::Width) {
+                lane_unit = new LaneUnit;
+                units.push_back(std::unique_ptr<SweepUnit>(lane_unit));
+            }
+            const GshareLanes *group = &lane_unit->group;
+            unsigned lane = lane_unit->group.addLane(configs[i].params);
+            point.unit = lane_unit;
+            point.results = [group, lane] { return group->getResults(lane); };
+            continue;
+        }
+
+        BPredUnit *bp = configs[i].create();
+        SweepUnit *unit;
+        if (GshareBP *gshare = dynamic_cast<GshareBP *>(bp))
+            unit = predictorPoint<GshareBP, BatchReplay<GshareBP> >(
+                gshare, point);
+        else if (GskewBP *gskew = dynamic_cast<GskewBP *>(bp))
+            unit = predictorPoint<GskewBP, BatchReplay<GskewBP> >(
+                gskew, point);
+        else if (YagsBP *yags = dynamic_cast<YagsBP *>(bp))
+            unit = predictorPoint<YagsBP, BatchReplay<YagsBP> >(yags, point);
+        else if (PerceptronBP *perceptron = dynamic_cast<PerceptronBP *>(bp))
+            unit = predictorPoint<PerceptronBP, BatchReplay<PerceptronBP> >(
+                perceptron, point);
+        else
+            unit = predictorPoint<BPredUnit, BranchReplay>(bp, point);
+        units.push_back(std::unique_ptr<SweepUnit>(unit));
+    }
+}
+
+void
+usage(const char *prog)
+{
+    std::fprintf(stderr,
+                 "usage: %s [--threads=N] [--window=N] [--limit=N] "
+                 "[--no-lanes] [--configs=FILE] [--output=FILE]\n"
+                 "       [name=v1,v2,... ...] [+ name=v1,... ...] <trace>\n",
+                 prog);
+    std::exit(2);
+}
+
+} // anonymous namespace
+
+int
+main(int argc, char **argv)
+{
+    std::vector<PredictorConfig> configs;
+    std::vector<std::string> group;
+    std::string trace_path;
+    std::string output_path;
+    unsigned threads = 0;
+    uint64_t window = 4 * 1024 * 1024;
+    uint64_t limit = UINT64_MAX;
+    bool lanes = true;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 10, "--threads=") == 0) {
+            threads = std::strtoul(arg.c_str() + 10, NULL, 0);
+        } else if (arg.compare(0, 9, "--window=") == 0) {
+            window = std::strtoull(arg.c_str() + 9, NULL, 0);
+        } else if (arg.compare(0, 8, "--limit=") == 0) {
+            limit = std::strtoull(arg.c_str() + 8, NULL, 0);
+        } else if (arg.compare(0, 10, "--configs=") == 0) {
+            readConfigFile(arg.substr(10), configs);
+        } else if (arg.compare(0, 9, "--output=") == 0) {
+            output_path = arg.substr(9);
+        } else if (arg == "--no-lanes") {
+            lanes = false;
+        } else if (arg == "+") {
+            if (!group.empty())
+                expandConfigs(group, configs);
+            group.clear();
+        } else if (arg.find('=') != std::string::npos) {
+            group.push_back(arg);
+        } else if (trace_path.empty()) {
+            trace_path = arg;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (!group.empty())
+        expandConfigs(group, configs);
+    if (trace_path.empty() || !window)
+        usage(argv[0]);
+    if (configs.empty())
+        configs.push_back(PredictorConfig());
+    checkOutputFiles(configs);
+
+    FILE *out = stdout;
+    if (!output_path.empty() && !(out = std::fopen(output_path.c_str(), "w")))
+        fatal("Cannot open output file '%s'.\n", output_path.c_str());
+
+    std::vector<std::unique_ptr<SweepUnit> > units;
+    std::vector<SweepPoint> points;
+    createUnits(configs, lanes, units, points);
+
+    WorkPool pool(threads);
+    TraceWindows trace(trace_path, limit);
+    std::vector<BranchRecord> bufs[2];
+    std::vector<WorkPool::Task> tasks;
+    unsigned cur = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    trace.decodeTasks(bufs[cur], window, tasks);
+    pool.run(tasks);
+    while (!bufs[cur].empty()) {
+        const BranchRecord *recs = &bufs[cur][0];
+        size_t count = bufs[cur].size();
+        for (size_t i = 0; i < units.size(); i++) {
+            SweepUnit *unit = units[i].get();
+            tasks.push_back([unit, recs, count] {
+                auto begin = std::chrono::steady_clock::now();
+                unit->replay(recs, count);
+                auto end = std::chrono::steady_clock::now();
+                unit->seconds +=
+                    std::chrono::duration<double>(end - begin).count();
+            });
+        }
+        trace.decodeTasks(bufs[cur ^ 1], window, tasks);
+        pool.run(tasks);
+        cur ^= 1;
+    }
+    auto stop = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(stop - start).count();
+
+    ReplayResults first = points[0].results();
+    std::fprintf(out, "# trace %s: %llu branches, %llu conditional, "
+                 "%llu instructions\n", trace_path.c_str(),
+                 (unsigned long long)first.branches,
+                 (unsigned long long)first.condBranches,
+                 (unsigned long long)first.instructions);
+    if (!first.instructions)
+        std::fprintf(out, "# the trace has no instruction counts (it was "
+                     "captured by a predictor?), so no mpki\n");
+    std::fprintf(out, "# %zu configurations on %u threads in %.3f s, "
+                 "%.0f branches/s\n", points.size(), pool.size(), secs,
+                 secs > 0 ? first.branches * points.size() / secs : 0);
+    std::fprintf(out, "%-4s %12s %9s %9s %9s  %s\n", "id", "mispredicts",
+                 "miss_rate", "mpki", "seconds", "config");
+    for (size_t i = 0; i < points.size(); i++) {
+        ReplayResults res = points[i].results();
+        char mpki[32] = "n/a";
+        if (res.instructions)
+            std::snprintf(mpki, sizeof(mpki), "%.4f", res.mpki());
+        std::fprintf(out, "%-4zu %12llu %9.4f %9s %9.3f  %s\n", i,
+                     (unsigned long long)res.mispredicts, res.missRate(),
+                     mpki, points[i].unit->seconds,
+                     points[i].config.describe().c_str());
+    }
+    if (out != stdout)
+        std::fclose(out);
+
+    return 0;
+}
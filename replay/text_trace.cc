@@ -0,0 +1,44 @@
+/* @file
+ * Reader for plain-text branch traces.
+ */
+
+#include "text_trace.hh"
+
+#include <cstdlib>
+
+#include "base/misc.hh"
+
+TextTraceReader::TextTraceReader(const std::string &path)
+    : lines(path)
+{
+}
+
+size_t
+TextTraceReader::read(BranchRecord *recs, size_t max)
+{
+    size_t n = 0;
+    char *line;
+
+    while (n < max && (line = lines.next())) {
+        while (*line == ' ' || *line == '\t')
+            line++;
+        if (*line == '\0' || *line == '#' || *line == '\r')
+            continue;
+
+        char *p;
+        BranchRecord &rec = recs[n];
+        rec.pc = std::strtoull(line, &p, 16);
+        unsigned long taken = std::strtoul(p, &p, 10);
+        unsigned long cond = std::strtoul(p, &p, 10);
+        char *gap_end;
+        rec.instGap = std::strtoul(p, &gap_end, 10);
+        if (gap_end == p)
+            fatal("Malformed trace line %llu.\n",
+                  (unsigned long long)lines.lineNumber());
+        rec.taken = taken != 0;
+        rec.conditional = cond != 0;
+        n++;
+    }
+
+    return n;
+}
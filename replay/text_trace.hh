@@ -0,0 +1,29 @@
+/* @file
+ * Reader for plain-text branch traces.
+ *
+ * One branch per line: "<pc> <taken> <conditional> <instGap>", where pc
+ * is hexadecimal (an optional 0x prefix is accepted) and the remaining
+ * fields are decimal. Blank lines and lines starting with '#' are
+ * ignored. The file may be gzip- or xz-compressed.
+ */
+
+#ifndef __REPLAY_TEXT_TRACE_HH__
+#define __REPLAY_TEXT_TRACE_HH__
+
+#include <string>
+
+#include "decompress_stream.hh"
+#include "trace_source.hh"
+
+class TextTraceReader : public TraceSource
+{
+  public:
+    TextTraceReader(const std::string &path);
+
+    size_t read(BranchRecord *recs, size_t max);
+
+  private:
+    LineReader lines;
+};
+
+#endif // __REPLAY_TEXT_TRACE_HH__
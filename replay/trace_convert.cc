@@ -0,0 +1,42 @@
+/* @file
+ * bp_trace_convert: convert a trace in any format the replay tools
+ * read into the binary format of bp_trace.hh.
+ *
+ * Usage: bp_trace_convert <input> <output>
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "cpu/pred/bp_trace.hh"
+#include "trace_source.hh"
+
+int
+main(int argc, char **argv)
+{
+    if (argc != 3) {
+        std::fprintf(stderr, "usage: %s <input> <output>\n", argv[0]);
+        return 2;
+    }
+
+    std::unique_ptr<TraceSource> in = openTrace(argv[1]);
+    BranchTraceWriter out(argv[2]);
+    std::vector<BranchRecord> chunk(64 * 1024);
+    size_t n;
+
+    while ((n = in->read(&chunk[0], chunk.size())) != 0)
+        out.write(&chunk[0], n);
+    out.close();
+
+    BranchTraceFile trace(argv[2]);
+    const BranchTraceHeader &hdr = trace.getHeader();
+    std::printf("records       %llu\n", (unsigned long long)hdr.recordCount);
+    std::printf("instructions  %llu\n", (unsigned long long)hdr.instCount);
+    if (hdr.recordCount && !hdr.instCount)
+        std::printf("note          no instruction counts, so no MPKI "
+                    "from this trace\n");
+    std::printf("blocks        %llu\n", (unsigned long long)hdr.blockCount);
+    std::printf("bytes/record  %.2f\n", hdr.recordCount ?
+                (double)hdr.indexOffset / hdr.recordCount : 0.0);
+    return 0;
+}
@@ -0,0 +1,84 @@
+/* @file
+ * Common interface of the trace readers used by the replay tools.
+ */
+
+#include "trace_source.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "bt9_trace.hh"
+#include "champsim_trace.hh"
+#include "decompress_stream.hh"
+#include "text_trace.hh"
+
+void
+TraceSource::skip(uint64_t count)
+{
+    std::vector<BranchRecord> buf(4096);
+    while (count) {
+        size_t n = read(&buf[0], std::min<uint64_t>(count, buf.size()));
+        if (!n)
+            break;
+        count -= n;
+    }
+}
+
+BinaryTraceSource::BinaryTraceSource(const std::string &path)
+    : trace(path), reader(trace)
+{
+    reader.setReleaseConsumed(true);
+}
+
+void
+BinaryTraceSource::skip(uint64_t count)
+{
+    reader.seek(reader.tell() + count);
+}
+
+namespace
+{
+
+/** Strip 'prefix' from the front of 'path', if it is there. */
+bool
+stripPrefix(std::string &path, const char *prefix)
+{
+    size_t len = std::strlen(prefix);
+    if (path.compare(0, len, prefix) != 0)
+        return false;
+    path.erase(0, len);
+    return true;
+}
+
+} // anonymous namespace
+
+std::unique_ptr<TraceSource>
+openTrace(const std::string &name)
+{
+    std::string path = name;
+    TraceSource *source;
+
+    if (stripPrefix(path, "champsim:")) {
+        source = new ChampSimTraceReader(path);
+    } else if (stripPrefix(path, "bt9:")) {
+        source = new Bt9TraceReader(path);
+    } else if (stripPrefix(path, "text:")) {
+        source = new TextTraceReader(path);
+    } else if (BranchTrace::isBinaryTrace(path)) {
+        source = new BinaryTraceSource(path);
+    } else {
+        size_t len = std::strlen(Bt9TraceReader::magic);
+        std::vector<char> head(len);
+        if (DecompressStream::peek(path, &head[0], len) == len &&
+            std::memcmp(&head[0], Bt9TraceReader::magic, len) == 0) {
+            source = new Bt9TraceReader(path);
+        } else if (path.find("champsim") != std::string::npos) {
+            // ChampSim records have no header; go by the file name
+            source = new ChampSimTraceReader(path);
+        } else {
+            source = new TextTraceReader(path);
+        }
+    }
+    return std::unique_ptr<TraceSource>(source);
+}
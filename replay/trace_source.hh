@@ -0,0 +1,56 @@
+/* @file
+ * Common interface of the trace readers used by the replay tools.
+ */
+
+#ifndef __REPLAY_TRACE_SOURCE_HH__
+#define __REPLAY_TRACE_SOURCE_HH__
+
+#include <memory>
+#include <string>
+
+#include "cpu/pred/bp_trace.hh"
+
+class TraceSource
+{
+  public:
+    virtual ~TraceSource() { }
+
+    /**
+     * Decode up to 'max' records into 'recs'. Returns the number of
+     * records decoded, 0 at the end of the trace.
+     */
+    virtual size_t read(BranchRecord *recs, size_t max) = 0;
+
+    /** Skip the next 'count' records. */
+    virtual void skip(uint64_t count);
+};
+
+/** Reader for the binary format of bp_trace.hh. */
+class BinaryTraceSource : public TraceSource
+{
+  public:
+    BinaryTraceSource(const std::string &path);
+
+    size_t read(BranchRecord *recs, size_t max)
+    {
+        return reader.read(recs, max);
+    }
+
+    /** Seeks through the block index instead of decoding. */
+    void skip(uint64_t count);
+
+  private:
+    BranchTraceFile trace;
+    BranchTraceReader reader;
+};
+
+/**
+ * Open a trace in any supported format: binary, text, ChampSim or BT9,
+ * the last three optionally gzip- or xz-compressed. Binary and BT9
+ * traces are recognised by their contents, ChampSim traces by a name
+ * containing "champsim"; anything else is read as text. A "champsim:",
+ * "bt9:" or "text:" prefix on 'path' forces the format.
+ */
+std::unique_ptr<TraceSource> openTrace(const std::string &path);
+
+#endif // __REPLAY_TRACE_SOURCE_HH__
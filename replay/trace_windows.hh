@@ -0,0 +1,127 @@
+/* @file
+ * Decoding of a trace a window at a time on a WorkPool, shared by the
+ * replay tools that replay one window while decoding the next.
+ *
+ * decodeTasks() appends to a round of pool tasks the decoding of the
+ * next records into a buffer; the buffer holds them once the round has
+ * run. A binary trace is decoded by one task per block of the window,
+ * each with its own reader; any other trace by one task reading it in
+ * order.
+ */
+
+#ifndef __REPLAY_TRACE_WINDOWS_HH__
+#define __REPLAY_TRACE_WINDOWS_HH__
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/misc.hh"
+#include "trace_source.hh"
+#include "work_pool.hh"
+
+class TraceWindows
+{
+  public:
+    /** Decode at most the first 'limit' records of 'path'. */
+    TraceWindows(const std::string &path, uint64_t limit)
+        : remaining(limit), done(0)
+    {
+        if (BranchTrace::isBinaryTrace(path)) {
+            binary.reset(new BranchTraceFile(path));
+            remaining = std::min(remaining, binary->numRecords());
+        } else {
+            source = openTrace(path);
+        }
+    }
+
+    /**
+     * Append to 'tasks' the decoding of the next 'count' records, or
+     * as many as are left, into 'buf'. 'buf' is sized at once and
+     * shrinks when a text trace ends early; it is empty after the end.
+     */
+    void
+    decodeTasks(std::vector<BranchRecord> &buf, uint64_t count,
+                std::vector<WorkPool::Task> &tasks)
+    {
+        buf.resize(std::min(count, remaining));
+        if (buf.empty())
+            return;
+        if (binary)
+            binaryTasks(buf, tasks);
+        else
+            sourceTask(buf, tasks);
+    }
+
+    bool ended() const { return remaining == 0; }
+
+    /** Records decoded so far, once the tasks have run. */
+    uint64_t decoded() const { return done; }
+
+  private:
+    /** One task per block the window touches. */
+    void
+    binaryTasks(std::vector<BranchRecord> &buf,
+                std::vector<WorkPool::Task> &tasks)
+    {
+        const BranchTraceFile *trace = binary.get();
+        uint64_t first = done;
+        uint64_t last = done + buf.size();
+        for (uint64_t block = trace->findBlock(first);
+             first < last; block++) {
+            uint64_t end = std::min(trace->block(block).firstRecord +
+                                    trace->blockRecords(block), last);
+            BranchRecord *dest = &buf[first - done];
+            tasks.push_back([trace, block, dest, first, end] {
+                BranchTraceReader reader(*trace, block, block + 1);
+                // a window may start part way into a block
+                if (first > trace->block(block).firstRecord)
+                    reader.seek(first);
+                size_t want = end - first;
+                size_t got = 0;
+                while (got < want) {
+                    size_t n = reader.read(dest + got, want - got);
+                    if (!n)
+                        fatal("Trace block %llu is truncated.\n",
+                              (unsigned long long)block);
+                    got += n;
+                }
+            });
+            first = end;
+        }
+        remaining -= buf.size();
+        done += buf.size();
+    }
+
+    /** Other traces decode sequentially, in one task. */
+    void
+    sourceTask(std::vector<BranchRecord> &buf,
+               std::vector<WorkPool::Task> &tasks)
+    {
+        TraceSource *src = source.get();
+        uint64_t *left = &remaining;
+        uint64_t *decoded = &done;
+        std::vector<BranchRecord> *dest = &buf;
+        tasks.push_back([src, left, decoded, dest] {
+            size_t want = dest->size();
+            size_t got = 0;
+            size_t n;
+            while (got < want &&
+                   (n = src->read(&(*dest)[got], want - got)) != 0)
+                got += n;
+            dest->resize(got);
+            // a short read is the end of the trace
+            *left = got < want ? 0 : *left - got;
+            *decoded += got;
+        });
+    }
+
+    std::unique_ptr<BranchTraceFile> binary;
+    std::unique_ptr<TraceSource> source;
+    uint64_t remaining;
+    uint64_t done;
+};
+
+#endif // __REPLAY_TRACE_WINDOWS_HH__
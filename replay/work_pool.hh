@@ -0,0 +1,144 @@
+/* @file
+ * A fixed pool of worker threads with work stealing, for the replay
+ * tools that run many independent predictor configurations.
+ *
+ * Tasks are submitted in rounds: run() deals the tasks of a round out
+ * to per-worker deques and returns when all of them have finished.
+ * Each worker takes tasks from the back of its own deque and, once it
+ * is empty, steals from the front of the others', so a round finishes
+ * close to evenly even when tasks differ widely in length.
+ */
+
+#ifndef __REPLAY_WORK_POOL_HH__
+#define __REPLAY_WORK_POOL_HH__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkPool
+{
+  public:
+    typedef std::function<void()> Task;
+
+    /** Start 'threads' workers; 0 means one per hardware thread. */
+    WorkPool(unsigned threads = 0)
+        : pending(0), round(0), stopping(false)
+    {
+        if (!threads)
+            threads = std::thread::hardware_concurrency();
+        if (!threads)
+            threads = 1;
+        for (unsigned i = 0; i < threads; i++)
+            queues.push_back(std::unique_ptr<Queue>(new Queue));
+        for (unsigned i = 0; i < threads; i++)
+            workers.push_back(std::thread(&WorkPool::workerLoop, this, i));
+    }
+
+    ~WorkPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    unsigned size() const { return workers.size(); }
+
+    /** Run every task of 'tasks' and wait for all of them. */
+    void
+    run(std::vector<Task> &tasks)
+    {
+        if (tasks.empty())
+            return;
+        {
+            // set before any task is visible: a worker still looking
+            // for work may pick one up before the round starts
+            std::lock_guard<std::mutex> lock(mtx);
+            pending = tasks.size();
+        }
+        for (size_t i = 0; i < tasks.size(); i++) {
+            Queue &q = *queues[i % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mtx);
+            q.tasks.push_back(std::move(tasks[i]));
+        }
+        std::unique_lock<std::mutex> lock(mtx);
+        round++;
+        wake.notify_all();
+        done.wait(lock, [this] { return pending == 0; });
+        tasks.clear();
+    }
+
+  private:
+    struct Queue
+    {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+    };
+
+    /** Next task for worker 'self': its own newest, else the oldest of
+     *  another worker. */
+    bool
+    take(unsigned self, Task &task)
+    {
+        for (unsigned i = 0; i < queues.size(); i++) {
+            Queue &q = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mtx);
+            if (q.tasks.empty())
+                continue;
+            if (i == 0) {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void
+    workerLoop(unsigned self)
+    {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                wake.wait(lock, [&] { return stopping || round != seen; });
+                if (stopping)
+                    return;
+                seen = round;
+            }
+            Task task;
+            while (take(self, task)) {
+                task();
+                std::lock_guard<std::mutex> lock(mtx);
+                if (--pending == 0)
+                    done.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex mtx;
+    std::condition_variable wake;
+    std::condition_variable done;
+    /** Tasks of the current round not yet finished. */
+    size_t pending;
+    /** Rounds started, so workers notice a new one. */
+    uint64_t round;
+    bool stopping;
+};
+
+#endif // __REPLAY_WORK_POOL_HH__
@@ -0,0 +1,208 @@
+/* @file
+ * Replacement policies for small set-associative predictor caches
+ *
+ * Each policy is a class template on the number of ways with the same
+ * static interface, so a cache can be compiled once per policy:
+ *
+ *   State                per-set replacement state; all-zero is a
+ *                        valid initial state
+ *   name()               policy name as accepted by the parameters
+ *   stateBits()          bits of state modelled per set
+ *   touch(state, way)    a lookup or update hit 'way'
+ *   insert(state, way)   a new tag was filled into 'way'
+ *   victim(state, rng)   way to replace; 'rng' is the cache's random
+ *                        number state
+ *
+ * LRUReplacement is true LRU with a rank per way. TreePLRUReplacement
+ * keeps one bit per node of a binary tree over the ways.
+ * SRRIPReplacement is static re-reference interval prediction with
+ * 2-bit re-reference values. RandomReplacement keeps no state.
+ */
+
+#ifndef __CPU_PRED_SET_REPLACEMENT_HH__
+#define __CPU_PRED_SET_REPLACEMENT_HH__
+
+#include <cstdint>
+
+#include "base/intmath.hh"
+#include "base/types.hh"
+
+namespace SetReplacement
+{
+
+/** xorshift64* step, used by the random policy. */
+inline uint64_t
+nextRandom(uint64_t &state)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * ULL(2685821657736338717);
+}
+
+} // namespace SetReplacement
+
+template <unsigned Ways>
+class LRUReplacement
+{
+  public:
+    struct State
+    {
+        // rank of each way, Ways - 1 for the MRU way and 0 for the LRU
+        // way, stored XORed with the way number so that all-zero state
+        // is the ranking 0, 1, ..., Ways - 1
+        uint8_t rank[Ways];
+        // the way of rank 0
+        uint8_t lru;
+    };
+
+    static const char *name() { return "lru"; }
+    static unsigned stateBits() { return Ways * ceilLog2(Ways); }
+
+    static void
+    touch(State &state, unsigned way)
+    {
+        unsigned threshold = state.rank[way] ^ way;
+        for (unsigned w = 0; w < Ways; w++) {
+            unsigned r = state.rank[w] ^ w;
+            if (w == way)
+                r = Ways - 1;
+            else if (r > threshold)
+                r--;
+            if (r == 0)
+                state.lru = w;
+            state.rank[w] = r ^ w;
+        }
+    }
+
+    static void insert(State &state, unsigned way) { touch(state, way); }
+
+    static unsigned
+    victim(State &state, uint64_t &rng)
+    {
+        return state.lru;
+    }
+};
+
+template <unsigned Ways>
+class TreePLRUReplacement
+{
+  public:
+    struct State
+    {
+        // node n of the tree (root 1, children 2n and 2n + 1) is bit
+        // n - 1; a set bit sends the victim search right
+        uint8_t bits;
+    };
+
+    static const char *name() { return "plru"; }
+    static unsigned stateBits() { return Ways - 1; }
+
+    static void
+    touch(State &state, unsigned way)
+    {
+        unsigned node = 1;
+        for (unsigned level = Levels; level-- > 0; ) {
+            unsigned right = (way >> level) & 1;
+            // point the node away from the way just used
+            if (right)
+                state.bits &= ~(1 << (node - 1));
+            else
+                state.bits |= 1 << (node - 1);
+            node = 2 * node + right;
+        }
+    }
+
+    static void insert(State &state, unsigned way) { touch(state, way); }
+
+    static unsigned
+    victim(State &state, uint64_t &rng)
+    {
+        unsigned node = 1;
+        for (unsigned level = 0; level < Levels; level++)
+            node = 2 * node + ((state.bits >> (node - 1)) & 1);
+        return node - Ways;
+    }
+
+  private:
+    static const unsigned Levels =
+        Ways >= 8 ? 3 : Ways >= 4 ? 2 : Ways >= 2 ? 1 : 0;
+};
+
+template <unsigned Ways>
+class SRRIPReplacement
+{
+  public:
+    struct State
+    {
+        // 2-bit re-reference prediction value per way
+        uint16_t rrpv;
+    };
+
+    static const char *name() { return "srrip"; }
+    static unsigned stateBits() { return 2 * Ways; }
+
+    static void touch(State &state, unsigned way) { set(state, way, 0); }
+
+    static void
+    insert(State &state, unsigned way)
+    {
+        set(state, way, MaxRRPV - 1);
+    }
+
+    static unsigned
+    victim(State &state, uint64_t &rng)
+    {
+        // age every way at once so the oldest reaches MaxRRPV
+        unsigned oldest = 0;
+        for (unsigned w = 0; w < Ways; w++)
+            if (get(state, w) > oldest)
+                oldest = get(state, w);
+        unsigned age = MaxRRPV - oldest;
+        unsigned pick = 0;
+        for (unsigned w = Ways; w-- > 0; ) {
+            unsigned rrpv = get(state, w) + age;
+            set(state, w, rrpv);
+            if (rrpv == MaxRRPV)
+                pick = w;
+        }
+        return pick;
+    }
+
+  private:
+    static const unsigned MaxRRPV = 3;
+
+    static unsigned
+    get(const State &state, unsigned way)
+    {
+        return (state.rrpv >> (2 * way)) & MaxRRPV;
+    }
+
+    static void
+    set(State &state, unsigned way, unsigned val)
+    {
+        state.rrpv = (state.rrpv & ~(MaxRRPV << (2 * way))) |
+            (val << (2 * way));
+    }
+};
+
+template <unsigned Ways>
+class RandomReplacement
+{
+  public:
+    struct State { };
+
+    static const char *name() { return "random"; }
+    static unsigned stateBits() { return 0; }
+
+    static void touch(State &state, unsigned way) { }
+    static void insert(State &state, unsigned way) { }
+
+    static unsigned
+    victim(State &state, uint64_t &rng)
+    {
+        return SetReplacement::nextRandom(rng) & (Ways - 1);
+    }
+};
+
+#endif // __CPU_PRED_SET_REPLACEMENT_HH__
@@ -0,0 +1,115 @@
+/* @file
+ * Page-aligned backing store for the predictor tables
+ */
+
+#include "cpu/pred/table_storage.hh"
+
+#include <sys/mman.h>
+
+#include <cstdint>
+
+#include "base/misc.hh"
+
+namespace
+{
+
+const size_t pageBytes = 4096;
+const size_t hugePageBytes = 2 * 1024 * 1024;
+
+size_t
+roundUp(size_t bytes, size_t align)
+{
+    return (bytes + align - 1) & ~(align - 1);
+}
+
+} // anonymous namespace
+
+TableStorage::TableStorage()
+    : base(NULL), bytes(0), mapBase(NULL), mapBytes(0), fileBacked(false),
+      hugePages(false)
+{
+}
+
+TableStorage::~TableStorage()
+{
+    release();
+}
+
+void
+TableStorage::release()
+{
+    if (mapBase)
+        munmap(mapBase, mapBytes);
+    base = mapBase = NULL;
+    bytes = mapBytes = 0;
+    fileBacked = false;
+}
+
+void
+TableStorage::allocate(size_t size, bool huge_pages)
+{
+    release();
+    hugePages = huge_pages;
+    if (!size)
+        return;
+
+    // huge pages only pay off, and only fit, in tables of 2 MiB or more;
+    // over-allocate so the table can start on a huge page boundary
+    bool huge = huge_pages && size >= hugePageBytes;
+    size_t align = huge ? hugePageBytes : pageBytes;
+    size_t length = roundUp(size, align) + (huge ? hugePageBytes : 0);
+
+    void *map = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED)
+        fatal("Cannot allocate %zu bytes of predictor tables.\n", size);
+    mapBase = map;
+    mapBytes = length;
+    base = (void *)roundUp((uintptr_t)map, align);
+    bytes = size;
+#ifdef MADV_HUGEPAGE
+    if (huge)
+        madvise(base, roundUp(size, hugePageBytes), MADV_HUGEPAGE);
+#endif
+}
+
+void
+TableStorage::mapFile(int fd, uint64_t offset, size_t size)
+{
+    bool huge_pages = hugePages;
+    release();
+    hugePages = huge_pages;
+    if (!size)
+        return;
+    if (offset % pageBytes)
+        panic("Predictor table mapped at unaligned offset %llu.\n",
+              (unsigned long long)offset);
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                     offset);
+    if (map == MAP_FAILED)
+        fatal("Cannot map %zu bytes of predictor tables.\n", size);
+    base = mapBase = map;
+    bytes = mapBytes = size;
+    fileBacked = true;
+}
+
+void
+TableStorage::clear()
+{
+    if (!bytes)
+        return;
+    if (fileBacked) {
+        // replace the file pages with zero-filled anonymous memory at
+        // the same address, so pointers into the table stay valid
+        void *map = mmap(mapBase, mapBytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE |
+                         MAP_FIXED, -1, 0);
+        if (map == MAP_FAILED)
+            panic("Cannot reset predictor tables.\n");
+        fileBacked = false;
+        return;
+    }
+    // private anonymous pages read back as zero once dropped
+    if (madvise(mapBase, mapBytes, MADV_DONTNEED) != 0)
+        panic("Cannot reset predictor tables.\n");
+}
@@ -0,0 +1,72 @@
+/* @file
+ * Page-aligned backing store for the predictor tables
+ *
+ * A TableStorage is either an anonymous mapping or a copy-on-write
+ * private mapping of a region of a file.
+ *
+ * Anonymous mappings are zero-filled by the kernel page by page as the
+ * predictor first touches them, and every predictor table is encoded
+ * so that all-zero memory is its initial state. Allocating a table is
+ * therefore a single system call however large it is, memory is only
+ * committed for the parts of the table that get used, and clear()
+ * just hands the pages back (MADV_DONTNEED) instead of writing them.
+ * Optionally, tables of 2 MiB or more are aligned to and backed by
+ * transparent huge pages, cutting TLB misses on large tables.
+ *
+ * File mappings are how predictor snapshots (bp_snapshot.hh) are
+ * restored: the tables are mapped straight from the snapshot file and
+ * only the pages the predictor then writes are copied.
+ */
+
+#ifndef __CPU_PRED_TABLE_STORAGE_HH__
+#define __CPU_PRED_TABLE_STORAGE_HH__
+
+#include <cstddef>
+#include <cstdint>
+
+class TableStorage
+{
+  public:
+    TableStorage();
+    ~TableStorage();
+
+    /**
+     * Replace the contents with 'bytes' zero bytes, page aligned and
+     * with 'huge_pages' backed by huge pages where the host allows.
+     */
+    void allocate(size_t bytes, bool huge_pages = false);
+
+    /**
+     * Replace the contents with a private, writable view of 'bytes'
+     * bytes of file 'fd' starting at 'offset', a multiple of the page
+     * size. Writes are not carried back to the file.
+     */
+    void mapFile(int fd, uint64_t offset, size_t bytes);
+
+    /**
+     * Set every byte back to zero, without touching the pages; data()
+     * does not change.
+     */
+    void clear();
+
+    void *data() { return base; }
+    const void *data() const { return base; }
+    size_t size() const { return bytes; }
+
+  private:
+    TableStorage(const TableStorage &);
+    TableStorage &operator=(const TableStorage &);
+
+    void release();
+
+    void *base;
+    size_t bytes;
+    /** Start and length of the whole mapping, including alignment. */
+    void *mapBase;
+    size_t mapBytes;
+    /** True if the pages come from a file rather than anonymous memory. */
+    bool fileBacked;
+    bool hugePages;
+};
+
+#endif // __CPU_PRED_TABLE_STORAGE_HH__
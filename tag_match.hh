@@ -0,0 +1,173 @@
+/* @file
+ * Vector tag comparison for small set-associative predictor tables
+ *
+ * tagMatchMask<Ways>(tags, tag) compares a tag against all ways of a set
+ * whose tags are stored contiguously and returns a bit mask of the
+ * matching ways. Sets of 2 to 32 bytes of tags are compared with a
+ * single SSE2 (or AVX2) compare and movemask; single-way sets, and
+ * hosts without SSE2, use an unrolled scalar loop.
+ *
+ * The vector paths read max(8, Ways * sizeof(Tag)) bytes starting at
+ * 'tags', aligned to the read size when it is 16 or 32 bytes. Callers
+ * must lay out sets so those bytes are readable; the YAGS caches do so
+ * by padding each set to a power of two of at least 8 bytes.
+ */
+
+#ifndef __CPU_PRED_TAG_MATCH_HH__
+#define __CPU_PRED_TAG_MATCH_HH__
+
+#include <cstdint>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace TagMatch
+{
+
+/** Portable fallback: one compare per way. */
+template <unsigned Ways, class Tag>
+inline unsigned
+scalarMask(const Tag *tags, Tag tag)
+{
+    unsigned hits = 0;
+    for (unsigned way = 0; way < Ways; way++)
+        hits |= (unsigned)(tags[way] == tag) << way;
+    return hits;
+}
+
+#if defined(__SSE2__)
+
+/** Broadcast 'tag' and compare lane-wise, giving one mask bit per byte. */
+template <class Tag>
+inline unsigned
+byteMask(__m128i lanes, Tag tag);
+
+template <>
+inline unsigned
+byteMask<uint8_t>(__m128i lanes, uint8_t tag)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(lanes,
+                                            _mm_set1_epi8((char)tag)));
+}
+
+template <>
+inline unsigned
+byteMask<uint16_t>(__m128i lanes, uint16_t tag)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(lanes,
+                                             _mm_set1_epi16((short)tag)));
+}
+
+template <>
+inline unsigned
+byteMask<uint32_t>(__m128i lanes, uint32_t tag)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi32(lanes,
+                                             _mm_set1_epi32((int)tag)));
+}
+
+/** Reduce a per-byte mask to one bit per way. */
+template <class Tag>
+inline unsigned
+compressMask(unsigned bytes)
+{
+    unsigned hits = 0;
+    for (unsigned way = 0; way < 16 / sizeof(Tag); way++)
+        hits |= ((bytes >> (way * sizeof(Tag))) & 1) << way;
+    return hits;
+}
+
+template <>
+inline unsigned
+compressMask<uint8_t>(unsigned bytes)
+{
+    return bytes;
+}
+
+#endif // __SSE2__
+
+/** Dispatch on the number of tag bytes in a set. */
+template <unsigned Ways, class Tag, unsigned Bytes = Ways * sizeof(Tag)>
+struct Matcher
+{
+    static unsigned
+    match(const Tag *tags, Tag tag)
+    {
+        return scalarMask<Ways>(tags, tag);
+    }
+};
+
+#if defined(__SSE2__)
+
+/** Up to 8 bytes of tags: one 64-bit load, unused lanes masked off. */
+template <unsigned Ways, class Tag>
+struct LowMatcher
+{
+    static unsigned
+    match(const Tag *tags, Tag tag)
+    {
+        __m128i lanes = _mm_loadl_epi64(
+            reinterpret_cast<const __m128i *>(tags));
+        return compressMask<Tag>(byteMask<Tag>(lanes, tag)) &
+            ((1u << Ways) - 1);
+    }
+};
+
+template <unsigned Ways, class Tag>
+struct Matcher<Ways, Tag, 2> : public LowMatcher<Ways, Tag> { };
+
+template <unsigned Ways, class Tag>
+struct Matcher<Ways, Tag, 4> : public LowMatcher<Ways, Tag> { };
+
+template <unsigned Ways, class Tag>
+struct Matcher<Ways, Tag, 8> : public LowMatcher<Ways, Tag> { };
+
+template <unsigned Ways, class Tag>
+struct Matcher<Ways, Tag, 16>
+{
+    static unsigned
+    match(const Tag *tags, Tag tag)
+    {
+        __m128i lanes = _mm_load_si128(
+            reinterpret_cast<const __m128i *>(tags));
+        return compressMask<Tag>(byteMask<Tag>(lanes, tag));
+    }
+};
+
+template <>
+struct Matcher<8, uint32_t, 32>
+{
+    static unsigned
+    match(const uint32_t *tags, uint32_t tag)
+    {
+#if defined(__AVX2__)
+        __m256i lanes = _mm256_load_si256(
+            reinterpret_cast<const __m256i *>(tags));
+        __m256i eq = _mm256_cmpeq_epi32(lanes, _mm256_set1_epi32((int)tag));
+        return _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+#else
+        return Matcher<4, uint32_t>::match(tags, tag) |
+            (Matcher<4, uint32_t>::match(tags + 4, tag) << 4);
+#endif
+    }
+};
+
+#endif // __SSE2__
+
+} // namespace TagMatch
+
+/** Bit mask of the ways of 'tags' equal to 'tag'. */
+template <unsigned Ways, class Tag>
+inline unsigned
+tagMatchMask(const Tag *tags, Tag tag)
+{
+    if (Ways == 1)
+        return tags[0] == tag;
+    return TagMatch::Matcher<Ways, Tag>::match(tags, tag);
+}
+
+#endif // __CPU_PRED_TAG_MATCH_HH__
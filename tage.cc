@@ -0,0 +1,504 @@
+/* @file
+ * Implementation of a TAGE branch predictor
+ */
+
+#include "cpu/pred/tage.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "base/bitfield.hh"
+#include "base/intmath.hh"
+#include "cpu/pred/bp_snapshot.hh"
+
+namespace
+{
+
+/** Conditional branches between halvings of the useful counters. */
+const unsigned usefulResetPeriod = 1 << 18;
+
+/** Saturation bounds of the alternate-on-new-entry counter. */
+const int useAltMax = 7;
+const int useAltMin = -8;
+
+} // anonymous namespace
+
+TageBP::TageBP(const Params *params)
+    : BPredUnit(params), numThreads(params->numThreads),
+      historyRing(params->numThreads,
+                  HistoryRing<BPHistory>(params->historyCheckpoints)),
+      globalHistory(params->numThreads),
+      instShiftAmt(params->instShiftAmt),
+      banks(NULL), numTables(params->tageTables),
+      tableSize(params->tageTableSize), tagBits(params->tageTagLength),
+      ctrBits(params->tageCtrBits),
+      useAltOnNewEntry(0), usefulTick(0),
+      allocationRng(ULL(0x9e3779b97f4a7c15))
+{
+    if (numThreads == 0)
+        fatal("TageBP needs at least one thread.\n");
+    if (numTables < 1 || numTables > maxTables)
+        fatal("Invalid TAGE table count, must be 1 to %u.\n", maxTables);
+    if (!isPowerOf2(tableSize) || tableSize < 2)
+        fatal("Invalid TAGE table size.\n");
+    if (!isPowerOf2(params->choicePredictorSize))
+        fatal("Invalid choice predictor size.\n");
+    if (tagBits < 1 || tagBits > 16)
+        fatal("Invalid TAGE tag length, must be 1 to 16 bits.\n");
+    if (ctrBits < 2 || ctrBits > 8)
+        fatal("Invalid TAGE counter width, must be 2 to 8 bits.\n");
+    if (params->tageMinHistory < 1 ||
+        params->tageMaxHistory < params->tageMinHistory)
+        fatal("Invalid TAGE history lengths.\n");
+
+    baseCtrs.init(params->choicePredictorSize, params->choiceCtrBits,
+                  params->tableHugePages);
+    baseMask = params->choicePredictorSize - 1;
+    baseThreshold = (1 << (params->choiceCtrBits - 1)) - 1;
+
+    tableBits = ceilLog2(tableSize);
+    tagMask = mask(tagBits);
+    ctrMax = (1 << (ctrBits - 1)) - 1;
+    ctrMin = -ctrMax - 1;
+    bankStorage.allocate((size_t)numTables * tableSize * sizeof(Entry),
+                         params->tableHugePages);
+    banks = static_cast<Entry *>(bankStorage.data());
+
+    // geometric series of history lengths, kept strictly increasing
+    // where rounding would repeat a length
+    double ratio = numTables > 1 ?
+        std::pow((double)params->tageMaxHistory / params->tageMinHistory,
+                 1.0 / (numTables - 1)) : 1.0;
+    for (unsigned i = 0; i < numTables; i++) {
+        unsigned len = (unsigned)(params->tageMinHistory *
+                                  std::pow(ratio, (double)i) + 0.5);
+        if (i && len <= histLengths[i - 1])
+            len = histLengths[i - 1] + 1;
+        histLengths[i] = len;
+    }
+
+    // the index and two tag hashes of each bank; the second tag hash is
+    // one bit narrower so the two do not cancel out
+    for (unsigned tid = 0; tid < numThreads; tid++) {
+        GlobalHistory &hist = globalHistory[tid];
+        hist.init(histLengths[numTables - 1], params->historyCheckpoints,
+                  pathHistoryBits);
+        for (unsigned i = 0; i < numTables; i++) {
+            hist.addFold(histLengths[i], tableBits);
+            hist.addFold(histLengths[i], tagBits);
+            hist.addFold(histLengths[i], std::max(tagBits - 1, 1u));
+        }
+    }
+
+    threadSalt.resize(numThreads, 0);
+    if (params->threadIndexSalt) {
+        for (ThreadID tid = 1; tid < (ThreadID)numThreads; tid++)
+            threadSalt[tid] = (unsigned)((tid * ULL(0x9e3779b97f4a7c15)) >>
+                                         32) & (tableSize - 1);
+    }
+
+    totalStorageBits = baseCtrs.storageBits() +
+        (uint64_t)numTables * tableSize *
+        (tagBits + ctrBits + 2) + 4 +
+        (uint64_t)numThreads *
+        (histLengths[numTables - 1] + pathHistoryBits);
+
+    if (!params->branchTraceFile.empty())
+        traceCapture.reset(new BranchTraceCapture(params->branchTraceFile));
+
+    if (!params->mispredictProfile.empty()) {
+        std::vector<std::string> components;
+        components.push_back("base");
+        components.push_back("provider");
+        components.push_back("alternate");
+        profiler.reset(new MispredictProfiler(params->mispredictProfile,
+            params->profileEntries, params->profileTop, components));
+    }
+}
+
+void
+TageBP::regStats()
+{
+    BPredUnit::regStats();
+
+    statBasePredictions
+        .scalar(stats.basePredictions)
+        .name(name() + ".basePredictions")
+        .desc("Number of predictions made by the base table")
+        ;
+
+    statProviderPredictions
+        .scalar(stats.providerPredictions)
+        .name(name() + ".providerPredictions")
+        .desc("Number of predictions made by the longest matching bank")
+        ;
+
+    statAlternatePredictions
+        .scalar(stats.alternatePredictions)
+        .name(name() + ".alternatePredictions")
+        .desc("Number of predictions left to the alternate over a new "
+              "entry")
+        ;
+
+    statAllocations
+        .scalar(stats.allocations)
+        .name(name() + ".allocations")
+        .desc("Number of entries allocated on a misprediction")
+        ;
+
+    statAllocationFailures
+        .scalar(stats.allocationFailures)
+        .name(name() + ".allocationFailures")
+        .desc("Number of mispredictions that could not allocate")
+        ;
+
+    statUsefulResets
+        .scalar(stats.usefulResets)
+        .name(name() + ".usefulResets")
+        .desc("Number of times the useful counters were halved")
+        ;
+
+    statStorageBits
+        .scalar(totalStorageBits)
+        .name(name() + ".storageBits")
+        .desc("Bits of predictor state")
+        ;
+}
+
+uint64_t
+TageBP::storageBits() const
+{
+    return totalStorageBits;
+}
+
+void
+TageBP::reset()
+{
+    baseCtrs.reset();
+    bankStorage.clear();
+    for (unsigned tid = 0; tid < numThreads; tid++)
+        globalHistory[tid].clear();
+    useAltOnNewEntry = 0;
+    usefulTick = 0;
+}
+
+/*
+ * Snapshot of the tables, the histories and the allocation state
+ */
+std::string
+TageBP::snapshotConfig() const
+{
+    std::ostringstream os;
+    os << "tage choicePredictorSize=" << baseCtrs.size()
+       << " choiceCtrBits=" << baseCtrs.bits()
+       << " tageTables=" << numTables
+       << " tageTableSize=" << tableSize
+       << " tageTagLength=" << tagBits
+       << " tageCtrBits=" << ctrBits
+       << " histories=";
+    for (unsigned i = 0; i < numTables; i++)
+        os << (i ? "," : "") << histLengths[i];
+    os << " pathHistoryBits=" << pathHistoryBits
+       << " instShiftAmt=" << instShiftAmt
+       << " numThreads=" << numThreads;
+    return os.str();
+}
+
+void
+TageBP::saveSnapshot(const std::string &path) const
+{
+    // the allocation state, then each thread's history
+    std::vector<uint64_t> registers;
+    registers.push_back(allocationRng);
+    registers.push_back((uint64_t)(int64_t)useAltOnNewEntry);
+    registers.push_back(usefulTick);
+    for (unsigned tid = 0; tid < numThreads; tid++) {
+        const GlobalHistory &hist = globalHistory[tid];
+        size_t at = registers.size();
+        registers.resize(at + hist.stateWords());
+        hist.saveState(&registers[at]);
+    }
+
+    BPSnapshotWriter writer(path, snapshotConfig());
+    writer.add("baseCtrs", baseCtrs.data(), baseCtrs.dataBytes());
+    writer.add("banks", bankStorage.data(), bankStorage.size());
+    writer.add("registers", &registers[0],
+               registers.size() * sizeof(registers[0]));
+    writer.write();
+}
+
+void
+TageBP::restoreSnapshot(const std::string &path)
+{
+    BPSnapshotReader reader(path, snapshotConfig());
+    size_t per_thread = globalHistory[0].stateWords();
+    std::vector<uint64_t> registers(3 + numThreads * per_thread);
+    reader.read("registers", &registers[0],
+                registers.size() * sizeof(registers[0]));
+
+    int fd = reader.descriptor();
+    baseCtrs.mapFile(fd, reader.sectionOffset("baseCtrs",
+                                              baseCtrs.dataBytes()));
+    bankStorage.mapFile(fd, reader.sectionOffset("banks", bankStorage.size()),
+                        bankStorage.size());
+    banks = static_cast<Entry *>(bankStorage.data());
+
+    allocationRng = registers[0];
+    useAltOnNewEntry = (int)(int64_t)registers[1];
+    usefulTick = registers[2];
+    for (unsigned tid = 0; tid < numThreads; tid++) {
+        globalHistory[tid].loadState(&registers[3 + tid * per_thread]);
+        // no branch is in flight across a snapshot
+        historyRing[tid].clear();
+    }
+}
+
+void
+TageBP::serialize(std::ostream &os)
+{
+    std::string snapshot = name() + ".bpsnap";
+    saveSnapshot(Checkpoint::dir() + "/" + snapshot);
+    SERIALIZE_SCALAR(snapshot);
+}
+
+void
+TageBP::unserialize(Checkpoint *cp, const std::string &section)
+{
+    std::string snapshot;
+    UNSERIALIZE_SCALAR(snapshot);
+    restoreSnapshot(cp->cptDir + "/" + snapshot);
+}
+
+void
+TageBP::uncondBranch(ThreadID tid, Addr pc, void * &bp_history)
+{
+    BPHistory *history = historyRing[tid].push(bp_history);
+    globalHistory[tid].save(history->checkpoint);
+    history->provider = -1;
+    history->alternate = -1;
+    history->finalPred = true;
+    history->uncond = true;
+    pushHistory(tid, pc, true);
+}
+
+bool
+TageBP::lookup(ThreadID tid, Addr branch_addr, void * &bp_history)
+{
+    const GlobalHistory &hist = globalHistory[tid];
+    BPHistory *history = historyRing[tid].push(bp_history);
+    hist.save(history->checkpoint);
+    history->uncond = false;
+
+    Addr pc = branch_addr >> instShiftAmt;
+    history->baseIndex = pc & baseMask;
+
+    // each bank hashes the PC with its folded histories and as much
+    // path history as its history length; the PC is also shifted by a
+    // different amount per bank so that banks of similar history
+    // length spread a branch differently
+    for (unsigned i = 0; i < numTables; i++) {
+        unsigned fold = i * foldsPerBank;
+        unsigned shift = tableBits - i % tableBits;
+        unsigned path = hist.pathHistory() &
+            mask(std::min(histLengths[i], pathHistoryBits));
+        history->index[i] = (unsigned)(pc ^ (pc >> shift) ^
+                                       hist.fold(fold) ^ path ^
+                                       (path >> tableBits) ^
+                                       threadSalt[tid]) & (tableSize - 1);
+        history->tag[i] = (uint16_t)((pc ^ hist.fold(fold + 1) ^
+                                      (hist.fold(fold + 2) << 1)) & tagMask);
+    }
+
+    // the provider is the matching bank of longest history, the
+    // alternate the next one down
+    int provider = -1;
+    int alternate = -1;
+    for (int i = numTables - 1; i >= 0; i--) {
+        if (entry(i, history->index[i]).tag == history->tag[i]) {
+            if (provider < 0) {
+                provider = i;
+            } else {
+                alternate = i;
+                break;
+            }
+        }
+    }
+
+    bool base_pred = baseCtrs.read(history->baseIndex) > baseThreshold;
+    bool alt_pred = alternate >= 0 ?
+        entry(alternate, history->index[alternate]).ctr >= 0 : base_pred;
+    bool final_pred = base_pred;
+    bool new_entry = false;
+    uint8_t component = 0;
+    if (provider >= 0) {
+        const Entry &e = entry(provider, history->index[provider]);
+        history->providerPred = e.ctr >= 0;
+        new_entry = (e.ctr == 0 || e.ctr == -1) && e.useful == 0;
+        if (new_entry && useAltOnNewEntry >= 0) {
+            final_pred = alt_pred;
+            component = 2;
+            stats.alternatePredictions++;
+        } else {
+            final_pred = history->providerPred;
+            component = 1;
+            stats.providerPredictions++;
+        }
+    } else {
+        history->providerPred = base_pred;
+        stats.basePredictions++;
+    }
+
+    history->provider = provider;
+    history->alternate = alternate;
+    history->alternatePred = alt_pred;
+    history->newEntry = new_entry;
+    history->component = component;
+    history->finalPred = final_pred;
+
+    // speculatively update the history with the prediction
+    pushHistory(tid, branch_addr, final_pred);
+    return final_pred;
+}
+
+void
+TageBP::btbUpdate(ThreadID tid, Addr branch_addr, void * &bp_history)
+{
+    globalHistory[tid].setLastOutcome(false);
+}
+
+void
+TageBP::trainCounter(int8_t &ctr, bool taken)
+{
+    if (taken && ctr < ctrMax)
+        ctr++;
+    else if (!taken && ctr > ctrMin)
+        ctr--;
+}
+
+void
+TageBP::train(bool taken, const BPHistory &history)
+{
+    int provider = history.provider;
+    // another branch may have taken the entry since the lookup
+    if (provider >= 0 &&
+        entry(provider, history.index[provider]).tag !=
+        history.tag[provider])
+        provider = -1;
+
+    if (provider < 0) {
+        if (taken)
+            baseCtrs.increment(history.baseIndex);
+        else
+            baseCtrs.decrement(history.baseIndex);
+    } else {
+        Entry &e = entry(provider, history.index[provider]);
+        bool alt_pred = history.alternatePred;
+        if (history.newEntry && history.providerPred != alt_pred) {
+            if (alt_pred == taken)
+                useAltOnNewEntry = std::min(useAltOnNewEntry + 1, useAltMax);
+            else
+                useAltOnNewEntry = std::max(useAltOnNewEntry - 1, useAltMin);
+        }
+        if (history.providerPred != alt_pred) {
+            if (history.providerPred == taken)
+                e.useful = std::min(e.useful + 1, 3);
+            else if (e.useful)
+                e.useful--;
+        }
+        trainCounter(e.ctr, taken);
+        // a new entry has not learnt anything yet; keep the alternate
+        // trained meanwhile
+        if (history.newEntry) {
+            int alt = history.alternate;
+            if (alt >= 0 &&
+                entry(alt, history.index[alt]).tag == history.tag[alt])
+                trainCounter(entry(alt, history.index[alt]).ctr, taken);
+            else if (alt < 0 && taken)
+                baseCtrs.increment(history.baseIndex);
+            else if (alt < 0)
+                baseCtrs.decrement(history.baseIndex);
+        }
+    }
+
+    if (history.finalPred != taken && provider < (int)numTables - 1)
+        allocate(taken, history);
+
+    if (++usefulTick == usefulResetPeriod) {
+        usefulTick = 0;
+        for (size_t i = 0; i < (size_t)numTables * tableSize; i++)
+            banks[i].useful >>= 1;
+        stats.usefulResets++;
+    }
+}
+
+void
+TageBP::allocate(bool taken, const BPHistory &history)
+{
+    // the first bank above the provider with a free entry, or one
+    // time in four the second, so that branches do not all pile up in
+    // the shortest history that would do
+    allocationRng ^= allocationRng << 13;
+    allocationRng ^= allocationRng >> 7;
+    allocationRng ^= allocationRng << 17;
+    bool skip = (allocationRng & 3) == 0;
+
+    int chosen = -1;
+    for (unsigned i = history.provider + 1; i < numTables; i++) {
+        if (entry(i, history.index[i]).useful == 0) {
+            chosen = i;
+            if (!skip)
+                break;
+            skip = false;
+        }
+    }
+
+    if (chosen < 0) {
+        // age the entries in the way, so one frees up eventually
+        for (unsigned i = history.provider + 1; i < numTables; i++)
+            entry(i, history.index[i]).useful--;
+        stats.allocationFailures++;
+        return;
+    }
+
+    Entry &e = entry(chosen, history.index[chosen]);
+    e.tag = history.tag[chosen];
+    e.ctr = taken ? 0 : -1;
+    e.useful = 0;
+    stats.allocations++;
+}
+
+void
+TageBP::update(ThreadID tid, Addr branch_addr, bool taken, void *bp_history,
+               bool squashed)
+{
+    if (!bp_history)
+        return;
+
+    BPHistory &history = historyRing[tid].get(bp_history);
+    if (squashed) {
+        // mispredicted: repair the history with the outcome; the
+        // tables are trained once, at commit
+        globalHistory[tid].restore(history.checkpoint);
+        pushHistory(tid, branch_addr, taken);
+        return;
+    }
+
+    if (!history.uncond) {
+        train(taken, history);
+        if (profiler)
+            profiler->record(branch_addr, history.finalPred != taken,
+                             history.component);
+    }
+    // a trace holds one thread's branches, thread 0's
+    if (traceCapture && tid == 0)
+        traceCapture->record(branch_addr, taken, !history.uncond);
+    historyRing[tid].release(bp_history);
+}
+
+void
+TageBP::squash(ThreadID tid, void *bp_history)
+{
+    globalHistory[tid].restore(historyRing[tid].get(bp_history).checkpoint);
+    historyRing[tid].squash(bp_history);
+}
@@ -0,0 +1,268 @@
+/* @file
+ * Header file for a TAGE branch predictor
+ *
+ * TAGE (Seznec and Michaud, "A case for (partially) TAgged GEometric
+ * history length branch prediction") extends the tagged direction
+ * caches of YAGS to several banks, each indexed and tagged with a hash
+ * of the PC and a longer global history than the one before: the
+ * history lengths form a geometric series from tageMinHistory to
+ * tageMaxHistory. A branch is predicted by the bank with the longest
+ * history whose tag matches (the provider), falling back to the next
+ * matching bank (the alternate) or to a bimodal base table.
+ *
+ * Histories of hundreds of bits do not fit a register, so each thread
+ * keeps its global history in a LongHistory (long_history.hh), and
+ * every bank hashes it through folded histories: the last L outcomes
+ * XOR-folded down to the index or tag width, updated in O(1) per
+ * branch. The indices also hash in up to 16 bits of path history.
+ *
+ * A misprediction allocates an entry in a bank with a longer history
+ * than the provider's, one whose useful counter is 0; the useful
+ * counters count the times an entry predicted right where the
+ * alternate did not, and are halved periodically so stale entries can
+ * be replaced.
+ *
+ * The tables are sized once by the parameters and never grow: the
+ * base table is choicePredictorSize choiceCtrBits-bit counters, and
+ * each of the tageTables tagged banks has tageTableSize entries of a
+ * tageTagLength-bit tag, a tageCtrBits-bit counter and a 2-bit useful
+ * counter; storageBits() gives the total.
+ *
+ * Unlike the YAGS caches, the banks are direct-mapped: an index names
+ * one entry, and which entry to replace is chosen across banks by the
+ * useful counters. So there is no set to search or replacement state
+ * to keep, and the banks do not use the YAGS set layout, tagMatchMask
+ * (tag_match.hh) or the policies of set_replacement.hh.
+ */
+
+#ifndef __CPU_PRED_TAGE_PRED_HH__
+#define __CPU_PRED_TAGE_PRED_HH__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/statistics.hh"
+#include "cpu/pred/bp_trace_capture.hh"
+#include "cpu/pred/bpred_unit.hh"
+#include "cpu/pred/history_ring.hh"
+#include "cpu/pred/long_history.hh"
+#include "cpu/pred/mispredict_profile.hh"
+#include "cpu/pred/packed_counters.hh"
+#include "cpu/pred/table_storage.hh"
+
+/** Prediction and allocation counts of a TageBP. */
+struct TageStats
+{
+    TageStats()
+        : basePredictions(0), providerPredictions(0),
+          alternatePredictions(0), allocations(0), allocationFailures(0),
+          usefulResets(0)
+    { }
+
+    /** Predictions made by the base table, no tagged bank hit. */
+    uint64_t basePredictions;
+    /** Predictions made by the provider bank. */
+    uint64_t providerPredictions;
+    /** Predictions left to the alternate because the provider entry
+     *  was newly allocated. */
+    uint64_t alternatePredictions;
+    /** Entries allocated on a misprediction. */
+    uint64_t allocations;
+    /** Mispredictions that found no entry to allocate. */
+    uint64_t allocationFailures;
+    /** Periodic halvings of all useful counters. */
+    uint64_t usefulResets;
+};
+
+/*
+ * Each of the numThreads hardware threads has its own global history
+ * and history checkpoints, while the tables are shared. With
+ * threadIndexSalt, every thread but thread 0 XORs a fixed salt into the
+ * bank indices.
+ */
+class TageBP : public BPredUnit
+{
+  public:
+    /** Most tagged banks. */
+    static const unsigned maxTables = 12;
+
+    TageBP(const Params *params);
+    void uncondBranch(ThreadID tid, Addr pc, void * &bp_history);
+    void squash(ThreadID tid, void *bp_history);
+    bool lookup(ThreadID tid, Addr branch_addr, void * &bp_history);
+    void btbUpdate(ThreadID tid, Addr branch_addr, void * &bp_history);
+    void update(ThreadID tid, Addr branch_addr, bool taken, void *bp_history,
+                bool squashed);
+    void reset();
+
+    /**
+     * Write the tables, the global histories and the allocation state
+     * to a snapshot file (see bp_snapshot.hh). No branch may be in
+     * flight.
+     */
+    void saveSnapshot(const std::string &path) const;
+
+    /**
+     * Restore the state saved by saveSnapshot() from a predictor with
+     * the same table parameters, mapping the tables copy-on-write.
+     */
+    void restoreSnapshot(const std::string &path);
+
+    /** Checkpointing: the tables go to a snapshot next to the
+     *  checkpoint, named in the checkpoint. */
+    void serialize(std::ostream &os);
+    void unserialize(Checkpoint *cp, const std::string &section);
+
+    /** Occupancy counts of a thread's history checkpoint ring. */
+    const HistoryRingStats &historyStats(ThreadID tid = 0) const
+    { return historyRing[tid].getStats(); }
+
+    /** Prediction and allocation counts. */
+    const TageStats &accessStats() const { return stats; }
+
+    /** Register accessStats() as gem5 statistics. */
+    void regStats();
+
+    /** History length of tagged bank 'bank'. */
+    unsigned historyLength(unsigned bank) const { return histLengths[bank]; }
+
+    /** Bits of predictor state: base and tagged tables, the
+     *  alternate-on-new-entry counter and the global histories. */
+    uint64_t storageBits() const;
+
+  private:
+    /** One entry of a tagged bank; all-zero is an empty, weakly taken
+     *  entry. */
+    struct Entry
+    {
+        uint16_t tag;
+        /** Signed direction counter, taken if >= 0. */
+        int8_t ctr;
+        uint8_t useful;
+    };
+
+    /**
+     * Folded histories per bank, numbered bank * foldsPerBank + f in
+     * the thread's LongHistory: f = 0 for the index, 1 and 2 for the
+     * tag.
+     */
+    static const unsigned foldsPerBank = 3;
+
+    /** Bits of path history hashed into the indices. */
+    static const unsigned pathHistoryBits = 16;
+
+    typedef LongHistory<maxTables * foldsPerBank> GlobalHistory;
+
+    struct BPHistory
+    {
+        /** The thread's history before this branch. */
+        GlobalHistory::Checkpoint checkpoint;
+        /** Index and tag of the branch in each bank. */
+        unsigned index[maxTables];
+        uint16_t tag[maxTables];
+        unsigned baseIndex;
+        /** Banks of the provider and the alternate, -1 for none. */
+        int8_t provider;
+        int8_t alternate;
+        bool providerPred;
+        bool alternatePred;
+        /** The provider entry was newly allocated. */
+        bool newEntry;
+        /** What made the prediction: 0 the base table, 1 the provider,
+         *  2 the alternate. */
+        uint8_t component;
+        bool finalPred;
+        /** True if the history belongs to an unconditional branch. */
+        bool uncond;
+    };
+
+    /** Append a branch to a thread's history. */
+    void
+    pushHistory(ThreadID tid, Addr branch_addr, bool taken)
+    {
+        globalHistory[tid].push(taken, branch_addr >> instShiftAmt);
+    }
+
+    Entry &entry(unsigned bank, unsigned idx)
+    { return banks[(size_t)bank * tableSize + idx]; }
+
+    /** Move a tagged counter one step toward 'taken'. */
+    void trainCounter(int8_t &ctr, bool taken);
+    /** Train the tables on a committed conditional branch. */
+    void train(bool taken, const BPHistory &history);
+    /** Take an entry in a bank above the provider for a mispredicted
+     *  branch. */
+    void allocate(bool taken, const BPHistory &history);
+
+    /** Parameters a snapshot must agree on, as a string. */
+    std::string snapshotConfig() const;
+
+    /** Number of hardware threads. */
+    unsigned numThreads;
+
+    /** Per thread, the checkpoints handed out as bp_history by lookup()
+     *  and uncondBranch(). */
+    std::vector<HistoryRing<BPHistory> > historyRing;
+    /** Per thread, the global and path histories. */
+    std::vector<GlobalHistory> globalHistory;
+
+    unsigned instShiftAmt;
+
+    /** Bimodal base table. */
+    PackedCounterTable baseCtrs;
+    unsigned baseMask;
+    unsigned baseThreshold;
+
+    /** The tagged banks, tableSize entries each, back to back. */
+    TableStorage bankStorage;
+    Entry *banks;
+    unsigned numTables;
+    unsigned tableSize;
+    unsigned tableBits;
+    unsigned tagBits;
+    unsigned tagMask;
+    unsigned ctrBits;
+    int ctrMin;
+    int ctrMax;
+
+    /** History length of each bank, increasing. */
+    unsigned histLengths[maxTables];
+
+    /**
+     * Signed counter of whether the alternate predicts newly allocated
+     * entries better than they do themselves (>= 0: use the alternate).
+     */
+    int useAltOnNewEntry;
+    /** Conditional branches committed since the last useful reset. */
+    unsigned usefulTick;
+    /** Random number state of the allocation policy. */
+    uint64_t allocationRng;
+
+    /** Per thread, the salt XORed into the bank indices (0 unless
+     *  threadIndexSalt is set). */
+    std::vector<unsigned> threadSalt;
+
+    /** Records committed branches if branchTraceFile is set. */
+    std::unique_ptr<BranchTraceCapture> traceCapture;
+    /** Profiles mispredicted branches if mispredictProfile is set, by
+     *  the component that predicted them: base, provider or
+     *  alternate. */
+    std::unique_ptr<MispredictProfiler> profiler;
+
+    TageStats stats;
+    /** Constant, for reports next to the counts. */
+    uint64_t totalStorageBits;
+
+    /** The counts of 'stats' as gem5 statistics. */
+    Stats::Value statBasePredictions;
+    Stats::Value statProviderPredictions;
+    Stats::Value statAlternatePredictions;
+    Stats::Value statAllocations;
+    Stats::Value statAllocationFailures;
+    Stats::Value statUsefulResets;
+    Stats::Value statStorageBits;
+};
+
+#endif // __CPU_PRED_TAGE_PRED_HH__
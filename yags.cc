@@ -6,88 +6,396 @@
  *
  */
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
 #include "base/bitfield.hh"
 #include "base/intmath.hh"
+#include "base/trace.hh"
+#include "cpu/pred/bp_snapshot.hh"
 #include "cpu/pred/yags.hh"
+#include "debug/Fetch.hh"
 
 
 /*
  * Constructor for YagsBP
  */
 YagsBP::YagsBP(const Params *params)
-    : BPredUnit(params), instShiftAmt(params->instShiftAmt),
-      globalHistoryReg(0),
+    : BPredUnit(params), numThreads(params->numThreads),
+      historyRing(params->numThreads,
+                  HistoryRing<BPHistory>(params->historyCheckpoints)),
+      associativity(params->yagsAssociativity),
+      associativityBits(ceilLog2(params->yagsAssociativity)),
+      instShiftAmt(params->instShiftAmt),
+      globalHistoryReg(params->numThreads, 0),
       globalHistoryBits(ceilLog2(params->globalPredictorSize)),
+      globalHistoryLength(params->globalHistoryLength),
       choicePredictorSize(params->choicePredictorSize),
       choiceCtrBits(params->choiceCtrBits),
-      globalPredictorSize(params->globalPredictorSize / _SET_ASSOCITY),
-      globalCtrBits(params->globalCtrBits)
+      globalCtrBits(params->globalCtrBits),
+      replacementRng(ULL(0x9e3779b97f4a7c15)),
+      tableHugePages(params->tableHugePages)
 {
+	//judging the associativity and tag length
+    if(this->associativity != 1 && this->associativity != 2 &&
+       this->associativity != 4 && this->associativity != 8)
+        fatal("Invalid YAGS associativity, must be 1, 2, 4 or 8!\n");
+    if(params->yagsTagLength < 1 || params->yagsTagLength > 32)
+        fatal("Invalid YAGS tag length, must be 1 to 32 bits!\n");
+    if(this->numThreads == 0)
+        fatal("YagsBP needs at least one thread!\n");
+
+    //the taken/notTaken caches hold globalPredictorSize counters in sets
+    this->globalPredictorSize = params->globalPredictorSize / this->associativity;
+
 	//judging the predictor size
     if(!isPowerOf2(this->globalPredictorSize))
     	fatal("Invalid global predictor size!\n");
     if(!isPowerOf2(this->choicePredictorSize))
     	fatal("Invalid choice predictor size!\n");
 
-    //set up the tables of counters and Tags
-    //taken and notTaken predictor should share the same size as globalPredictorSize
-    this->choiceCounters.resize(this->choicePredictorSize);
-    this->takenCounters.resize(this->globalPredictorSize);
-    this->notTakenCounters.resize(this->globalPredictorSize);
+    //set up the tables of counters, all counters start at 0
+    DPRINTF(Fetch, "Initializing choiceCounters with %u bits\n", this->choiceCtrBits);
+    this->choiceCounters.init(this->choicePredictorSize, this->choiceCtrBits, this->tableHugePages);
 
-    //initilize the counter's values
-    printf("Initilizing choiceCounters with %u 1s\n",this->choiceCtrBits);
-    for(uint32_t count = 0; count < this->choicePredictorSize; count++)
+    //set up the taken/notTaken caches and pick the lookup/update
+    //instantiation for their associativity and tag width
+    //the cache sets hold counters of up to 4 bits
+    if(this->globalCtrBits < 1 || this->globalCtrBits > 4)
+        fatal("Invalid global counter width, must be 1 to 4 bits!\n");
+    this->globalCtrMax = mask(this->globalCtrBits);
+    this->globalCtrShift = PackedCounters::slotShift(this->globalCtrBits);
+    switch(this->associativity)
     {
-    	this->choiceCounters[count].setBits(this->choiceCtrBits);
+      case 1: this->configureWays<1>(params->yagsTagLength, params->yagsReplacement); break;
+      case 2: this->configureWays<2>(params->yagsTagLength, params->yagsReplacement); break;
+      case 4: this->configureWays<4>(params->yagsTagLength, params->yagsReplacement); break;
+      case 8: this->configureWays<8>(params->yagsTagLength, params->yagsReplacement); break;
     }
-
-    this->initCache();
     //set up the mask for indexing from branch address
     this->choicePredictorMask = this->choicePredictorSize - 1;
     this->globalPredictorMask = this->globalPredictorSize - 1;
     this->globalHistoryMask = mask(this->globalHistoryBits);
-    this->globalHistoryUnusedMask = this->globalHistoryMask - (this->globalHistoryMask >> (ceilLog2(_SET_ASSOCITY)));
-    printf("globalHistoryBits is %u\n",this->globalHistoryBits);
-    printf("globalHistoryMask is %08x\n",this->globalHistoryMask);
-    printf("globalPredictorMask is %08x\n",this->globalPredictorMask);
-    printf("globalHistoryUnusedMask is %08x\n",this->globalHistoryUnusedMask);
+    this->globalHistoryUnusedMask = this->globalHistoryMask - (this->globalHistoryMask >> this->associativityBits);
+    this->tagHistoryShift = this->globalHistoryBits - this->associativityBits;
+    //with globalHistoryLength, each thread keeps that many outcomes and
+    //the register holds them folded down to globalHistoryBits
+    if(this->globalHistoryLength)
+    {
+        this->longHistory.resize(this->numThreads);
+        for(unsigned tid = 0; tid < this->numThreads; tid++)
+        {
+            this->longHistory[tid].init(this->globalHistoryLength, params->historyCheckpoints, 0);
+            this->longHistory[tid].addFold(this->globalHistoryLength, this->globalHistoryBits);
+        }
+    }
+    //with loopPredictorEntries, each thread has a loop predictor in
+    //front of YAGS
+    if(params->loopPredictorEntries)
+    {
+        this->loopPredictor.resize(this->numThreads);
+        for(unsigned tid = 0; tid < this->numThreads; tid++)
+            this->loopPredictor[tid].init(params->loopPredictorEntries);
+    }
+    DPRINTF(Fetch, "globalHistoryBits is %u\n", this->globalHistoryBits);
+    DPRINTF(Fetch, "globalHistoryMask is %08x\n", this->globalHistoryMask);
+    DPRINTF(Fetch, "globalPredictorMask is %08x\n", this->globalPredictorMask);
+    DPRINTF(Fetch, "globalHistoryUnusedMask is %08x\n", this->globalHistoryUnusedMask);
     //set up the threshold for branch prediction
     this->choiceThreshold = (ULL(1) << (this->choiceCtrBits - 1)) - 1;
     this->globalPredictorThreshold = (ULL(1) << (this->globalCtrBits - 1)) - 1;
 
-    //using 8 bits of address as tags.
-    this->tagsMask = mask(_YAGS_TAG_LENGTH);
-    printf("YagsBP() Constructor done\n");
+    //using yagsTagLength bits of address as tags.
+    this->tagsMask = mask(params->yagsTagLength);
+
+    //with threadIndexSalt, each thread but thread 0 XORs its own salt
+    //into the choice and cache indices
+    this->threadSalt.resize(this->numThreads, 0);
+    if(params->threadIndexSalt)
+        for(ThreadID tid = 1; tid < (ThreadID)this->numThreads; tid++)
+            this->threadSalt[tid] = (unsigned)((tid * ULL(0x9e3779b97f4a7c15)) >> 32);
+
+    //record every committed branch to a trace if requested
+    if (!params->branchTraceFile.empty())
+        this->traceCapture.reset(new BranchTraceCapture(params->branchTraceFile));
+    //attribute mispredictions to branches and components if requested,
+    //in the order of BPHistory::takenUsed, then the loop predictor
+    if (!params->mispredictProfile.empty())
+    {
+        std::vector<std::string> components;
+        components.push_back("choice");
+        components.push_back("takenCache");
+        components.push_back("notTakenCache");
+        if (!this->loopPredictor.empty())
+            components.push_back("loop");
+        this->profiler.reset(new MispredictProfiler(params->mispredictProfile,
+            params->profileEntries, params->profileTop, components));
+    }
+    DPRINTF(Fetch, "YagsBP() Constructor done\n");
+}
+
+/*
+ * Statistics
+ */
+void
+YagsBP::regStats()
+{
+    BPredUnit::regStats();
+
+    statChoicePredictions
+        .scalar(stats.choicePredictions)
+        .name(name() + ".choicePredictions")
+        .desc("Number of predictions made by the choice predictor alone")
+        ;
+
+    statTakenHits
+        .scalar(stats.takenHits)
+        .name(name() + ".takenHits")
+        .desc("Number of taken cache lookups that hit")
+        ;
+
+    statTakenMisses
+        .scalar(stats.takenMisses)
+        .name(name() + ".takenMisses")
+        .desc("Number of taken cache lookups that missed")
+        ;
+
+    statNotTakenHits
+        .scalar(stats.notTakenHits)
+        .name(name() + ".notTakenHits")
+        .desc("Number of not-taken cache lookups that hit")
+        ;
+
+    statNotTakenMisses
+        .scalar(stats.notTakenMisses)
+        .name(name() + ".notTakenMisses")
+        .desc("Number of not-taken cache lookups that missed")
+        ;
+
+    statReplacements
+        .scalar(stats.replacements)
+        .name(name() + ".replacements")
+        .desc("Number of cache ways replaced on a tag conflict")
+        ;
+
+    statReplacementUpdates
+        .scalar(stats.replacementUpdates)
+        .name(name() + ".replacementUpdates")
+        .desc("Number of cache replacement state updates")
+        ;
+
+    statLoopPredictions
+        .scalar(stats.loopPredictions)
+        .name(name() + ".loopPredictions")
+        .desc("Number of committed branches predicted by the loop "
+              "predictor")
+        ;
+
+    statLoopMispredictions
+        .scalar(stats.loopMispredictions)
+        .name(name() + ".loopMispredictions")
+        .desc("Number of loop predictor predictions that were "
+              "mispredicted")
+        ;
+}
+
+/*
+ * Storage: globalPredictorSize holds the sets of each cache
+ */
+uint64_t
+YagsBP::storageBits() const
+{
+    uint64_t ways = 2 * (uint64_t)this->globalPredictorSize * this->associativity;
+    unsigned historyBits = this->globalHistoryLength ? this->globalHistoryLength : this->globalHistoryBits;
+    uint64_t bits = this->choiceCounters.storageBits() +
+                    ways * (popCount(this->tagsMask) + this->globalCtrBits) +
+                    this->replacementBits + (uint64_t)this->numThreads * historyBits;
+    for(unsigned tid = 0; tid < this->loopPredictor.size(); tid++)
+        bits += this->loopPredictor[tid].storageBits();
+    return bits;
+}
+
+/*
+ * Snapshot of the choice counters, the taken/notTaken caches and the
+ * global history register
+ */
+std::string
+YagsBP::snapshotConfig() const
+{
+    std::ostringstream os;
+    os << "yags choicePredictorSize=" << this->choicePredictorSize
+       << " choiceCtrBits=" << this->choiceCtrBits
+       << " globalPredictorSize=" << this->globalPredictorSize * this->associativity
+       << " globalCtrBits=" << this->globalCtrBits
+       << " yagsAssociativity=" << this->associativity
+       << " yagsTagLength=" << popCount(this->tagsMask)
+       << " yagsReplacement=" << this->replacementName
+       << " instShiftAmt=" << this->instShiftAmt
+       << " numThreads=" << this->numThreads;
+    if(this->globalHistoryLength)
+        os << " globalHistoryLength=" << this->globalHistoryLength;
+    if(!this->loopPredictor.empty())
+        os << " loopPredictorEntries=" << this->loopPredictor[0].entries();
+    return os.str();
+}
+
+void
+YagsBP::saveSnapshot(const std::string &path) const
+{
+    //the replacement random state, then each thread's global history
+    std::vector<uint64_t> registers(1, this->replacementRng);
+    registers.insert(registers.end(), this->globalHistoryReg.begin(),
+                     this->globalHistoryReg.end());
+    BPSnapshotWriter writer(path, this->snapshotConfig());
+    writer.add("choiceCtrs", this->choiceCounters.data(), this->choiceCounters.dataBytes());
+    writer.add("takenCache", this->directionCaches->takenStorage.data(),
+               this->directionCaches->takenStorage.size());
+    writer.add("notTakenCache", this->directionCaches->notTakenStorage.data(),
+               this->directionCaches->notTakenStorage.size());
+    writer.add("registers", &registers[0], registers.size() * sizeof(registers[0]));
+    //the long histories of all threads, back to back
+    std::vector<uint64_t> longHist;
+    for(unsigned tid = 0; tid < this->longHistory.size(); tid++)
+    {
+        size_t at = longHist.size();
+        longHist.resize(at + this->longHistory[tid].stateWords());
+        this->longHistory[tid].saveState(&longHist[at]);
+    }
+    if(!longHist.empty())
+        writer.add("longHistory", &longHist[0], longHist.size() * sizeof(longHist[0]));
+    //likewise the loop predictors
+    std::vector<uint64_t> loopTable;
+    for(unsigned tid = 0; tid < this->loopPredictor.size(); tid++)
+    {
+        size_t at = loopTable.size();
+        loopTable.resize(at + this->loopPredictor[tid].stateWords());
+        this->loopPredictor[tid].saveState(&loopTable[at]);
+    }
+    if(!loopTable.empty())
+        writer.add("loopTable", &loopTable[0], loopTable.size() * sizeof(loopTable[0]));
+    writer.write();
+}
+
+void
+YagsBP::restoreSnapshot(const std::string &path)
+{
+    BPSnapshotReader reader(path, this->snapshotConfig());
+    std::vector<uint64_t> registers(1 + this->numThreads);
+    reader.read("registers", &registers[0], registers.size() * sizeof(registers[0]));
+    if(!this->longHistory.empty())
+    {
+        size_t words = this->longHistory[0].stateWords();
+        std::vector<uint64_t> longHist(words * this->numThreads);
+        reader.read("longHistory", &longHist[0], longHist.size() * sizeof(longHist[0]));
+        for(unsigned tid = 0; tid < this->numThreads; tid++)
+            this->longHistory[tid].loadState(&longHist[tid * words]);
+    }
+    if(!this->loopPredictor.empty())
+    {
+        size_t words = this->loopPredictor[0].stateWords();
+        std::vector<uint64_t> loopTable(words * this->numThreads);
+        reader.read("loopTable", &loopTable[0], loopTable.size() * sizeof(loopTable[0]));
+        for(unsigned tid = 0; tid < this->numThreads; tid++)
+            this->loopPredictor[tid].loadState(&loopTable[tid * words]);
+    }
+
+    int fd = reader.descriptor();
+    DirectionCaches &sets = *this->directionCaches;
+    this->choiceCounters.mapFile(fd,
+        reader.sectionOffset("choiceCtrs", this->choiceCounters.dataBytes()));
+    sets.takenStorage.mapFile(fd,
+        reader.sectionOffset("takenCache", sets.takenStorage.size()),
+        sets.takenStorage.size());
+    sets.notTakenStorage.mapFile(fd,
+        reader.sectionOffset("notTakenCache", sets.notTakenStorage.size()),
+        sets.notTakenStorage.size());
+    sets.bind();
+
+    this->replacementRng = registers[0];
+    for(unsigned tid = 0; tid < this->numThreads; tid++)
+    {
+        this->globalHistoryReg[tid] = registers[1 + tid] & this->globalHistoryMask;
+        //no branch is in flight across a snapshot
+        this->historyRing[tid].clear();
+    }
+}
+
+void
+YagsBP::serialize(std::ostream &os)
+{
+    std::string snapshot = name() + ".bpsnap";
+    this->saveSnapshot(Checkpoint::dir() + "/" + snapshot);
+    SERIALIZE_SCALAR(snapshot);
+}
+
+void
+YagsBP::unserialize(Checkpoint *cp, const std::string &section)
+{
+    std::string snapshot;
+    UNSERIALIZE_SCALAR(snapshot);
+    this->restoreSnapshot(cp->cptDir + "/" + snapshot);
+}
+
+/*
+ * Reset Data Structures; the tables drop their pages rather than
+ * being rewritten
+ */
+void
+YagsBP::reset()
+{
+    std::fill(this->globalHistoryReg.begin(), this->globalHistoryReg.end(), 0);
+    for(unsigned tid = 0; tid < this->longHistory.size(); tid++)
+        this->longHistory[tid].clear();
+    for(unsigned tid = 0; tid < this->loopPredictor.size(); tid++)
+        this->loopPredictor[tid].clear();
+    this->choiceCounters.reset();
+    this->directionCaches->takenStorage.clear();
+    this->directionCaches->notTakenStorage.clear();
 }
 
 /*
  * Actions for an unconditional branch
  */
 void
-YagsBP::uncondBranch(void * &bpHistory)
+YagsBP::uncondBranch(ThreadID tid, Addr pc, void * &bpHistory)
 {
-    BPHistory *history = new BPHistory;
-    history->globalHistoryReg = this->globalHistoryReg;
+    BPHistory *history = this->historyRing[tid].push(bpHistory);
+    history->globalHistoryReg = this->globalHistoryReg[tid];
     history->takenUsed = 0;
     history->notTakenPred = true;
     history->takenPred = true;
     history->finalPred = true;
-    bpHistory = static_cast<void*>(history);
-    updateGlobalHistReg(true);
+    history->uncond = true;
+    history->loop.entry = -1;
+    history->loop.confident = false;
+    if(!this->longHistory.empty())
+        this->longHistory[tid].save(history->longHistory);
+    updateGlobalHistReg(tid, true);
 }
 
 /*
  * Actions for squash
  */
 void
-YagsBP::squash(void *bpHistory)
+YagsBP::squash(ThreadID tid, void *bpHistory)
 {
 	if(bpHistory)
     {
-    	BPHistory *history = static_cast<BPHistory*>(bpHistory);
-    	this->globalHistoryReg = history->globalHistoryReg;
-    	delete history;
+    	BPHistory *history = &this->historyRing[tid].get(bpHistory);
+    	this->globalHistoryReg[tid] = history->globalHistoryReg;
+    	if(!this->longHistory.empty())
+    		this->longHistory[tid].restore(history->longHistory);
+    	//each squashed branch may have advanced a different loop entry
+    	if(!this->loopPredictor.empty())
+    	{
+    		LoopPredictor &loop = this->loopPredictor[tid];
+    		this->historyRing[tid].squash(bpHistory,
+    			[&loop](const BPHistory &h) { loop.restore(h.loop); });
+    	}
+    	else
+    		this->historyRing[tid].squash(bpHistory);
     }
 }
 
@@ -95,36 +403,69 @@ YagsBP::squash(void *bpHistory)
  * Lookup the actual branch prediction.
  */
 bool
-YagsBP::lookup(Addr branchAddr, void * &bpHistory)
+YagsBP::lookup(ThreadID tid, Addr branchAddr, void * &bpHistory)
+{
+    return (this->*lookupFn)(tid, branchAddr, bpHistory);
+}
+
+template <class Cfg>
+bool
+YagsBP::lookupWays(ThreadID tid, Addr branchAddr, void * &bpHistory)
 {
 	//printf("Performing lookup\n");
+   	BPHistory *history = this->historyRing[tid].push(bpHistory);
+   	bool finalPred = this->predictWays<Cfg>(branchAddr, this->globalHistoryReg[tid], this->threadSalt[tid], *history);
+   	if(!this->longHistory.empty())
+   		this->longHistory[tid].save(history->longHistory);
+   	//a confident loop predictor overrides YAGS, and its iteration
+   	//count follows the branch down the predicted path
+   	history->loop.entry = -1;
+   	history->loop.confident = false;
+   	if(!this->loopPredictor.empty())
+   	{
+   		LoopPredictor &loop = this->loopPredictor[tid];
+   		loop.lookup(branchAddr >> instShiftAmt, history->loop);
+   		finalPred = history->loop.predict(finalPred);
+   		loop.speculate(history->loop, finalPred);
+   	}
+   	//printf("Updating global history\n");
+   	updateGlobalHistReg(tid, finalPred);
+    return finalPred;
+}
+
+template <class Cfg>
+bool
+YagsBP::predictWays(Addr branchAddr, unsigned globalHistory, unsigned salt, BPHistory &history)
+{
 	bool choicePred, finalPred = true;
-	unsigned choiceCountersIdx = ((branchAddr >> instShiftAmt) & this->choicePredictorMask);
+	unsigned choiceCountersIdx = (((branchAddr >> instShiftAmt) ^ salt) & this->choicePredictorMask);
 	//indexing into either takenPredictor or notTakenPredictor
-   	unsigned globalPredictorIdx = ((branchAddr >> instShiftAmt) ^ this->globalHistoryReg) & this->globalPredictorMask;
+   	unsigned globalPredictorIdx = ((branchAddr >> instShiftAmt) ^ globalHistory ^ salt) & this->globalPredictorMask;
 
    	//printf("%u,%u\n",choiceCountersIdx,globalPredictorIdx);
    	assert(choiceCountersIdx < this->choicePredictorSize);
    	assert(globalPredictorIdx < this->globalPredictorSize);
 
-   	uint32_t tag = ((branchAddr >> instShiftAmt) & this->tagsMask) | ((this->globalHistoryReg & this->globalHistoryUnusedMask) << (ceilLog2(_SET_ASSOCITY)));
-   	BPHistory *history = new BPHistory;
-  	history->globalHistoryReg = this->globalHistoryReg;
+   	typename Cfg::Tag tag = this->cacheTag<typename Cfg::Tag>(branchAddr, globalHistory);
+  	history.globalHistoryReg = globalHistory;
    	//printf("Getting choice prediction\n");
-   	choicePred = this->choiceCounters[choiceCountersIdx].read() > this->choiceThreshold;
+   	choicePred = this->choiceCounters.read(choiceCountersIdx) > this->choiceThreshold;
    	if(choicePred)
    	{
    		//the choice predict taken, try to look into notTaken predictor/cache
    		//printf("Getting taken prediction\n");
-   		if(lookupTakenCache(globalPredictorIdx,tag,&finalPred))
+   		if(lookupCache<Cfg>(caches<Cfg>().takenCounters[globalPredictorIdx],tag,&finalPred))
    		{
    			//printf("USING PREDICTION FROM TAKEN PREDICTOR\n");
-   			history->takenPred = finalPred;
-   			history->takenUsed = 1;
+   			history.takenPred = finalPred;
+   			history.takenUsed = 1;
+   			this->stats.takenHits++;
    		}
    		else
    		{
-   			history->takenUsed = 0;
+   			this->stats.takenMisses++;
+   			this->stats.choicePredictions++;
+   			history.takenUsed = 0;
    			finalPred = choicePred;
    		}
    	}
@@ -132,22 +473,23 @@ YagsBP::lookup(Addr branchAddr, void * &bpHistory)
    	{
    		//the choice predict not taken, try to look into Taken predictor/cache
    		//printf("Getting not taken prediction\n");
-   		if(lookupNotTakenCache(globalPredictorIdx,tag,&finalPred))
+   		if(lookupCache<Cfg>(caches<Cfg>().notTakenCounters[globalPredictorIdx],tag,&finalPred))
    		{
    			//printf("USING PREDICTION FROM NOT TAKEN PREDICTOR\n");
-   			history->notTakenPred = finalPred;
-   			history->takenUsed = 2;
+   			history.notTakenPred = finalPred;
+   			history.takenUsed = 2;
+   			this->stats.notTakenHits++;
    		}
    		else
    		{
-   			history->takenUsed = 0;
+   			this->stats.notTakenMisses++;
+   			this->stats.choicePredictions++;
+   			history.takenUsed = 0;
    			finalPred = choicePred;
    		}
    	}
-   	//printf("Updating global history\n");
-   	history->finalPred = finalPred;
-   	bpHistory = static_cast<void*>(history);
-   	updateGlobalHistReg(finalPred);
+   	history.finalPred = finalPred;
+   	history.uncond = false;
     return finalPred;
 }
 
@@ -155,110 +497,258 @@ YagsBP::lookup(Addr branchAddr, void * &bpHistory)
  * BTB Update actions
  */
 void
-YagsBP::btbUpdate(Addr branchAddr, void * &bpHistory)
+YagsBP::btbUpdate(ThreadID tid, Addr branchAddr, void * &bpHistory)
 {
-    this->globalHistoryReg &= (globalHistoryMask & ~ULL(1));
+    //the branch now goes down the not-taken path, so does its loop
+    //iteration count
+    if(!this->loopPredictor.empty() && bpHistory)
+    {
+        BPHistory *history = &this->historyRing[tid].get(bpHistory);
+        this->loopPredictor[tid].restore(history->loop);
+        this->loopPredictor[tid].speculate(history->loop, false);
+    }
+    if(!this->longHistory.empty())
+    {
+        this->longHistory[tid].setLastOutcome(false);
+        this->globalHistoryReg[tid] = this->longHistory[tid].fold(0);
+        return;
+    }
+    this->globalHistoryReg[tid] &= (globalHistoryMask & ~ULL(1));
 }
 
 /*
  * Update data structures after getting actual decison 
  */
 void
-YagsBP::update(Addr branchAddr, bool taken, void *bpHistory, bool squashed)
+YagsBP::update(ThreadID tid, Addr branchAddr, bool taken, void *bpHistory, bool squashed)
+{
+    (this->*updateFn)(tid, branchAddr, taken, bpHistory, squashed);
+}
+
+template <class Cfg>
+void
+YagsBP::updateWays(ThreadID tid, Addr branchAddr, bool taken, void *bpHistory, bool squashed)
 {
 	//printf("Performing update\n");
     if(bpHistory)
     {
-    	BPHistory *history = static_cast<BPHistory *>(bpHistory);
-    	unsigned choiceCountersIdx = ((branchAddr >> instShiftAmt) & this->choicePredictorMask);
+    	BPHistory *history = &this->historyRing[tid].get(bpHistory);
+    	//a confident loop predictor that predicted the branch right
+    	//keeps it out of the tables
+    	if(!(history->loop.confident && history->loop.pred == taken))
+    		this->trainWays<Cfg>(branchAddr, taken, this->threadSalt[tid], *history);
+
+    	if(squashed)
+    	{
+    		//roll the history back to this branch and insert the outcome
+    		this->globalHistoryReg[tid] = history->globalHistoryReg;
+    		if(!this->longHistory.empty())
+    			this->longHistory[tid].restore(history->longHistory);
+    		updateGlobalHistReg(tid, taken);
+    		//likewise the loop iteration count
+    		if(!this->loopPredictor.empty())
+    		{
+    			this->loopPredictor[tid].restore(history->loop);
+    			this->loopPredictor[tid].speculate(history->loop, taken);
+    		}
+    	}
+    	else
+    	{
+    		//the branch commits here, record it if capturing a trace.
+    		if(!this->loopPredictor.empty() && !history->uncond)
+    		{
+    			this->loopPredictor[tid].update(branchAddr >> instShiftAmt, history->loop, taken, history->finalPred);
+    			if(history->loop.confident)
+    			{
+    				this->stats.loopPredictions++;
+    				if(history->loop.pred != taken)
+    					this->stats.loopMispredictions++;
+    			}
+    		}
+    		if(this->profiler && !history->uncond)
+    			this->profiler->record(branchAddr, history->loop.predict(history->finalPred) != taken,
+    			                       history->loop.confident ? 3 : history->takenUsed);
+    		//a trace holds one thread's branches, thread 0's
+    		if(this->traceCapture && tid == 0)
+    			this->traceCapture->record(branchAddr, taken, !history->uncond);
+    		this->historyRing[tid].release(bpHistory);
+    	}
+    }
+
+}
+
+template <class Cfg>
+void
+YagsBP::trainWays(Addr branchAddr, bool taken, unsigned salt, const BPHistory &history)
+{
+    	unsigned choiceCountersIdx = (((branchAddr >> instShiftAmt) ^ salt) & this->choicePredictorMask);
     	//indexing into either takenPredictor or notTakenPredictor
-    	unsigned globalPredictorIdx = ((branchAddr >> instShiftAmt) ^ history->globalHistoryReg) & this->globalPredictorMask;
-   		uint32_t tag = ((branchAddr >> instShiftAmt) & this->tagsMask) | ((history->globalHistoryReg & this->globalHistoryUnusedMask) << (ceilLog2(_SET_ASSOCITY)));
+    	unsigned globalPredictorIdx = ((branchAddr >> instShiftAmt) ^ history.globalHistoryReg ^ salt) & this->globalPredictorMask;
+   		typename Cfg::Tag tag = this->cacheTag<typename Cfg::Tag>(branchAddr, history.globalHistoryReg);
       assert(choiceCountersIdx < this->choicePredictorSize);
    		assert(globalPredictorIdx < this->globalPredictorSize);
-    	switch(history->takenUsed)
+    	switch(history.takenUsed)
     	{
     		case 0:
     			//the choice predictor was used
-    			if(history->finalPred == taken)
+    			if(history.finalPred == taken)
     			{
     				//the case that the prediction is correct
     				if(taken == true)
-    					this->choiceCounters[choiceCountersIdx].increment();
+    					this->choiceCounters.increment(choiceCountersIdx);
     				else
-    					this->choiceCounters[choiceCountersIdx].decrement();
+    					this->choiceCounters.decrement(choiceCountersIdx);
 
     			}
-    			else if(history->finalPred == false && taken == true)
+    			else if(history.finalPred == false && taken == true)
     			{
     				//update the taken predictor(cache)
-            this->updateTakenCache(globalPredictorIdx,tag,taken);
-    				this->choiceCounters[choiceCountersIdx].increment();
+            this->updateCache<Cfg>(caches<Cfg>().takenCounters[globalPredictorIdx],tag,taken);
+    				this->choiceCounters.increment(choiceCountersIdx);
 
     			}
-    			else if(history->finalPred == true && taken == false)
+    			else if(history.finalPred == true && taken == false)
     			{
     				//update the not taken predictor(cache)
-            this->updateNotTakenCache(globalPredictorIdx,tag,taken);
-    				this->choiceCounters[choiceCountersIdx].decrement();
+            this->updateCache<Cfg>(caches<Cfg>().notTakenCounters[globalPredictorIdx],tag,taken);
+    				this->choiceCounters.decrement(choiceCountersIdx);
     			}
     		break;
     		case 1:
     			//the taken predictor was used, choice predictor indicates not taken
-    			if(taken == history->takenPred && (!taken) == false)
+    			if(taken == history.takenPred && (!taken) == false)
     			{
     				
     			}
     			else
     			{
     				if(taken)
-    					this->choiceCounters[choiceCountersIdx].increment();
+    					this->choiceCounters.increment(choiceCountersIdx);
     				else
-    					this->choiceCounters[choiceCountersIdx].decrement();
+    					this->choiceCounters.decrement(choiceCountersIdx);
     			}
-          this->updateTakenCache(globalPredictorIdx,tag,taken);
+          this->updateCache<Cfg>(caches<Cfg>().takenCounters[globalPredictorIdx],tag,taken);
     		break;
     		case 2:
     			//the not taken predictor was used
-    			if(taken == history->notTakenPred && (!taken) == true)
+    			if(taken == history.notTakenPred && (!taken) == true)
     			{
     				
     			}
     			else
     			{
     				if(taken)
-    					this->choiceCounters[choiceCountersIdx].increment();
+    					this->choiceCounters.increment(choiceCountersIdx);
     				else
-    					this->choiceCounters[choiceCountersIdx].decrement();
+    					this->choiceCounters.decrement(choiceCountersIdx);
     			}
-          this->updateNotTakenCache(globalPredictorIdx,tag,taken);
+          this->updateCache<Cfg>(caches<Cfg>().notTakenCounters[globalPredictorIdx],tag,taken);
     		break;
     	}
+}
 
-    	if(squashed)
-    	{
-    		if(taken)
-    			this->globalHistoryReg = (history->globalHistoryReg << 1) | 1;
-    		else
-    			this->globalHistoryReg = (history->globalHistoryReg << 1);
-    		this->globalHistoryReg &= this->globalHistoryMask;
-    	}
-    	else
-    		delete history;
+/*
+ * Offline replay of committed branches: lookup()/uncondBranch() followed
+ * by update(), plus the squashing update() of a mispredicted branch,
+ * folded together
+ */
+uint64_t
+YagsBP::predictBatch(const BranchRecord *recs, size_t count, uint64_t *pred_bits)
+{
+    return (this->*batchFn)(recs, count, pred_bits);
+}
+
+template <class Cfg>
+uint64_t
+YagsBP::predictBatchWays(const BranchRecord *recs, size_t count, uint64_t *pred_bits)
+{
+  //thread 0, which has no salt
+  unsigned ghr = this->globalHistoryReg[0];
+  const unsigned histMask = this->globalHistoryMask;
+  LongHistory<1> *const longHist = this->longHistory.empty() ? NULL : &this->longHistory[0];
+  MispredictProfiler *const profiler = this->profiler.get();
+  LoopPredictor *const loop = this->loopPredictor.empty() ? NULL : &this->loopPredictor[0];
+  uint64_t misses = 0;
+  BPHistory history;
+  history.loop.confident = false;
+
+  for(size_t i = 0; i < count; i++)
+  {
+    const BranchRecord &rec = recs[i];
+    bool taken = rec.taken || !rec.conditional;
+    bool pred;
+    if(rec.conditional)
+    {
+      pred = this->predictWays<Cfg>(rec.pc, ghr, 0, history);
+      if(loop)
+      {
+        loop->lookup(rec.pc >> instShiftAmt, history.loop);
+        pred = history.loop.predict(pred);
+        //the squashing update() leaves the count as if fetched down
+        //the right path
+        loop->speculate(history.loop, taken);
+      }
+      if(pred != taken)
+      {
+        //the squashing update() trains once more
+        misses++;
+        this->trainWays<Cfg>(rec.pc, taken, 0, history);
+      }
+      if(loop)
+      {
+        loop->update(rec.pc >> instShiftAmt, history.loop, taken, history.finalPred);
+        if(history.loop.confident)
+        {
+          this->stats.loopPredictions++;
+          if(pred != taken)
+            this->stats.loopMispredictions++;
+        }
+      }
+      if(profiler)
+        profiler->record(rec.pc, pred != taken,
+                         history.loop.confident ? 3 : history.takenUsed);
+    }
+    else
+    {
+      //as uncondBranch(): the choice predictor was used, predicting taken
+      pred = true;
+      history.globalHistoryReg = ghr;
+      history.takenUsed = 0;
+      history.finalPred = true;
+      history.loop.confident = false;
     }
+    if(pred_bits)
+    {
+      uint64_t bit = ULL(1) << (i & 63);
+      pred_bits[i >> 6] = pred ? pred_bits[i >> 6] | bit : pred_bits[i >> 6] & ~bit;
+    }
+    //commit
+    if(!(history.loop.confident && history.loop.pred == taken))
+      this->trainWays<Cfg>(rec.pc, taken, 0, history);
+    //either the prediction was right or the history was repaired,
+    //so the history always ends up holding the outcome
+    if(longHist)
+    {
+      longHist->push(taken, 0);
+      ghr = longHist->fold(0);
+    }
+    else
+      ghr = ((ghr << 1) | taken) & histMask;
+  }
 
+  this->globalHistoryReg[0] = ghr;
+  return misses;
 }
 
 /*
  * Retire Squashed Instruction
  */
 void
-YagsBP::retireSquashed(void *bp_history)
+YagsBP::retireSquashed(ThreadID tid, void *bp_history)
 {
 	if(bp_history)
     {
-    	BPHistory *history = static_cast<BPHistory*>(bp_history);
-    	delete history;
+    	this->historyRing[tid].release(bp_history);
     }
 }
 
@@ -266,159 +756,143 @@ YagsBP::retireSquashed(void *bp_history)
  * Global History Registor Update 
  */
 void
-YagsBP::updateGlobalHistReg(bool taken)
+YagsBP::updateGlobalHistReg(ThreadID tid, bool taken)
 {
-    this->globalHistoryReg = taken ? this->globalHistoryReg << 1 | 1 : this->globalHistoryReg << 1;
-    this->globalHistoryReg = this->globalHistoryReg & this->globalHistoryMask;
+    //with globalHistoryLength, the register is the fold of the long history
+    if(!this->longHistory.empty())
+    {
+        this->longHistory[tid].push(taken, 0);
+        this->globalHistoryReg[tid] = this->longHistory[tid].fold(0);
+        return;
+    }
+    unsigned &ghr = this->globalHistoryReg[tid];
+    ghr = taken ? ghr << 1 | 1 : ghr << 1;
+    ghr = ghr & this->globalHistoryMask;
 }
 
-bool YagsBP::lookupTakenCache(const unsigned idx,const uint32_t tag, bool *taken)
+template <unsigned Ways>
+void YagsBP::configureWays(unsigned tag_length, const std::string &repl)
 {
-  bool found = 0;
-  for(uint8_t count = 0;count < _SET_ASSOCITY;count++)
-  {
-    if(this->takenCounters[idx].tag[count] == tag)
-    {
-      this->updateTakenCacheLRU(idx,count);  
-      *taken = this->takenCounters[idx].ctr[count].read() > this->globalPredictorThreshold;
-      found = true;
-      return true;
-    }
-  }
+  if(tag_length <= 8)
+    this->configureTag<Ways, uint8_t>(repl);
+  else if(tag_length <= 16)
+    this->configureTag<Ways, uint16_t>(repl);
+  else
+    this->configureTag<Ways, uint32_t>(repl);
+}
 
-  if(found)
-    return true;
+template <unsigned Ways, class Tag>
+void YagsBP::configureTag(const std::string &repl)
+{
+  if(repl == "lru")
+    this->configure<YagsCacheConfig<Ways, Tag, LRUReplacement> >();
+  else if(repl == "plru")
+    this->configure<YagsCacheConfig<Ways, Tag, TreePLRUReplacement> >();
+  else if(repl == "srrip")
+    this->configure<YagsCacheConfig<Ways, Tag, SRRIPReplacement> >();
+  else if(repl == "random")
+    this->configure<YagsCacheConfig<Ways, Tag, RandomReplacement> >();
   else
-    return false;
+    fatal("Invalid YAGS replacement policy, must be lru, plru, srrip or random!\n");
 }
 
-bool YagsBP::lookupNotTakenCache(const unsigned idx,const uint32_t tag,bool *taken)
+template <class Cfg>
+void YagsBP::configure()
 {
+  this->initCache<Cfg>();
+  this->lookupFn = &YagsBP::lookupWays<Cfg>;
+  this->updateFn = &YagsBP::updateWays<Cfg>;
+  this->batchFn = &YagsBP::predictBatchWays<Cfg>;
+  this->replacementName = Cfg::Repl::name();
+  this->replacementBits = 2 * (uint64_t)this->globalPredictorSize *
+                          Cfg::Repl::stateBits();
+}
 
-  bool found = 0;
-  for(uint8_t count = 0;count < _SET_ASSOCITY;count++)
-  {
-    if(this->notTakenCounters[idx].tag[count] == tag)
-    {
-      this->updateNotTakenCacheLRU(idx,count);
-      *taken = this->notTakenCounters[idx].ctr[count].read() > this->globalPredictorThreshold;
-      found = true;
-      return true;
-    }
-  }
+/*
+ * The tag is the low yagsTagLength bits of the branch address. With
+ * associativity, the top history bits no longer take part in the set
+ * index, so they are folded into the low tag bits instead.
+ */
+template <class Tag>
+Tag YagsBP::cacheTag(Addr branchAddr, unsigned globalHistory) const
+{
+  return (Tag)(((branchAddr >> instShiftAmt) ^
+                ((globalHistory & this->globalHistoryUnusedMask) >> this->tagHistoryShift)) &
+               this->tagsMask);
+}
 
-  if(found)
-    return true;
-  else
+template <class Cfg>
+bool YagsBP::lookupCache(CacheSet<Cfg> &set, const typename Cfg::Tag tag, bool *taken)
+{
+  unsigned hits = tagMatchMask<Cfg::Ways>(set.tag, tag);
+  if(!hits)
     return false;
+
+  //use the first matching way
+  uint8_t way = findLsbSet(hits);
+  Cfg::Repl::touch(set.repl, way);
+  this->stats.replacementUpdates++;
+  *taken = PackedCounters::read(set.ctr, way, this->globalCtrShift, this->globalCtrMax) > this->globalPredictorThreshold;
+  return true;
 }
 
-void YagsBP::updateTakenCache(const unsigned idx, const uint32_t tag,const bool taken)
+template <class Cfg>
+void YagsBP::updateCache(CacheSet<Cfg> &set, const typename Cfg::Tag tag, const bool taken)
 {
-  bool found = false;
-  for(uint8_t count = 0;count < _SET_ASSOCITY;count++)
-  {
-    if(this->takenCounters[idx].tag[count] == tag)
-    {
-      this->updateTakenCacheLRU(idx,count);
-      if(taken)
-        this->takenCounters[idx].ctr[count].increment();
-      else
-        this->takenCounters[idx].ctr[count].decrement();
-      found = true;
-    }
-  }
-  //if did not find any matching tag
-  //replace the least-recently-used one
-  
-  if(!found)
+  unsigned hits = tagMatchMask<Cfg::Ways>(set.tag, tag);
+
+  //update every matching way; only the zero tags of ways that were
+  //never replaced can match more than once
+  for(unsigned remaining = hits; remaining; remaining &= remaining - 1)
   {
-    uint8_t LRU = this->takenCounters[idx].LRU;
-    this->takenCounters[idx].tag[LRU] = tag;
-    //reset the counter
-    this->takenCounters[idx].ctr[LRU].setBits(this->globalCtrBits);
-    
+    uint8_t way = findLsbSet(remaining);
+    Cfg::Repl::touch(set.repl, way);
+    this->stats.replacementUpdates++;
     if(taken)
-      this->takenCounters[idx].ctr[LRU].increment();
+      PackedCounters::increment(set.ctr, way, this->globalCtrShift, this->globalCtrMax);
     else
-      this->takenCounters[idx].ctr[LRU].decrement();
-    
-  }
-}
-
-void YagsBP::updateNotTakenCache(const unsigned idx, const uint32_t tag,const bool taken)
-{
-  bool found = false;
-  for(uint8_t count = 0;count < _SET_ASSOCITY;count++)
-  {
-    if(this->notTakenCounters[idx].tag[count] == tag)
-    {
-      this->updateNotTakenCacheLRU(idx,count);
-      if(taken)
-        this->notTakenCounters[idx].ctr[count].increment();
-      else
-        this->notTakenCounters[idx].ctr[count].decrement();
-
-      found = true;
-    }
+      PackedCounters::decrement(set.ctr, way, this->globalCtrShift, this->globalCtrMax);
   }
-  //if did not find any matching tag
-  //replace the least-recently-used one
-  if(!found)
+  //if did not find any matching tag, replace the victim the set's own
+  //replacement state picks and make the new tag most recently used
+  if(!hits)
   {
-    uint8_t LRU = this->takenCounters[idx].LRU;
-    this->notTakenCounters[idx].tag[LRU] = tag;
-    //reset the counter 
-    this->notTakenCounters[idx].ctr[LRU].setBits(this->globalCtrBits);
+    uint8_t victim = Cfg::Repl::victim(set.repl, this->replacementRng);
+    set.tag[victim] = tag;
+    Cfg::Repl::insert(set.repl, victim);
+    this->stats.replacements++;
+    this->stats.replacementUpdates++;
+    //the counter carries over from the replaced branch
     if(taken)
-      this->notTakenCounters[idx].ctr[LRU].increment();
+      PackedCounters::increment(set.ctr, victim, this->globalCtrShift, this->globalCtrMax);
     else
-      this->notTakenCounters[idx].ctr[LRU].decrement();
+      PackedCounters::decrement(set.ctr, victim, this->globalCtrShift, this->globalCtrMax);
   }
 }
 
-void YagsBP::initCache()
+template <class Cfg>
+YagsBP::DirectionCachesWays<Cfg>::DirectionCachesWays(unsigned sets, bool huge_pages)
 {
-    printf("Initilizing taken/notTaken counters with %u 1s\n",this->globalCtrBits);
-    for(uint32_t count = 0; count < this->globalPredictorSize; count++)
-    {
-      for(uint8_t count_entry = 0;count_entry < _SET_ASSOCITY;count_entry++)
-      {
-        this->takenCounters[count].ctr[count_entry].setBits(this->globalCtrBits);
-        this->takenCounters[count].tag[count_entry] = 0;
-        this->takenCounters[count].used[count_entry] = count_entry;
-        this->notTakenCounters[count].ctr[count_entry].setBits(this->globalCtrBits);
-        this->notTakenCounters[count].tag[count_entry] = 0;
-        this->notTakenCounters[count].used[count_entry] = count_entry;
-      }
-      this->takenCounters[count].LRU = 0;
-      this->notTakenCounters[count].LRU = 0;
-    }
-    printf("Cache initilization done\n");
+  //page-aligned, so no set straddles a cache line, and zero-filled
+  //lazily: all-zero tags, counters and replacement state are the
+  //initial state, so no set is touched here
+  this->takenStorage.allocate(sets * sizeof(CacheSet<Cfg>), huge_pages);
+  this->notTakenStorage.allocate(sets * sizeof(CacheSet<Cfg>), huge_pages);
+  this->bind();
 }
 
-void YagsBP::updateTakenCacheLRU(const unsigned idx, const uint8_t entry_idx)
+template <class Cfg>
+void YagsBP::DirectionCachesWays<Cfg>::bind()
 {
-  uint8_t threshold_used = this->takenCounters[idx].used[entry_idx];
-  this->takenCounters[idx].used[entry_idx] = _SET_ASSOCITY - 1;
-  for(uint8_t count = 0; count < _SET_ASSOCITY;count++)
-  {
-    if(this->takenCounters[idx].used[count] > threshold_used && count != entry_idx)
-      this->takenCounters[idx].used[count]--;
-    if(this->takenCounters[idx].used[count] == 0)
-      this->takenCounters[idx].LRU = count;
-  }
+  this->takenCounters = static_cast<CacheSet<Cfg> *>(this->takenStorage.data());
+  this->notTakenCounters = static_cast<CacheSet<Cfg> *>(this->notTakenStorage.data());
 }
 
-void YagsBP::updateNotTakenCacheLRU(const unsigned idx, const uint8_t entry_idx)
+template <class Cfg>
+void YagsBP::initCache()
 {
-  uint8_t threshold_used = this->notTakenCounters[idx].used[entry_idx];
-  this->notTakenCounters[idx].used[entry_idx] = _SET_ASSOCITY - 1;
-  for(uint8_t count = 0; count < _SET_ASSOCITY;count++)
-  {
-    if(this->notTakenCounters[idx].used[count] > threshold_used && count != entry_idx)
-      this->notTakenCounters[idx].used[count]--;
-    if(this->notTakenCounters[idx].used[count] == 0)
-      this->notTakenCounters[idx].LRU = count;
-  }
-}
\ No newline at end of file
+    DPRINTF(Fetch, "Initializing taken/notTaken counters with %u bits\n", this->globalCtrBits);
+    this->directionCaches.reset(
+        new DirectionCachesWays<Cfg>(this->globalPredictorSize, this->tableHugePages));
+    DPRINTF(Fetch, "Cache initialization done\n");
+}
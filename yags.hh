@@ -9,8 +9,21 @@
 #ifndef __CPU_PRED_YAGS_PRED_HH__
 #define __CPU_PRED_YAGS_PRED_HH__
 
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/statistics.hh"
+#include "cpu/pred/bp_trace_capture.hh"
 #include "cpu/pred/bpred_unit.hh"
-#include "cpu/pred/sat_counter.hh"
+#include "cpu/pred/history_ring.hh"
+#include "cpu/pred/long_history.hh"
+#include "cpu/pred/loop_predictor.hh"
+#include "cpu/pred/mispredict_profile.hh"
+#include "cpu/pred/packed_counters.hh"
+#include "cpu/pred/set_replacement.hh"
+#include "cpu/pred/table_storage.hh"
+#include "cpu/pred/tag_match.hh"
 
 /*
  * Feel free to make any modifications, this is a skeleton code
@@ -18,37 +31,198 @@
  * Note: Do not change name of class
  */
 
+// word holding the counters of one YAGS cache set, 4 bits per way
+template <unsigned Ways> struct YagsCounterWord;
+template <> struct YagsCounterWord<1> { typedef uint8_t Type; };
+template <> struct YagsCounterWord<2> { typedef uint8_t Type; };
+template <> struct YagsCounterWord<4> { typedef uint16_t Type; };
+template <> struct YagsCounterWord<8> { typedef uint32_t Type; };
+
+// one configuration of the YAGS taken/not-taken caches: ways per set,
+// tag type and replacement policy (see set_replacement.hh)
+template <unsigned W, class T, template <unsigned> class R>
+struct YagsCacheConfig
+{
+    static const unsigned Ways = W;
+    typedef T Tag;
+    typedef R<W> Repl;
+};
+
+// access counts of a YagsBP, for tuning and power models
+struct YagsStats
+{
+    YagsStats()
+        : choicePredictions(0), takenHits(0), takenMisses(0),
+          notTakenHits(0), notTakenMisses(0), replacements(0),
+          replacementUpdates(0), loopPredictions(0), loopMispredictions(0)
+    { }
 
- #define _SET_ASSOCITY 1
- #define _YAGS_TAG_LENGTH 8
+    // predictions made by the choice predictor alone, the cache missed
+    uint64_t choicePredictions;
+    // hits and misses of prediction lookups in the taken cache
+    uint64_t takenHits;
+    uint64_t takenMisses;
+    // and in the not-taken cache
+    uint64_t notTakenHits;
+    uint64_t notTakenMisses;
+    // cache updates that missed and replaced a way
+    uint64_t replacements;
+    // replacement state updates, on hits and fills
+    uint64_t replacementUpdates;
+    // committed branches the loop predictor predicted instead of the
+    // caches and choice predictor (with loopPredictorEntries)
+    uint64_t loopPredictions;
+    // and of those, the mispredicted ones
+    uint64_t loopMispredictions;
+};
 
+/*
+ * Each of the numThreads hardware threads has its own global history
+ * register and history checkpoints, while the choice predictor and the
+ * caches are shared. With threadIndexSalt, every thread but thread 0
+ * XORs a fixed salt into the choice and cache indices.
+ *
+ * With globalHistoryLength set, the history register holds the last
+ * globalHistoryLength outcomes folded down to its width (see
+ * long_history.hh), so the cache index and tag hash more history than
+ * the cache has index bits.
+ *
+ * The associativity of the taken/not-taken caches (yagsAssociativity,
+ * 1, 2, 4 or 8), the tag length (yagsTagLength) and the replacement
+ * policy (yagsReplacement: lru, plru, srrip or random) are parameters.
+ * The lookup and update paths are compiled once per associativity, tag
+ * width (8, 16 or 32 bits) and policy, so tag matching is a single
+ * vector compare, and the constructor picks the instantiation to use.
+ *
+ * With loopPredictorEntries set, each thread also has a loop predictor
+ * (see loop_predictor.hh) that overrides YAGS for the loop branches it
+ * is confident about. A branch it predicts right does not train the
+ * choice predictor and caches at commit.
+ */
 class YagsBP : public BPredUnit
 {
   public:
     YagsBP(const Params *params);
-    void uncondBranch(void * &bp_history);
-    void squash(void *bp_history);
-    bool lookup(Addr branch_addr, void * &bp_history);
-    void btbUpdate(Addr branch_addr, void * &bp_history);
-    void update(Addr branch_addr, bool taken, void *bp_history, bool squashed);
-    void retireSquashed(void *bp_history);
+    void uncondBranch(ThreadID tid, Addr pc, void * &bp_history);
+    void squash(ThreadID tid, void *bp_history);
+    bool lookup(ThreadID tid, Addr branch_addr, void * &bp_history);
+    void btbUpdate(ThreadID tid, Addr branch_addr, void * &bp_history);
+    void update(ThreadID tid, Addr branch_addr, bool taken, void *bp_history,
+                bool squashed);
+    void retireSquashed(ThreadID tid, void *bp_history);
+    void reset();
+
+    // predict and train on a run of committed branches of thread 0
+    // without the BPredUnit hooks: each branch resolves before the next, so the
+    // global history stays in a register and no checkpoints are taken.
+    // The tables end up exactly as after lookup()/uncondBranch() and
+    // update() for every record; nothing is recorded to
+    // branchTraceFile. If pred_bits is not NULL, bit i of word i / 64
+    // is set to the prediction for recs[i]. Returns the number of
+    // mispredicted conditional branches.
+    uint64_t predictBatch(const BranchRecord *recs, size_t count,
+                          uint64_t *pred_bits);
+
+    // write the choice counters, both caches, the global histories and
+    // the replacement random state to a snapshot file (see
+    // bp_snapshot.hh); no branch may be in flight
+    void saveSnapshot(const std::string &path) const;
+    // restore them from a snapshot of a predictor with the same table
+    // parameters, mapping the tables copy-on-write from the file
+    void restoreSnapshot(const std::string &path);
+
+    // checkpointing: the tables go to a snapshot next to the
+    // checkpoint, named in the checkpoint
+    void serialize(std::ostream &os);
+    void unserialize(Checkpoint *cp, const std::string &section);
+
+    // occupancy counts of a thread's history checkpoint ring
+    const HistoryRingStats &historyStats(ThreadID tid = 0) const
+    { return historyRing[tid].getStats(); }
+
+    // cache access and replacement counts
+    const YagsStats &accessStats() const { return stats; }
+
+    // register accessStats() as gem5 statistics
+    void regStats();
+
+    // name of the replacement policy of the taken/notTaken caches
+    const char *replacementPolicy() const { return replacementName; }
+    // bits of replacement state of both caches together
+    uint64_t replacementStorageBits() const { return replacementBits; }
+    // bits of predictor state: the choice counters, the tags, counters
+    // and replacement state of both caches, the history registers (or
+    // long histories) and the loop predictors
+    uint64_t storageBits() const;
 
   private:
-    void updateGlobalHistReg(bool taken);
+    //parameters a snapshot must agree on, as a string
+    std::string snapshotConfig() const;
+
+    // one set of a taken/notTaken cache, structure-of-arrays: the tags of
+    // all ways come first, at the width of yagsTagLength, so they can be
+    // matched with one vector compare (see tag_match.hh)
+    template <class Cfg>
+    struct CacheSetFields
+    {
+        typename Cfg::Tag tag[Cfg::Ways];
+        // the globalCtrBits saturating counters of the ways, packed in
+        // slots of up to 4 bits (see packed_counters.hh)
+        typename YagsCounterWord<Cfg::Ways>::Type ctr;
+        // replacement state (see set_replacement.hh)
+        typename Cfg::Repl::State repl;
+    };
+
+    // sets are padded to a power of two (at least 8 bytes, at most a
+    // 64 byte line) so a set never straddles a cache line
+    template <size_t Bytes>
+    struct SetAlign
+    {
+        static const size_t value =
+            Bytes <= 8 ? 8 : Bytes <= 16 ? 16 : Bytes <= 32 ? 32 : 64;
+    };
+
+    template <class Cfg>
+    struct alignas(SetAlign<sizeof(CacheSetFields<Cfg>)>::value)
+        CacheSet : public CacheSetFields<Cfg>
+    { };
+
+    void updateGlobalHistReg(ThreadID tid, bool taken);
 
-    //init cache
+    //lookup()/update() for one cache configuration (YagsCacheConfig)
+    template <class Cfg>
+    bool lookupWays(ThreadID tid, Addr branch_addr, void * &bp_history);
+    template <class Cfg>
+    void updateWays(ThreadID tid, Addr branch_addr, bool taken,
+                    void *bp_history, bool squashed);
+    template <class Cfg>
+    uint64_t predictBatchWays(const BranchRecord *recs, size_t count,
+                              uint64_t *pred_bits);
+
+    //pick the tag type and replacement policy, then set up the caches
+    template <unsigned Ways>
+    void configureWays(unsigned tag_length, const std::string &repl);
+    template <unsigned Ways, class Tag>
+    void configureTag(const std::string &repl);
+    template <class Cfg>
+    void configure();
+
+    //allocate and init cache
+    template <class Cfg>
     void initCache();
 
-    //return true means hit, false means miss
-    bool lookupTakenCache(const unsigned idx,const uint32_t tag, bool *taken);
-    bool lookupNotTakenCache(const unsigned idx,const uint32_t tag, bool *taken);
-    
+    //tag of a branch in the taken/notTaken caches
+    template <class Tag>
+    Tag cacheTag(Addr branch_addr, unsigned global_history) const;
 
-    void updateTakenCache(const unsigned idx, const uint32_t tag,const bool taken);
-    void updateNotTakenCache(const unsigned idx, const uint32_t tag,const bool taken);
+    //return true means hit, false means miss
+    template <class Cfg>
+    bool lookupCache(CacheSet<Cfg> &set, const typename Cfg::Tag tag,
+                     bool *taken);
 
-    void updateTakenCacheLRU(const unsigned idx, const uint8_t entry_idx);
-    void updateNotTakenCacheLRU(const unsigned idx, const uint8_t entry_idx);
+    template <class Cfg>
+    void updateCache(CacheSet<Cfg> &set, const typename Cfg::Tag tag,
+                     const bool taken);
 
     struct BPHistory {
         unsigned globalHistoryReg;
@@ -69,29 +243,97 @@ class YagsBP : public BPredUnit
         // true: predict taken
         // false: predict not-taken
         bool finalPred;
+        // true if the history belongs to an unconditional branch
+        bool uncond;
+        // the long history before this branch, with globalHistoryLength
+        LongHistory<1>::Checkpoint longHistory;
+        // what the loop predictor found; the prediction made is
+        // loop.predict(finalPred)
+        LoopPredictor::Lookup loop;
+    };
+
+    // number of hardware threads
+    unsigned numThreads;
+
+    // per thread, the checkpoints handed out as bp_history by lookup()
+    // and uncondBranch()
+    std::vector<HistoryRing<BPHistory> > historyRing;
+
+    //prediction with the given history and thread salt, filling in
+    //'history'
+    template <class Cfg>
+    bool predictWays(Addr branch_addr, unsigned global_history,
+                     unsigned salt, BPHistory &history);
+    //train the tables on the outcome of a branch predicted as 'history'
+    template <class Cfg>
+    void trainWays(Addr branch_addr, bool taken, unsigned salt,
+                   const BPHistory &history);
+
+    // the taken and not-taken caches, whatever their layout
+    struct DirectionCaches
+    {
+        virtual ~DirectionCaches() { }
+        // point the typed set arrays at the storage again
+        virtual void bind() = 0;
+
+        TableStorage takenStorage;
+        TableStorage notTakenStorage;
     };
 
-    struct CacheEntry
+    template <class Cfg>
+    struct DirectionCachesWays : public DirectionCaches
     {
-        SatCounter ctr[_SET_ASSOCITY];
-        uint32_t tag[_SET_ASSOCITY];
-        uint8_t LRU;
-        uint8_t used[_SET_ASSOCITY];
+        DirectionCachesWays(unsigned sets, bool huge_pages);
+        void bind();
+
+        // taken direction predictors
+        CacheSet<Cfg> *takenCounters;
+        // not-taken direction predictors
+        CacheSet<Cfg> *notTakenCounters;
     };
 
+    template <class Cfg>
+    DirectionCachesWays<Cfg> &
+    caches()
+    {
+        return static_cast<DirectionCachesWays<Cfg> &>(*directionCaches);
+    }
+
     // choice predictors
-    std::vector<SatCounter> choiceCounters;
-    // taken direction predictors
-    std::vector<CacheEntry> takenCounters;
-    // not-taken direction predictors
-    std::vector<CacheEntry> notTakenCounters;
+    PackedCounterTable choiceCounters;
+    // taken and not-taken direction predictors
+    std::unique_ptr<DirectionCaches> directionCaches;
+
+    // lookupWays()/updateWays()/predictBatchWays() for the configured
+    // associativity, tag and replacement policy
+    bool (YagsBP::*lookupFn)(ThreadID tid, Addr branch_addr,
+                             void * &bp_history);
+    void (YagsBP::*updateFn)(ThreadID tid, Addr branch_addr, bool taken,
+                             void *bp_history, bool squashed);
+    uint64_t (YagsBP::*batchFn)(const BranchRecord *recs, size_t count,
+                                uint64_t *pred_bits);
+
+    // ways per set of the taken and not-taken caches
+    unsigned associativity;
+    // log2(associativity)
+    unsigned associativityBits;
+    // shift bringing the history bits above the cache index down to bit 0
+    unsigned tagHistoryShift;
 
     unsigned instShiftAmt;
 
-    unsigned globalHistoryReg;
+    // global history register of each thread
+    std::vector<unsigned> globalHistoryReg;
     unsigned globalHistoryBits;
     unsigned globalHistoryMask;
     unsigned globalHistoryUnusedMask;
+    // outcomes folded into the history register if not 0
+    unsigned globalHistoryLength;
+    // per thread, the history folded into globalHistoryReg, with
+    // globalHistoryLength
+    std::vector<LongHistory<1> > longHistory;
+    // per thread, the loop predictor, with loopPredictorEntries
+    std::vector<LoopPredictor> loopPredictor;
 
     unsigned choicePredictorSize;
     unsigned choiceCtrBits;
@@ -99,12 +341,46 @@ class YagsBP : public BPredUnit
 
     unsigned globalPredictorSize;
     unsigned globalCtrBits;
+    unsigned globalCtrMax;
+    unsigned globalCtrShift;
     unsigned globalPredictorMask;
 
     unsigned choiceThreshold;
     unsigned globalPredictorThreshold;
 
     unsigned tagsMask;
+
+    // per thread, the salt XORed into the indices (0 unless
+    // threadIndexSalt is set)
+    std::vector<unsigned> threadSalt;
+
+    // replacement policy name and state size, for reporting
+    const char *replacementName;
+    uint64_t replacementBits;
+    // random number state of the random replacement policy
+    uint64_t replacementRng;
+    // back the tables with huge pages (tableHugePages)
+    bool tableHugePages;
+
+    // records committed branches if branchTraceFile is set
+    std::unique_ptr<BranchTraceCapture> traceCapture;
+    // profiles mispredicted branches if mispredictProfile is set, by
+    // the component that predicted them (BPHistory::takenUsed, or 3 for
+    // the loop predictor)
+    std::unique_ptr<MispredictProfiler> profiler;
+
+    YagsStats stats;
+
+    // the counts of 'stats' as gem5 statistics
+    Stats::Value statChoicePredictions;
+    Stats::Value statTakenHits;
+    Stats::Value statTakenMisses;
+    Stats::Value statNotTakenHits;
+    Stats::Value statNotTakenMisses;
+    Stats::Value statReplacements;
+    Stats::Value statReplacementUpdates;
+    Stats::Value statLoopPredictions;
+    Stats::Value statLoopMispredictions;
 };
 
 #endif // __CPU_PRED_YAGS_PRED_HH__